@@ -682,7 +682,8 @@ wl_connection_demarshal(struct wl_connection *connection,
 				goto err;
 			}
 
-			if (wl_map_reserve_new(objects, id) < 0) {
+			if (objects != NULL &&
+			    wl_map_reserve_new(objects, id) < 0) {
 				printf("not a valid new object id (%d), "
 				       "message %s(%s)\n",
 				       id, message->name, message->signature);
@@ -800,6 +801,49 @@ wl_closure_lookup_objects(struct wl_closure *closure, struct wl_map *objects)
 	return 0;
 }
 
+int
+wl_closure_reserve_new_ids(struct wl_closure *closure, struct wl_map *objects)
+{
+	const struct wl_message *message;
+	const char *signature;
+	struct argument_details arg;
+	int i, count;
+
+	message = closure->message;
+	signature = message->signature;
+	count = arg_count_for_signature(signature);
+	for (i = 0; i < count; i++) {
+		signature = get_next_argument(signature, &arg);
+		if (arg.type != 'n' || closure->args[i].n == 0)
+			continue;
+
+		if (wl_map_reserve_new(objects, closure->args[i].n) < 0) {
+			printf("not a valid new object id (%d), "
+			       "message %s(%s)\n", closure->args[i].n,
+			       message->name, message->signature);
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+void
+wl_closure_close_fds(struct wl_closure *closure)
+{
+	const char *signature;
+	struct argument_details arg;
+	int i;
+
+	signature = closure->message->signature;
+	for (i = 0; i < closure->count; i++) {
+		signature = get_next_argument(signature, &arg);
+		if (arg.type == 'h')
+			close(closure->args[i].h);
+	}
+}
+
 static void
 convert_arguments_to_ffi(const char *signature, uint32_t flags,
 			 union wl_argument *args,
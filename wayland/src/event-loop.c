@@ -43,6 +43,7 @@ struct wl_event_loop {
 	struct wl_list check_list;
 	struct wl_list idle_list;
 	struct wl_list destroy_list;
+	uint32_t dispatch_serial;
 
 	struct wl_signal destroy_signal;
 };
@@ -58,8 +59,28 @@ struct wl_event_source {
 	struct wl_list link;
 	void *data;
 	int fd;
+	int priority;
+	uint32_t last_dispatch;
 };
 
+/* How many low priority sources may be dispatched per iteration. */
+#define LOW_PRIORITY_BUDGET 8
+
+/* Whether the ready source a goes before b: higher priority first, and
+ * among low priority sources the one dispatched longest ago first, so
+ * that the budget rotates through all of them. */
+static int
+source_dispatch_before(struct wl_event_source *a, struct wl_event_source *b)
+{
+	if (a->priority != b->priority)
+		return a->priority > b->priority;
+
+	if (a->priority < WL_EVENT_PRIORITY_DEFAULT)
+		return (int32_t) (a->last_dispatch - b->last_dispatch) < 0;
+
+	return 0;
+}
+
 struct wl_event_source_fd {
 	struct wl_event_source base;
 	wl_event_loop_fd_func_t func;
@@ -104,6 +125,8 @@ add_source(struct wl_event_loop *loop,
 
 	source->loop = loop;
 	source->data = data;
+	source->priority = WL_EVENT_PRIORITY_DEFAULT;
+	source->last_dispatch = 0;
 	wl_list_init(&source->link);
 
 	memset(&ep, 0, sizeof ep);
@@ -296,6 +319,8 @@ wl_event_loop_add_idle(struct wl_event_loop *loop,
 	source->base.interface = &idle_source_interface;
 	source->base.loop = loop;
 	source->base.fd = -1;
+	source->base.priority = WL_EVENT_PRIORITY_DEFAULT;
+	source->base.last_dispatch = 0;
 
 	source->func = func;
 	source->base.data = data;
@@ -311,6 +336,12 @@ wl_event_source_check(struct wl_event_source *source)
 	wl_list_insert(source->loop->check_list.prev, &source->link);
 }
 
+WL_EXPORT void
+wl_event_source_set_priority(struct wl_event_source *source, int priority)
+{
+	source->priority = priority;
+}
+
 WL_EXPORT int
 wl_event_source_remove(struct wl_event_source *source)
 {
@@ -358,6 +389,7 @@ wl_event_loop_create(void)
 	wl_list_init(&loop->check_list);
 	wl_list_init(&loop->idle_list);
 	wl_list_init(&loop->destroy_list);
+	loop->dispatch_serial = 0;
 
 	wl_signal_init(&loop->destroy_signal);
 
@@ -405,9 +437,9 @@ wl_event_loop_dispatch_idle(struct wl_event_loop *loop)
 WL_EXPORT int
 wl_event_loop_dispatch(struct wl_event_loop *loop, int timeout)
 {
-	struct epoll_event ep[32];
+	struct epoll_event ep[32], tmp;
 	struct wl_event_source *source;
-	int i, count, n;
+	int i, j, count, n, budget;
 
 	wl_event_loop_dispatch_idle(loop);
 
@@ -415,8 +447,30 @@ wl_event_loop_dispatch(struct wl_event_loop *loop, int timeout)
 	if (count < 0)
 		return -1;
 
+	/* Stable sort, so that otherwise equal sources are still
+	 * dispatched in the order epoll reported them. */
+	for (i = 1; i < count; i++) {
+		tmp = ep[i];
+		for (j = i; j > 0; j--) {
+			if (!source_dispatch_before(tmp.data.ptr,
+						    ep[j - 1].data.ptr))
+				break;
+			ep[j] = ep[j - 1];
+		}
+		ep[j] = tmp;
+	}
+
+	/* Sources skipped once the budget runs out are still ready, so
+	 * epoll reports them again on the next iteration, where they sort
+	 * ahead of the ones dispatched now. */
+	loop->dispatch_serial++;
+	budget = LOW_PRIORITY_BUDGET;
 	for (i = 0; i < count; i++) {
 		source = ep[i].data.ptr;
+		if (source->priority < WL_EVENT_PRIORITY_DEFAULT &&
+		    budget-- == 0)
+			break;
+		source->last_dispatch = loop->dispatch_serial;
 		if (source->fd != -1)
 			source->interface->dispatch(source, &ep[i]);
 	}
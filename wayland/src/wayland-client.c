@@ -47,7 +47,8 @@
 
 enum wl_proxy_flag {
 	WL_PROXY_FLAG_ID_DELETED = (1 << 0),
-	WL_PROXY_FLAG_DESTROYED = (1 << 1)
+	WL_PROXY_FLAG_DESTROYED = (1 << 1),
+	WL_PROXY_FLAG_SYNC = (1 << 2)
 };
 
 struct wl_proxy {
@@ -71,6 +72,9 @@ struct wl_event_queue {
 	struct wl_list event_list;
 	struct wl_display *display;
 	pthread_cond_t cond;
+	struct wl_proxy *sync_proxy;
+	uint32_t sync_sent;
+	uint32_t sync_done;
 };
 
 struct wl_display {
@@ -122,6 +126,9 @@ wl_event_queue_init(struct wl_event_queue *queue, struct wl_display *display)
 	wl_list_init(&queue->event_list);
 	pthread_cond_init(&queue->cond, NULL);
 	queue->display = display;
+	queue->sync_proxy = NULL;
+	queue->sync_sent = 0;
+	queue->sync_done = 0;
 }
 
 static void
@@ -136,6 +143,15 @@ wl_event_queue_release(struct wl_event_queue *queue)
 		wl_closure_destroy(closure);
 	}
 	pthread_cond_destroy(&queue->cond);
+
+	/* Callback ids still in flight keep the sync proxy alive until
+	 * their done event is read, see queue_event(). */
+	if (queue->sync_proxy) {
+		queue->sync_proxy->flags |= WL_PROXY_FLAG_DESTROYED;
+		queue->sync_proxy->refcount--;
+		if (!queue->sync_proxy->refcount)
+			free(queue->sync_proxy);
+	}
 }
 
 /** Destroy an event queue
@@ -595,6 +611,11 @@ wl_display_disconnect(struct wl_display *display)
 {
 	wl_connection_destroy(display->connection);
 	wl_map_release(&display->objects);
+
+	/* The object map is gone, so in-flight round trips no longer hold
+	 * a reference to the sync proxy. */
+	if (display->queue.sync_proxy)
+		display->queue.sync_proxy->refcount = 1;
 	wl_event_queue_release(&display->queue);
 	pthread_mutex_destroy(&display->mutex);
 	if (display->fd > 0)
@@ -619,47 +640,138 @@ wl_display_get_fd(struct wl_display *display)
 	return display->fd;
 }
 
-static void
-sync_callback(void *data, struct wl_callback *callback, uint32_t serial)
+static int
+dispatch_queue(struct wl_display *display,
+	       struct wl_event_queue *queue, int block);
+
+/* Sends a wl_display.sync request whose done event is only counted in
+ * queue->sync_done instead of going to a listener. All round trips on
+ * a queue share its sync proxy, and each callback id in flight holds a
+ * reference to it, so after the first round trip none of them allocate
+ * a proxy. Must be called with the display mutex held. */
+static int
+queue_send_sync(struct wl_event_queue *queue, uint32_t *ticket)
 {
-   int *done = data;
+	struct wl_display *display = queue->display;
+	struct wl_proxy *proxy = queue->sync_proxy;
+	struct wl_closure *closure;
+	union wl_argument args[1];
+	uint32_t request[3], id;
+
+	if (proxy == NULL) {
+		proxy = malloc(sizeof *proxy);
+		if (proxy == NULL) {
+			errno = ENOMEM;
+			return -1;
+		}
 
-   *done = 1;
-   wl_callback_destroy(callback);
-}
+		memset(proxy, 0, sizeof *proxy);
+		proxy->object.interface = &wl_callback_interface;
+		proxy->display = display;
+		proxy->queue = queue;
+		proxy->flags = WL_PROXY_FLAG_SYNC;
+		proxy->refcount = 1;
+		queue->sync_proxy = proxy;
+	}
 
-static const struct wl_callback_listener sync_listener = {
-	sync_callback
-};
+	id = wl_map_insert_new(&display->objects, 0, proxy);
+	if (id == 0) {
+		errno = ENOMEM;
+		return -1;
+	}
+	proxy->object.id = id;
+	proxy->refcount++;
+
+	if (wl_debug) {
+		args[0].o = &proxy->object;
+		closure = wl_closure_marshal(&display->proxy.object,
+					     WL_DISPLAY_SYNC, args,
+					     &wl_display_interface.methods[WL_DISPLAY_SYNC]);
+		if (closure) {
+			wl_closure_print(closure, &display->proxy.object, true);
+			wl_closure_destroy(closure);
+		}
+	}
+
+	request[0] = display->proxy.object.id;
+	request[1] = sizeof request << 16 | WL_DISPLAY_SYNC;
+	request[2] = id;
+	if (wl_connection_write(display->connection,
+				request, sizeof request) < 0) {
+		display_fatal_error(display, errno);
+		return -1;
+	}
+
+	*ticket = ++queue->sync_sent;
+
+	return 0;
+}
 
 /** Block until all pending request are processed by the server
  *
  * \param display The display context object
+ * \param queue The queue to dispatch while waiting
  * \return The number of dispatched events on success or -1 on failure
  *
  * Blocks until the server process all currently issued requests and
- * sends out pending events on all event queues.
+ * sends out pending events. Only events on \c queue are dispatched
+ * while waiting, so this can be used by a thread that only dispatches
+ * its own queue.
+ *
+ * \sa wl_display_roundtrip()
  *
  * \memberof wl_display
  */
 WL_EXPORT int
-wl_display_roundtrip(struct wl_display *display)
+wl_display_roundtrip_queue(struct wl_display *display,
+			   struct wl_event_queue *queue)
 {
-	struct wl_callback *callback;
+	uint32_t ticket;
 	int done, ret = 0;
 
-	done = 0;
-	callback = wl_display_sync(display);
-	wl_callback_add_listener(callback, &sync_listener, &done);
-	while (!done && ret >= 0)
-		ret = wl_display_dispatch(display);
+	pthread_mutex_lock(&display->mutex);
+	if (display->last_error) {
+		errno = display->last_error;
+		ret = -1;
+	} else if (queue_send_sync(queue, &ticket) < 0) {
+		ret = -1;
+	}
+	pthread_mutex_unlock(&display->mutex);
 
-	if (ret == -1 && !done)
-		wl_callback_destroy(callback);
+	while (ret >= 0) {
+		pthread_mutex_lock(&display->mutex);
+		done = (int32_t) (queue->sync_done - ticket) >= 0;
+		pthread_mutex_unlock(&display->mutex);
+		if (done)
+			break;
+
+		ret = dispatch_queue(display, queue, 1);
+	}
 
 	return ret;
 }
 
+/** Block until all pending request are processed by the server
+ *
+ * \param display The display context object
+ * \return The number of dispatched events on success or -1 on failure
+ *
+ * Blocks until the server process all currently issued requests and
+ * sends out pending events on all event queues.
+ *
+ * \note Like wl_display_dispatch(), this makes the current thread the
+ * main one.
+ *
+ * \memberof wl_display
+ */
+WL_EXPORT int
+wl_display_roundtrip(struct wl_display *display)
+{
+	display->display_thread = pthread_self();
+
+	return wl_display_roundtrip_queue(display, &display->queue);
+}
+
 static int
 create_proxies(struct wl_proxy *sender, struct wl_closure *closure)
 {
@@ -745,6 +857,22 @@ queue_event(struct wl_display *display, int len)
 		return size;
 	}
 
+	/* Each callback id of an internal round trip is done after its
+	 * one event, so drop it from the map right away; the delete_id
+	 * that follows then frees the zombie. If the queue is gone, there
+	 * is nothing left to deliver the event to. */
+	if (proxy->flags & WL_PROXY_FLAG_SYNC) {
+		wl_map_insert_at(&display->objects, 0, id, WL_ZOMBIE_OBJECT);
+		if (proxy->flags & WL_PROXY_FLAG_DESTROYED) {
+			wl_connection_consume(display->connection, size);
+			proxy->refcount--;
+			if (!proxy->refcount)
+				free(proxy);
+			return size;
+		}
+		proxy->refcount--;
+	}
+
 	message = &proxy->object.interface->events[opcode];
 	closure = wl_connection_demarshal(display->connection, size,
 					  &display->objects, message);
@@ -772,6 +900,38 @@ queue_event(struct wl_display *display, int len)
 	return size;
 }
 
+static void
+clear_destroyed_closure_args(struct wl_closure *closure)
+{
+	const char *signature;
+	struct argument_details arg;
+	int i, count;
+	struct wl_proxy *proxy;
+
+	signature = closure->message->signature;
+	count = arg_count_for_signature(signature);
+	for (i = 0; i < count; i++) {
+		signature = get_next_argument(signature, &arg);
+		switch (arg.type) {
+		case 'n':
+		case 'o':
+			proxy = (struct wl_proxy *) closure->args[i].o;
+			if (proxy && (proxy->flags & WL_PROXY_FLAG_DESTROYED)) {
+				/* The listener never sees this proxy, so drop
+				 * the reference queue_event() took here rather
+				 * than in release_closure(). */
+				proxy->refcount--;
+				if (!proxy->refcount)
+					free(proxy);
+				closure->args[i].o = NULL;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+}
+
 static void
 decrease_closure_args_refcount(struct wl_closure *closure)
 {
@@ -789,9 +949,6 @@ decrease_closure_args_refcount(struct wl_closure *closure)
 		case 'o':
 			proxy = (struct wl_proxy *) closure->args[i].o;
 			if (proxy) {
-				if (proxy->flags & WL_PROXY_FLAG_DESTROYED)
-					closure->args[i].o = NULL;
-
 				proxy->refcount--;
 				if (!proxy->refcount)
 					free(proxy);
@@ -803,35 +960,54 @@ decrease_closure_args_refcount(struct wl_closure *closure)
 	}
 }
 
+static void
+release_closure(struct wl_closure *closure)
+{
+	struct wl_proxy *proxy = closure->proxy;
+
+	decrease_closure_args_refcount(closure);
+
+	proxy->refcount--;
+	if (!proxy->refcount)
+		free(proxy);
+
+	wl_closure_destroy(closure);
+}
+
+/* Called with the display mutex held, returns with it held, but drops
+ * it while the listener runs. The closure keeps its references to the
+ * receiving proxy and the object arguments until the listener returns,
+ * so another thread destroying one of them in the meantime only marks
+ * it destroyed instead of freeing memory the listener may still use. */
 static void
 dispatch_event(struct wl_display *display, struct wl_event_queue *queue)
 {
 	struct wl_closure *closure;
 	struct wl_proxy *proxy;
 	int opcode;
-	bool proxy_destroyed;
 
 	closure = container_of(queue->event_list.next,
 			       struct wl_closure, link);
 	wl_list_remove(&closure->link);
 	opcode = closure->opcode;
+	proxy = closure->proxy;
 
 	/* Verify that the receiving object is still valid by checking if has
 	 * been destroyed by the application. */
 
-	decrease_closure_args_refcount(closure);
-	proxy = closure->proxy;
-	proxy_destroyed = !!(proxy->flags & WL_PROXY_FLAG_DESTROYED);
-
-	proxy->refcount--;
-	if (proxy_destroyed) {
-		if (!proxy->refcount)
-			free(proxy);
+	if (proxy->flags & WL_PROXY_FLAG_DESTROYED) {
+		release_closure(closure);
+		return;
+	}
 
-		wl_closure_destroy(closure);
+	if (proxy->flags & WL_PROXY_FLAG_SYNC) {
+		queue->sync_done++;
+		release_closure(closure);
 		return;
 	}
 
+	clear_destroyed_closure_args(closure);
+
 	pthread_mutex_unlock(&display->mutex);
 
 	if (proxy->object.implementation) {
@@ -843,16 +1019,16 @@ dispatch_event(struct wl_display *display, struct wl_event_queue *queue)
 				  proxy->user_data);
 	}
 
-	wl_closure_destroy(closure);
-
 	pthread_mutex_lock(&display->mutex);
+
+	release_closure(closure);
 }
 
 static int
 dispatch_queue(struct wl_display *display,
 	       struct wl_event_queue *queue, int block)
 {
-	int len, size, count, ret;
+	int len, size, count, batch, ret;
 
 	pthread_mutex_lock(&display->mutex);
 
@@ -891,7 +1067,16 @@ dispatch_queue(struct wl_display *display,
 			goto err_unlock;
 	}
 
-	for (count = 0; !wl_list_empty(&queue->event_list); count++) {
+	/* Only dispatch the events that are queued now. The display thread
+	 * may keep queueing more while the listeners run without the
+	 * mutex, and those are left for the next call rather than keeping
+	 * this thread in here indefinitely. The events stay on the queue
+	 * until they are dispatched, so a listener dispatching the same
+	 * queue recursively still sees them in order. */
+	batch = wl_list_length(&queue->event_list);
+	for (count = 0; count < batch; count++) {
+		if (wl_list_empty(&queue->event_list))
+			break;
 		dispatch_event(display, queue);
 		if (display->last_error)
 			goto err_unlock;
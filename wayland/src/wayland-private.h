@@ -140,6 +140,12 @@ wl_connection_demarshal(struct wl_connection *connection,
 int
 wl_closure_lookup_objects(struct wl_closure *closure, struct wl_map *objects);
 
+int
+wl_closure_reserve_new_ids(struct wl_closure *closure, struct wl_map *objects);
+
+void
+wl_closure_close_fds(struct wl_closure *closure);
+
 enum wl_closure_invoke_flag {
 	WL_CLOSURE_INVOKE_CLIENT = (1 << 0),
 	WL_CLOSURE_INVOKE_SERVER = (1 << 1)
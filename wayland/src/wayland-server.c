@@ -39,6 +39,10 @@
 #include <fcntl.h>
 #include <sys/file.h>
 #include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
 #include <ffi.h>
 
 #include "wayland-private.h"
@@ -65,9 +69,12 @@ struct wl_socket {
 	struct wl_event_source *source;
 };
 
+struct wl_client_reader;
+
 struct wl_client {
 	struct wl_connection *connection;
 	struct wl_event_source *source;
+	struct wl_client_reader *reader;
 	struct wl_display *display;
 	struct wl_resource *display_resource;
 	uint32_t id_count;
@@ -82,6 +89,7 @@ struct wl_client {
 struct wl_display {
 	struct wl_event_loop *loop;
 	int run;
+	int client_io_threads;
 
 	uint32_t id;
 	uint32_t serial;
@@ -191,17 +199,172 @@ wl_resource_post_error(struct wl_resource *resource,
 			       WL_DISPLAY_ERROR, resource, code, buffer);
 }
 
+#define READER_RING_SIZE 256
+
+enum reader_entry_type {
+	READER_ENTRY_CLOSURE,
+	READER_ENTRY_STALL,
+	READER_ENTRY_ERROR,
+	READER_ENTRY_HANGUP
+};
+
+struct reader_entry {
+	enum reader_entry_type type;
+	const struct wl_interface *interface;
+	uint32_t id;
+	uint32_t opcode;
+	int error;
+	struct wl_closure *closure;
+};
+
+/* A client I/O thread receives bytes and fds from the client socket and
+ * demarshals the requests into closures.  The closures are handed to the
+ * compositor thread through a single-producer, single-consumer ring, and
+ * object lookup and handler invocation happen there, so compositor code
+ * still only ever runs on one thread.
+ *
+ * To pick the signature of a request without touching client->objects,
+ * the reader keeps its own map from client-allocated object ids to
+ * interfaces, updated from the typed new_id arguments it demarshals.  A
+ * request for an object the reader doesn't know (server-allocated ids,
+ * objects created through an untyped new_id such as wl_registry.bind)
+ * stalls the reader; the compositor thread then dispatches that request
+ * straight from the connection and records what it learned in the map
+ * before letting the reader continue. */
+struct wl_client_reader {
+	struct wl_client *client;
+	int fd;
+	pthread_t thread;
+	struct wl_map interfaces;
+	int wake_fd;
+	int resume_fd;
+	struct wl_event_source *source;
+
+	struct reader_entry entries[READER_RING_SIZE];
+	uint32_t head;
+	uint32_t tail;
+	int waiting;
+	int stalled;
+	int quit;
+};
+
+static uint32_t
+client_read_mask(struct wl_client *client)
+{
+	/* With an I/O thread, the compositor thread only watches the
+	 * client fd for writability and hangup. */
+	return client->reader ? 0 : WL_EVENT_READABLE;
+}
+
+static void
+reader_learn_object(struct wl_map *interfaces,
+		    struct wl_client *client, uint32_t id)
+{
+	struct wl_resource *resource;
+
+	if (id == 0 || id >= WL_SERVER_ID_START)
+		return;
+
+	resource = wl_map_lookup(&client->objects, id);
+	wl_map_insert_at(interfaces, 0, id,
+			 resource ? (void *) resource->object.interface : NULL);
+}
+
+static void
+reader_learn_interfaces(struct wl_map *interfaces,
+			struct wl_client *client, struct wl_closure *closure)
+{
+	const char *signature;
+	struct argument_details arg;
+	int i;
+
+	reader_learn_object(interfaces, client, closure->sender_id);
+
+	signature = closure->message->signature;
+	for (i = 0; i < closure->count; i++) {
+		signature = get_next_argument(signature, &arg);
+		if (arg.type == 'n')
+			reader_learn_object(interfaces, client,
+					    closure->args[i].n);
+	}
+}
+
+/* Demarshals the request at the head of the connection input buffer and
+ * invokes its handler.  If interfaces is non-NULL, the interfaces of the
+ * objects the request touched are recorded there for the client's I/O
+ * thread.  Returns -1 if the request couldn't be dispatched, in which case
+ * an error has been posted to the client. */
 static int
-wl_client_connection_data(int fd, uint32_t mask, void *data)
+wl_client_handle_request(struct wl_client *client, uint32_t p[2],
+			 struct wl_map *interfaces)
 {
-	struct wl_client *client = data;
-	struct wl_connection *connection = client->connection;
 	struct wl_resource *resource;
 	struct wl_object *object;
 	struct wl_closure *closure;
 	const struct wl_message *message;
-	uint32_t p[2];
 	int opcode, size;
+
+	opcode = p[1] & 0xffff;
+	size = p[1] >> 16;
+
+	resource = wl_map_lookup(&client->objects, p[0]);
+	if (resource == NULL) {
+		wl_resource_post_error(client->display_resource,
+				       WL_DISPLAY_ERROR_INVALID_OBJECT,
+				       "invalid object %u", p[0]);
+		return -1;
+	}
+
+	object = &resource->object;
+	if (opcode >= object->interface->method_count) {
+		wl_resource_post_error(client->display_resource,
+				       WL_DISPLAY_ERROR_INVALID_METHOD,
+				       "invalid method %d, object %s@%u",
+				       opcode,
+				       object->interface->name,
+				       object->id);
+		return -1;
+	}
+
+	message = &object->interface->methods[opcode];
+	closure = wl_connection_demarshal(client->connection, size,
+					  &client->objects, message);
+
+	if (closure == NULL && errno == ENOMEM) {
+		wl_resource_post_no_memory(resource);
+		return -1;
+	} else if ((closure == NULL && errno == EINVAL) ||
+		   wl_closure_lookup_objects(closure, &client->objects) < 0) {
+		wl_resource_post_error(client->display_resource,
+				       WL_DISPLAY_ERROR_INVALID_METHOD,
+				       "invalid arguments for %s@%u.%s",
+				       object->interface->name,
+				       object->id,
+				       message->name);
+		return -1;
+	}
+
+	if (wl_debug)
+		wl_closure_print(closure, object, false);
+
+	wl_closure_invoke(closure, WL_CLOSURE_INVOKE_SERVER, object,
+			  opcode, client);
+
+	if (interfaces)
+		reader_learn_interfaces(interfaces, client, closure);
+
+	wl_closure_destroy(closure);
+
+	return 0;
+}
+
+static int
+wl_client_connection_data(int fd, uint32_t mask, void *data)
+{
+	struct wl_client *client = data;
+	struct wl_connection *connection = client->connection;
+	uint32_t p[2];
+	int size;
 	int len;
 
 	if (mask & (WL_EVENT_ERROR | WL_EVENT_HANGUP)) {
@@ -216,7 +379,7 @@ wl_client_connection_data(int fd, uint32_t mask, void *data)
 			return 1;
 		} else if (len >= 0) {
 			wl_event_source_fd_update(client->source,
-						  WL_EVENT_READABLE);
+						  client_read_mask(client));
 		}
 	}
 
@@ -231,67 +394,468 @@ wl_client_connection_data(int fd, uint32_t mask, void *data)
 
 	while ((size_t) len >= sizeof p) {
 		wl_connection_copy(connection, p, sizeof p);
-		opcode = p[1] & 0xffff;
 		size = p[1] >> 16;
 		if (len < size)
 			break;
 
-		resource = wl_map_lookup(&client->objects, p[0]);
-		if (resource == NULL) {
-			wl_resource_post_error(client->display_resource,
-					       WL_DISPLAY_ERROR_INVALID_OBJECT,
-					       "invalid object %u", p[0]);
+		if (wl_client_handle_request(client, p, NULL) < 0)
 			break;
-		}
 
-		object = &resource->object;
-		if (opcode >= object->interface->method_count) {
-			wl_resource_post_error(client->display_resource,
-					       WL_DISPLAY_ERROR_INVALID_METHOD,
-					       "invalid method %d, object %s@%u",
-					       opcode,
-					       object->interface->name,
-					       object->id);
+		len -= size;
+
+		if (client->error)
 			break;
+	}
+
+	if (client->error)
+		wl_client_destroy(client);
+
+	return 1;
+}
+
+static void
+reader_wake(struct wl_client_reader *reader)
+{
+	uint64_t one = 1;
+
+	if (write(reader->wake_fd, &one, sizeof one) < 0 && errno != EAGAIN)
+		wl_log("failed to wake compositor thread: %m\n");
+}
+
+static void
+reader_resume(struct wl_client_reader *reader)
+{
+	uint64_t one = 1;
+
+	if (write(reader->resume_fd, &one, sizeof one) < 0 && errno != EAGAIN)
+		wl_log("failed to resume client reader: %m\n");
+}
+
+static void
+reader_wait(struct wl_client_reader *reader)
+{
+	uint64_t count;
+	struct pollfd pfd;
+
+	pfd.fd = reader->resume_fd;
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, -1) > 0 &&
+	    read(reader->resume_fd, &count, sizeof count) < 0 &&
+	    errno != EAGAIN)
+		wl_log("failed to read resume event: %m\n");
+}
+
+static int
+reader_should_quit(struct wl_client_reader *reader)
+{
+	return __atomic_load_n(&reader->quit, __ATOMIC_ACQUIRE);
+}
+
+static int
+reader_push(struct wl_client_reader *reader, struct reader_entry *entry)
+{
+	uint32_t head = reader->head;
+
+	while (head - __atomic_load_n(&reader->tail, __ATOMIC_SEQ_CST) ==
+	       READER_RING_SIZE) {
+		/* The compositor thread is behind; make sure it knows
+		 * there is work and wait until it frees up a slot. */
+		reader_wake(reader);
+		__atomic_store_n(&reader->waiting, 1, __ATOMIC_SEQ_CST);
+		if (head - __atomic_load_n(&reader->tail, __ATOMIC_SEQ_CST) ==
+		    READER_RING_SIZE && !reader_should_quit(reader))
+			reader_wait(reader);
+		__atomic_store_n(&reader->waiting, 0, __ATOMIC_SEQ_CST);
+
+		if (reader_should_quit(reader))
+			return -1;
+	}
+
+	reader->entries[head & (READER_RING_SIZE - 1)] = *entry;
+	__atomic_store_n(&reader->head, head + 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+static int
+reader_stall(struct wl_client_reader *reader, struct reader_entry *entry)
+{
+	entry->type = READER_ENTRY_STALL;
+	entry->closure = NULL;
+
+	__atomic_store_n(&reader->stalled, 1, __ATOMIC_SEQ_CST);
+	if (reader_push(reader, entry) < 0)
+		return -1;
+
+	reader_wake(reader);
+	while (__atomic_load_n(&reader->stalled, __ATOMIC_SEQ_CST) &&
+	       !reader_should_quit(reader))
+		reader_wait(reader);
+
+	return reader_should_quit(reader) ? -1 : 0;
+}
+
+static void
+reader_track_new_ids(struct wl_client_reader *reader,
+		     struct wl_closure *closure)
+{
+	const struct wl_message *message = closure->message;
+	const char *signature;
+	struct argument_details arg;
+	uint32_t id;
+	int i;
+
+	signature = message->signature;
+	for (i = 0; i < closure->count; i++) {
+		signature = get_next_argument(signature, &arg);
+		if (arg.type != 'n')
+			continue;
+
+		id = closure->args[i].n;
+		if (id != 0 && id < WL_SERVER_ID_START)
+			wl_map_insert_at(&reader->interfaces, 0, id,
+					 (void *) message->types[i]);
+	}
+}
+
+static int
+reader_demarshal(struct wl_client_reader *reader, int len)
+{
+	struct wl_connection *connection = reader->client->connection;
+	const struct wl_interface *interface;
+	struct reader_entry entry;
+	uint32_t p[2];
+	int size, ret = 0;
+
+	while ((size_t) len >= sizeof p) {
+		wl_connection_copy(connection, p, sizeof p);
+		size = p[1] >> 16;
+		if (len < size)
+			break;
+
+		entry.id = p[0];
+		entry.opcode = p[1] & 0xffff;
+		entry.closure = NULL;
+
+		interface = NULL;
+		if (p[0] < WL_SERVER_ID_START)
+			interface = wl_map_lookup(&reader->interfaces, p[0]);
+
+		if ((size_t) size < sizeof p) {
+			entry.type = READER_ENTRY_ERROR;
+			entry.interface = NULL;
+			entry.error = EINVAL;
+			reader_push(reader, &entry);
+			ret = -1;
+			break;
+		}
+
+		if (interface == NULL ||
+		    entry.opcode >= (uint32_t) interface->method_count) {
+			if (reader_stall(reader, &entry) < 0) {
+				ret = -1;
+				break;
+			}
+
+			len -= size;
+			continue;
 		}
 
-		message = &object->interface->methods[opcode];
-		closure = wl_connection_demarshal(client->connection, size,
-						  &client->objects, message);
+		entry.interface = interface;
+		entry.closure =
+			wl_connection_demarshal(connection, size, NULL,
+						&interface->methods[entry.opcode]);
 		len -= size;
 
-		if (closure == NULL && errno == ENOMEM) {
-			wl_resource_post_no_memory(resource);
+		if (entry.closure == NULL) {
+			entry.type = READER_ENTRY_ERROR;
+			entry.error = errno;
+			reader_push(reader, &entry);
+			ret = -1;
 			break;
-		} else if ((closure == NULL && errno == EINVAL) ||
-			   wl_closure_lookup_objects(closure, &client->objects) < 0) {
-			wl_resource_post_error(client->display_resource,
-					       WL_DISPLAY_ERROR_INVALID_METHOD,
-					       "invalid arguments for %s@%u.%s",
-					       object->interface->name,
-					       object->id,
-					       message->name);
+		}
+
+		reader_track_new_ids(reader, entry.closure);
+
+		entry.type = READER_ENTRY_CLOSURE;
+		if (reader_push(reader, &entry) < 0) {
+			wl_closure_close_fds(entry.closure);
+			wl_closure_destroy(entry.closure);
+			ret = -1;
 			break;
 		}
+	}
 
-		if (wl_debug)
-			wl_closure_print(closure, object, false);
+	reader_wake(reader);
 
-		wl_closure_invoke(closure, WL_CLOSURE_INVOKE_SERVER, object,
-				  opcode, client);
+	return ret;
+}
 
-		wl_closure_destroy(closure);
+static void *
+reader_thread(void *data)
+{
+	struct wl_client_reader *reader = data;
+	struct wl_connection *connection = reader->client->connection;
+	struct reader_entry entry;
+	struct pollfd pfd[2];
+	uint64_t count;
+	int len;
 
-		if (client->error)
+	pfd[0].fd = reader->fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = reader->resume_fd;
+	pfd[1].events = POLLIN;
+
+	while (!reader_should_quit(reader)) {
+		if (poll(pfd, ARRAY_LENGTH(pfd), -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		if (reader_should_quit(reader))
+			return NULL;
+
+		if ((pfd[1].revents & POLLIN) &&
+		    read(reader->resume_fd, &count, sizeof count) < 0 &&
+		    errno != EAGAIN)
+			break;
+
+		if (pfd[0].revents & POLLIN) {
+			len = wl_connection_read(connection);
+			if (len == 0 || (len < 0 && errno != EAGAIN))
+				break;
+			if (len > 0 && reader_demarshal(reader, len) < 0)
+				return NULL;
+		} else if (pfd[0].revents & (POLLHUP | POLLERR)) {
 			break;
+		}
+	}
+
+	if (reader_should_quit(reader))
+		return NULL;
+
+	entry.type = READER_ENTRY_HANGUP;
+	entry.closure = NULL;
+	if (reader_push(reader, &entry) == 0)
+		reader_wake(reader);
+
+	return NULL;
+}
+
+static void
+wl_client_dispatch_closure(struct wl_client *client,
+			   struct reader_entry *entry)
+{
+	struct wl_closure *closure = entry->closure;
+	struct wl_resource *resource;
+	struct wl_object *object;
+
+	resource = wl_map_lookup(&client->objects, entry->id);
+	if (resource == NULL ||
+	    (resource->object.interface != entry->interface &&
+	     strcmp(resource->object.interface->name,
+		    entry->interface->name) != 0)) {
+		wl_resource_post_error(client->display_resource,
+				       WL_DISPLAY_ERROR_INVALID_OBJECT,
+				       "invalid object %u", entry->id);
+		goto err;
 	}
 
+	object = &resource->object;
+	if (wl_closure_reserve_new_ids(closure, &client->objects) < 0 ||
+	    wl_closure_lookup_objects(closure, &client->objects) < 0) {
+		wl_resource_post_error(client->display_resource,
+				       WL_DISPLAY_ERROR_INVALID_METHOD,
+				       "invalid arguments for %s@%u.%s",
+				       object->interface->name,
+				       object->id,
+				       closure->message->name);
+		goto err;
+	}
+
+	if (wl_debug)
+		wl_closure_print(closure, object, false);
+
+	wl_closure_invoke(closure, WL_CLOSURE_INVOKE_SERVER, object,
+			  entry->opcode, client);
+
+	wl_closure_destroy(closure);
+
+	return;
+
+err:
+	wl_closure_close_fds(closure);
+	wl_closure_destroy(closure);
+}
+
+static void
+wl_client_dispatch_error(struct wl_client *client, struct reader_entry *entry)
+{
+	struct wl_resource *resource;
+	const struct wl_interface *interface = entry->interface;
+
+	resource = wl_map_lookup(&client->objects, entry->id);
+	if (resource && entry->error == ENOMEM)
+		wl_resource_post_no_memory(resource);
+	else if (interface)
+		wl_resource_post_error(client->display_resource,
+				       WL_DISPLAY_ERROR_INVALID_METHOD,
+				       "invalid arguments for %s@%u.%s",
+				       interface->name, entry->id,
+				       interface->methods[entry->opcode].name);
+	else
+		wl_resource_post_error(client->display_resource,
+				       WL_DISPLAY_ERROR_INVALID_METHOD,
+				       "invalid request size, object %u",
+				       entry->id);
+}
+
+static int
+wl_client_reader_data(int fd, uint32_t mask, void *data)
+{
+	struct wl_client_reader *reader = data;
+	struct wl_client *client = reader->client;
+	struct reader_entry *entry;
+	uint32_t head, tail, p[2];
+	uint64_t count;
+
+	if (read(fd, &count, sizeof count) < 0 && errno != EAGAIN) {
+		wl_client_destroy(client);
+		return 1;
+	}
+
+	tail = reader->tail;
+	head = __atomic_load_n(&reader->head, __ATOMIC_ACQUIRE);
+	while (tail != head && !client->error) {
+		entry = &reader->entries[tail & (READER_RING_SIZE - 1)];
+
+		switch (entry->type) {
+		case READER_ENTRY_CLOSURE:
+			tail++;
+			wl_client_dispatch_closure(client, entry);
+			break;
+		case READER_ENTRY_STALL:
+			/* The reader is blocked, so the connection input
+			 * buffer is ours until we resume it. */
+			tail++;
+			wl_connection_copy(client->connection, p, sizeof p);
+			wl_client_handle_request(client, p,
+						 &reader->interfaces);
+			__atomic_store_n(&reader->stalled, 0,
+					 __ATOMIC_SEQ_CST);
+			reader_resume(reader);
+			break;
+		case READER_ENTRY_ERROR:
+			tail++;
+			wl_client_dispatch_error(client, entry);
+			break;
+		case READER_ENTRY_HANGUP:
+			wl_client_destroy(client);
+			return 1;
+		}
+
+		if (tail == head) {
+			__atomic_store_n(&reader->tail, tail, __ATOMIC_SEQ_CST);
+			head = __atomic_load_n(&reader->head, __ATOMIC_ACQUIRE);
+		}
+	}
+
+	__atomic_store_n(&reader->tail, tail, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&reader->waiting, __ATOMIC_SEQ_CST))
+		reader_resume(reader);
+
 	if (client->error)
 		wl_client_destroy(client);
 
 	return 1;
 }
 
+static struct wl_client_reader *
+reader_create(struct wl_client *client, int fd)
+{
+	struct wl_client_reader *reader;
+	sigset_t all, saved;
+	int ret;
+
+	reader = malloc(sizeof *reader);
+	if (reader == NULL)
+		return NULL;
+
+	memset(reader, 0, sizeof *reader);
+	reader->client = client;
+	reader->fd = fd;
+
+	wl_map_init(&reader->interfaces, WL_MAP_SERVER_SIDE);
+	if (wl_map_insert_at(&reader->interfaces, 0, 0, NULL) < 0 ||
+	    wl_map_insert_at(&reader->interfaces, 0, 1,
+			     (void *) &wl_display_interface) < 0)
+		goto err_map;
+
+	reader->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (reader->wake_fd < 0)
+		goto err_map;
+
+	reader->resume_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (reader->resume_fd < 0)
+		goto err_wake;
+
+	reader->source = wl_event_loop_add_fd(client->display->loop,
+					      reader->wake_fd,
+					      WL_EVENT_READABLE,
+					      wl_client_reader_data, reader);
+	if (reader->source == NULL)
+		goto err_resume;
+	wl_event_source_set_priority(reader->source, WL_EVENT_PRIORITY_LOW);
+
+	/* Signals are for the compositor thread to handle. */
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &saved);
+	ret = pthread_create(&reader->thread, NULL, reader_thread, reader);
+	pthread_sigmask(SIG_SETMASK, &saved, NULL);
+	if (ret != 0)
+		goto err_source;
+
+	return reader;
+
+err_source:
+	wl_event_source_remove(reader->source);
+err_resume:
+	close(reader->resume_fd);
+err_wake:
+	close(reader->wake_fd);
+err_map:
+	wl_map_release(&reader->interfaces);
+	free(reader);
+	return NULL;
+}
+
+static void
+reader_destroy(struct wl_client_reader *reader)
+{
+	struct reader_entry *entry;
+	uint32_t tail, head;
+
+	__atomic_store_n(&reader->quit, 1, __ATOMIC_SEQ_CST);
+	reader_resume(reader);
+	pthread_join(reader->thread, NULL);
+
+	head = reader->head;
+	for (tail = reader->tail; tail != head; tail++) {
+		entry = &reader->entries[tail & (READER_RING_SIZE - 1)];
+		if (entry->closure) {
+			wl_closure_close_fds(entry->closure);
+			wl_closure_destroy(entry->closure);
+		}
+	}
+
+	wl_event_source_remove(reader->source);
+	close(reader->resume_fd);
+	close(reader->wake_fd);
+	wl_map_release(&reader->interfaces);
+	free(reader);
+}
+
 WL_EXPORT void
 wl_client_flush(struct wl_client *client)
 {
@@ -327,6 +891,10 @@ wl_client_create(struct wl_display *display, int fd)
 	if (!client->source)
 		goto err_client;
 
+	/* Client requests can wait for input and output events, and a
+	 * busy client shouldn't hold up the others for long. */
+	wl_event_source_set_priority(client->source, WL_EVENT_PRIORITY_LOW);
+
 	len = sizeof client->ucred;
 	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED,
 		       &client->ucred, &len) < 0)
@@ -349,6 +917,13 @@ wl_client_create(struct wl_display *display, int fd)
 
 	wl_list_insert(display->client_list.prev, &client->link);
 
+	if (display->client_io_threads) {
+		client->reader = reader_create(client, fd);
+		if (client->reader)
+			wl_event_source_fd_update(client->source,
+						  client_read_mask(client));
+	}
+
 	return client;
 
 err_map:
@@ -536,6 +1111,9 @@ wl_client_destroy(struct wl_client *client)
 	
 	wl_log("disconnect from client %p\n", client);
 
+	if (client->reader)
+		reader_destroy(client->reader);
+
 	wl_signal_emit(&client->destroy_signal, client);
 
 	wl_client_flush(client);
@@ -671,6 +1249,7 @@ wl_display_create(void)
 
 	display->id = 1;
 	display->serial = 0;
+	display->client_io_threads = 0;
 
 	if (!wl_display_add_global(display, &wl_display_interface, 
 				   display, bind_display)) {
@@ -760,6 +1339,15 @@ wl_display_next_serial(struct wl_display *display)
 	return display->serial;
 }
 
+/* Clients created after this call get an I/O thread that reads and
+ * demarshals their requests off the compositor thread.  Handlers are
+ * still invoked from wl_event_loop_dispatch() on the compositor thread. */
+WL_EXPORT void
+wl_display_set_client_io_threads(struct wl_display *display, int enabled)
+{
+	display->client_io_threads = enabled;
+}
+
 WL_EXPORT struct wl_event_loop *
 wl_display_get_event_loop(struct wl_display *display)
 {
@@ -794,7 +1382,7 @@ wl_display_flush_clients(struct wl_display *display)
 		if (ret < 0 && errno == EAGAIN) {
 			wl_event_source_fd_update(client->source,
 						  WL_EVENT_WRITABLE |
-						  WL_EVENT_READABLE);
+						  client_read_mask(client));
 		} else if (ret < 0) {
 			wl_client_destroy(client);
 		}
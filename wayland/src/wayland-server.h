@@ -39,6 +39,15 @@ enum {
 	WL_EVENT_ERROR    = 0x08
 };
 
+/* Ready sources are dispatched in order of decreasing priority. Only a
+ * limited number of low priority sources are dispatched per loop
+ * iteration, the rest wait for the next one. */
+enum {
+	WL_EVENT_PRIORITY_LOW = -1,
+	WL_EVENT_PRIORITY_DEFAULT = 0,
+	WL_EVENT_PRIORITY_HIGH = 1
+};
+
 struct wl_event_loop;
 struct wl_event_source;
 typedef int (*wl_event_loop_fd_func_t)(int fd, uint32_t mask, void *data);
@@ -66,6 +75,8 @@ int wl_event_source_timer_update(struct wl_event_source *source,
 				 int ms_delay);
 int wl_event_source_remove(struct wl_event_source *source);
 void wl_event_source_check(struct wl_event_source *source);
+void wl_event_source_set_priority(struct wl_event_source *source,
+				  int priority);
 
 
 int wl_event_loop_dispatch(struct wl_event_loop *loop, int timeout);
@@ -95,6 +106,8 @@ int wl_display_add_socket(struct wl_display *display, const char *name);
 void wl_display_terminate(struct wl_display *display);
 void wl_display_run(struct wl_display *display);
 void wl_display_flush_clients(struct wl_display *display);
+void wl_display_set_client_io_threads(struct wl_display *display,
+				      int enabled);
 
 typedef void (*wl_global_bind_func_t)(struct wl_client *client, void *data,
 				      uint32_t version, uint32_t id);
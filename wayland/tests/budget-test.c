@@ -0,0 +1,289 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#include "wayland-server.h"
+#include "wayland-private.h"
+#include "test-runner.h"
+
+/* Budget tests: each of these asserts an upper bound on the number of
+ * allocations and syscalls a hot path makes, so that a change quietly
+ * adding per-message work shows up as a test failure. */
+
+#define NUM_MESSAGES 64
+
+/* wl_region.add, the request opcode isn't in the server header */
+#define REGION_ADD 1
+
+static const struct wl_message message = { "test", "iu", NULL };
+
+static void
+marshal_messages(struct wl_connection *connection, int count)
+{
+	struct wl_object sender = { NULL, NULL, 1234 };
+	struct wl_closure *closure;
+	union wl_argument args[2];
+	int i;
+
+	for (i = 0; i < count; i++) {
+		args[0].i = -i;
+		args[1].u = i;
+		closure = wl_closure_marshal(&sender, 0, args, &message);
+		assert(closure);
+		assert(wl_closure_send(closure, connection) == 0);
+		wl_closure_destroy(closure);
+	}
+}
+
+TEST(marshal_flush_budget)
+{
+	struct wl_connection *connection;
+	struct test_counters counters;
+	char buffer[4096];
+	int s[2];
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, s) == 0);
+	connection = wl_connection_create(s[0]);
+	assert(connection);
+
+	/* One closure per message, and no syscalls until the flush. */
+	test_counters_begin(&counters);
+	marshal_messages(connection, NUM_MESSAGES);
+	test_counters_end(&counters);
+	assert_alloc_budget(&counters, NUM_MESSAGES);
+	assert_syscall_budget(&counters, 0);
+
+	/* All messages fit in the output buffer, so flushing them is a
+	 * single sendmsg and allocates nothing. */
+	test_counters_begin(&counters);
+	assert(wl_connection_flush(connection) == NUM_MESSAGES * 16);
+	test_counters_end(&counters);
+	assert_alloc_budget(&counters, 0);
+	assert_syscall_budget(&counters, 1);
+
+	assert(read(s[1], buffer, sizeof buffer) == NUM_MESSAGES * 16);
+
+	wl_connection_destroy(connection);
+	close(s[1]);
+}
+
+TEST(demarshal_budget)
+{
+	struct wl_connection *write_connection, *read_connection;
+	struct test_counters counters;
+	struct wl_closure *closure;
+	int i, len, s[2];
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, s) == 0);
+	write_connection = wl_connection_create(s[0]);
+	read_connection = wl_connection_create(s[1]);
+	assert(write_connection && read_connection);
+
+	marshal_messages(write_connection, NUM_MESSAGES);
+	assert(wl_connection_flush(write_connection) == NUM_MESSAGES * 16);
+
+	/* One read for the whole burst and one allocation per message. */
+	test_counters_begin(&counters);
+	len = wl_connection_read(read_connection);
+	assert(len == NUM_MESSAGES * 16);
+	for (i = 0; i < NUM_MESSAGES; i++) {
+		closure = wl_connection_demarshal(read_connection, 16,
+						  NULL, &message);
+		assert(closure);
+		assert(closure->args[1].u == (uint32_t) i);
+		wl_closure_destroy(closure);
+	}
+	test_counters_end(&counters);
+	assert_alloc_budget(&counters, NUM_MESSAGES);
+	assert_syscall_budget(&counters, 1);
+
+	wl_connection_destroy(read_connection);
+	wl_connection_destroy(write_connection);
+}
+
+static void
+region_destroy(struct wl_client *client, struct wl_resource *resource)
+{
+	wl_resource_destroy(resource);
+}
+
+static void
+region_add(struct wl_client *client, struct wl_resource *resource,
+	   int32_t x, int32_t y, int32_t width, int32_t height)
+{
+	int *count = wl_resource_get_user_data(resource);
+
+	(*count)++;
+}
+
+static const struct wl_region_interface region_implementation = {
+	region_destroy,
+	region_add,
+	region_add
+};
+
+TEST(dispatch_budget)
+{
+	struct wl_display *display;
+	struct wl_event_loop *loop;
+	struct wl_client *client;
+	struct wl_connection *connection;
+	struct test_counters counters;
+	uint32_t request[6];
+	int i, count = 0, s[2];
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, s) == 0);
+	display = wl_display_create();
+	assert(display);
+	loop = wl_display_get_event_loop(display);
+	client = wl_client_create(display, s[0]);
+	assert(client);
+	assert(wl_client_add_object(client, &wl_region_interface,
+				    &region_implementation, 2, &count));
+
+	connection = wl_connection_create(s[1]);
+	assert(connection);
+	for (i = 0; i < NUM_MESSAGES; i++) {
+		request[0] = 2;
+		request[1] = sizeof request << 16 | REGION_ADD;
+		request[2] = i;
+		request[3] = i;
+		request[4] = 1;
+		request[5] = 1;
+		assert(wl_connection_write(connection,
+					   request, sizeof request) == 0);
+	}
+	assert(wl_connection_flush(connection) == sizeof request * NUM_MESSAGES);
+
+	/* Dispatching a burst of requests costs one epoll_wait, one
+	 * recvmsg and a closure per request. */
+	test_counters_begin(&counters);
+	wl_event_loop_dispatch(loop, 0);
+	test_counters_end(&counters);
+	assert(count == NUM_MESSAGES);
+	assert_alloc_budget(&counters, NUM_MESSAGES);
+	assert_syscall_budget(&counters, 2);
+
+	wl_connection_destroy(connection);
+	wl_client_destroy(client);
+	wl_display_destroy(display);
+}
+
+static int
+fd_dispatch(int fd, uint32_t mask, void *data)
+{
+	assert(0 && "fd source shouldn't be dispatched");
+
+	return 0;
+}
+
+static int
+timer_dispatch(void *data)
+{
+	assert(0 && "timer source shouldn't be dispatched");
+
+	return 0;
+}
+
+TEST(event_loop_idle_budget)
+{
+	struct wl_event_loop *loop;
+	struct wl_event_source *fd_source, *timer_source;
+	struct test_counters counters;
+	int i, p[2];
+
+	loop = wl_event_loop_create();
+	assert(loop);
+	assert(pipe(p) == 0);
+
+	fd_source = wl_event_loop_add_fd(loop, p[0], WL_EVENT_READABLE,
+					 fd_dispatch, NULL);
+	assert(fd_source);
+	timer_source = wl_event_loop_add_timer(loop, timer_dispatch, NULL);
+	assert(timer_source);
+
+	/* An iteration with nothing to do is one epoll_wait and
+	 * allocates nothing. */
+	test_counters_begin(&counters);
+	for (i = 0; i < NUM_MESSAGES; i++)
+		assert(wl_event_loop_dispatch(loop, 0) == 0);
+	test_counters_end(&counters);
+	assert_alloc_budget(&counters, 0);
+	assert_syscall_budget(&counters, NUM_MESSAGES);
+
+	wl_event_source_remove(timer_source);
+	wl_event_source_remove(fd_source);
+	wl_event_loop_destroy(loop);
+	close(p[0]);
+	close(p[1]);
+}
+
+TEST(shm_buffer_access_budget)
+{
+	struct wl_display *display;
+	struct wl_client *client;
+	struct wl_buffer *buffer;
+	struct test_counters counters;
+	int i, s[2];
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, s) == 0);
+	display = wl_display_create();
+	assert(display);
+	client = wl_client_create(display, s[0]);
+	assert(client);
+
+	test_counters_begin(&counters);
+	buffer = wl_shm_buffer_create(client, 0, 16, 16, 64,
+				      WL_SHM_FORMAT_XRGB8888);
+	test_counters_end(&counters);
+	assert(buffer);
+	/* The buffer itself, plus possibly growing the object map. */
+	assert_alloc_budget(&counters, 2);
+	assert_syscall_budget(&counters, 0);
+
+	/* Renderers query these on every attach and repaint. */
+	test_counters_begin(&counters);
+	for (i = 0; i < NUM_MESSAGES; i++) {
+		assert(wl_buffer_is_shm(buffer));
+		assert(wl_shm_buffer_get_data(buffer));
+		assert(wl_shm_buffer_get_stride(buffer) == 64);
+		assert(wl_shm_buffer_get_width(buffer) == 16);
+		assert(wl_shm_buffer_get_height(buffer) == 16);
+		assert(wl_shm_buffer_get_format(buffer) ==
+		       WL_SHM_FORMAT_XRGB8888);
+	}
+	test_counters_end(&counters);
+	assert_alloc_budget(&counters, 0);
+	assert_syscall_budget(&counters, 0);
+
+	wl_resource_destroy(&buffer->resource);
+	wl_client_destroy(client);
+	close(s[1]);
+	wl_display_destroy(display);
+}
@@ -247,3 +247,158 @@ TEST(event_loop_destroy)
 	assert(a.done);
 }
 
+
+struct priority_context {
+	int order[8];
+	int count;
+};
+
+struct priority_source {
+	struct priority_context *context;
+	int id;
+};
+
+static int
+priority_dispatch(int fd, uint32_t mask, void *data)
+{
+	struct priority_source *source = data;
+
+	source->context->order[source->context->count++] = source->id;
+
+	return 0;
+}
+
+TEST(event_loop_priority_order)
+{
+	static const int priorities[] = {
+		WL_EVENT_PRIORITY_LOW,
+		WL_EVENT_PRIORITY_DEFAULT,
+		WL_EVENT_PRIORITY_HIGH,
+		WL_EVENT_PRIORITY_LOW,
+		WL_EVENT_PRIORITY_HIGH,
+		WL_EVENT_PRIORITY_DEFAULT
+	};
+	struct wl_event_loop *loop = wl_event_loop_create();
+	struct wl_event_source *sources[ARRAY_LENGTH(priorities)];
+	struct priority_source data[ARRAY_LENGTH(priorities)];
+	struct priority_context context;
+	unsigned int i;
+	int p[2];
+
+	context.count = 0;
+	assert(pipe(p) == 0);
+	assert(write(p[1], "x", 1) == 1);
+
+	for (i = 0; i < ARRAY_LENGTH(priorities); i++) {
+		data[i].context = &context;
+		data[i].id = i;
+		sources[i] = wl_event_loop_add_fd(loop, p[0],
+						  WL_EVENT_READABLE,
+						  priority_dispatch, &data[i]);
+		assert(sources[i]);
+		wl_event_source_set_priority(sources[i], priorities[i]);
+	}
+
+	wl_event_loop_dispatch(loop, 0);
+	assert(context.count == ARRAY_LENGTH(priorities));
+	for (i = 1; i < ARRAY_LENGTH(priorities); i++)
+		assert(priorities[context.order[i - 1]] >=
+		       priorities[context.order[i]]);
+
+	for (i = 0; i < ARRAY_LENGTH(priorities); i++)
+		wl_event_source_remove(sources[i]);
+	wl_event_loop_destroy(loop);
+	close(p[0]);
+	close(p[1]);
+}
+
+#define NUM_FLOOD_SOURCES 24
+/* Iterations the loop's budget of 8 low priority dispatches needs to
+ * get through every flood source once. */
+#define FLOOD_ROUNDS (NUM_FLOOD_SOURCES / 8)
+
+static int
+flood_dispatch(int fd, uint32_t mask, void *data)
+{
+	int *count = data;
+
+	/* Like a client that always has more requests queued, the pipe
+	 * is never drained. */
+	(*count)++;
+
+	return 0;
+}
+
+static int
+input_dispatch(int fd, uint32_t mask, void *data)
+{
+	int *count = data;
+	char c;
+
+	assert(read(fd, &c, 1) == 1);
+	(*count)++;
+
+	return 0;
+}
+
+TEST(event_loop_low_priority_budget)
+{
+	struct wl_event_loop *loop = wl_event_loop_create();
+	struct wl_event_source *flood[NUM_FLOOD_SOURCES], *input;
+	int flood_counts[NUM_FLOOD_SOURCES];
+	int i, iteration, flood_count, input_count, flood_pipe[2], input_pipe[2];
+
+	assert(pipe(flood_pipe) == 0);
+	assert(write(flood_pipe[1], "x", 1) == 1);
+	assert(pipe(input_pipe) == 0);
+
+	for (i = 0; i < NUM_FLOOD_SOURCES; i++) {
+		flood_counts[i] = 0;
+		flood[i] = wl_event_loop_add_fd(loop, flood_pipe[0],
+						WL_EVENT_READABLE,
+						flood_dispatch,
+						&flood_counts[i]);
+		assert(flood[i]);
+		wl_event_source_set_priority(flood[i], WL_EVENT_PRIORITY_LOW);
+	}
+
+	input = wl_event_loop_add_fd(loop, input_pipe[0], WL_EVENT_READABLE,
+				     input_dispatch, &input_count);
+	assert(input);
+	wl_event_source_set_priority(input, WL_EVENT_PRIORITY_HIGH);
+
+	/* However busy the low priority sources are, input arriving
+	 * before an iteration is handled in that iteration, after at most
+	 * a budget's worth of low priority work.  The budget rotates, so
+	 * no flood source waits longer than FLOOD_ROUNDS iterations. */
+	for (iteration = 1; iteration <= 5 * FLOOD_ROUNDS; iteration++) {
+		input_count = 0;
+		assert(write(input_pipe[1], "x", 1) == 1);
+
+		flood_count = 0;
+		for (i = 0; i < NUM_FLOOD_SOURCES; i++)
+			flood_count -= flood_counts[i];
+		assert(wl_event_loop_dispatch(loop, 0) == 0);
+		for (i = 0; i < NUM_FLOOD_SOURCES; i++)
+			flood_count += flood_counts[i];
+
+		assert(input_count == 1);
+		assert(flood_count > 0 && flood_count < NUM_FLOOD_SOURCES);
+
+		if (iteration % FLOOD_ROUNDS != 0)
+			continue;
+		for (i = 0; i < NUM_FLOOD_SOURCES; i++) {
+			assert(flood_counts[i] == 1);
+			flood_counts[i] = 0;
+		}
+	}
+
+	for (i = 0; i < NUM_FLOOD_SOURCES; i++)
+		wl_event_source_remove(flood[i]);
+	wl_event_source_remove(input);
+	wl_event_loop_destroy(loop);
+	close(flood_pipe[0]);
+	close(flood_pipe[1]);
+	close(input_pipe[0]);
+	close(input_pipe[1]);
+}
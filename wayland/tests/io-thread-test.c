@@ -0,0 +1,316 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <assert.h>
+
+#include "wayland-client.h"
+#include "wayland-server.h"
+#include "test-runner.h"
+
+#define NUM_RECTS 2000
+
+#define client_assert(expr)					\
+	do {							\
+		if (!(expr)) {					\
+			fprintf(stderr, "%s:%d: "		\
+				"Assertion `%s' failed.\n",	\
+				__FILE__, __LINE__, #expr);	\
+			exit(EXIT_FAILURE);			\
+		}						\
+	} while (0)
+
+struct server_state {
+	struct wl_display *display;
+	struct wl_listener client_destroy;
+	int rects;
+	int32_t rect_sum;
+	int regions;
+	int pools;
+	int32_t pool_size;
+	int pool_fd_valid;
+};
+
+struct client_state {
+	struct wl_compositor *compositor;
+	struct wl_shm *shm;
+};
+
+static void
+registry_handle_global(void *data, struct wl_registry *registry,
+		       uint32_t id, const char *interface, uint32_t version)
+{
+	struct client_state *state = data;
+
+	if (strcmp(interface, "wl_compositor") == 0)
+		state->compositor =
+			wl_registry_bind(registry, id,
+					 &wl_compositor_interface, 1);
+	else if (strcmp(interface, "wl_shm") == 0)
+		state->shm = wl_registry_bind(registry, id,
+					      &wl_shm_interface, 1);
+}
+
+static const struct wl_registry_listener registry_listener = {
+	registry_handle_global,
+	NULL
+};
+
+static int
+client_main(int fd)
+{
+	struct wl_display *display;
+	struct wl_registry *registry;
+	struct wl_region *region;
+	struct wl_shm_pool *pool;
+	struct client_state state;
+	int i, pipe_fds[2];
+
+	alarm(5);
+
+	memset(&state, 0, sizeof state);
+	display = wl_display_connect_to_fd(fd);
+	client_assert(display);
+
+	registry = wl_display_get_registry(display);
+	wl_registry_add_listener(registry, &registry_listener, &state);
+	client_assert(wl_display_roundtrip(display) >= 0);
+	client_assert(state.compositor && state.shm);
+
+	/* Enough requests to wrap around the reader ring a few times. */
+	region = wl_compositor_create_region(state.compositor);
+	for (i = 0; i < NUM_RECTS; i++)
+		wl_region_add(region, i, 1, 2, 3);
+	wl_region_destroy(region);
+
+	client_assert(pipe(pipe_fds) == 0);
+	pool = wl_shm_create_pool(state.shm, pipe_fds[0], 4096);
+	close(pipe_fds[0]);
+	close(pipe_fds[1]);
+	wl_shm_pool_destroy(pool);
+
+	client_assert(wl_display_roundtrip(display) >= 0);
+
+	wl_display_disconnect(display);
+
+	return EXIT_SUCCESS;
+}
+
+static void
+region_destroy(struct wl_client *client, struct wl_resource *resource)
+{
+	wl_resource_destroy(resource);
+}
+
+static void
+region_add(struct wl_client *client, struct wl_resource *resource,
+	   int32_t x, int32_t y, int32_t width, int32_t height)
+{
+	struct server_state *state = wl_resource_get_user_data(resource);
+
+	assert(y == 1 && width == 2 && height == 3);
+	assert(x == state->rects);
+	state->rects++;
+	state->rect_sum += x;
+}
+
+static void
+region_subtract(struct wl_client *client, struct wl_resource *resource,
+		int32_t x, int32_t y, int32_t width, int32_t height)
+{
+	assert(0 && "unexpected request");
+}
+
+static const struct wl_region_interface region_implementation = {
+	region_destroy,
+	region_add,
+	region_subtract
+};
+
+static void
+compositor_create_surface(struct wl_client *client,
+			  struct wl_resource *resource, uint32_t id)
+{
+	assert(0 && "unexpected request");
+}
+
+static void
+compositor_create_region(struct wl_client *client,
+			 struct wl_resource *resource, uint32_t id)
+{
+	struct server_state *state = wl_resource_get_user_data(resource);
+
+	wl_client_add_object(client, &wl_region_interface,
+			     &region_implementation, id, state);
+	state->regions++;
+}
+
+static const struct wl_compositor_interface compositor_implementation = {
+	compositor_create_surface,
+	compositor_create_region
+};
+
+static void
+pool_create_buffer(struct wl_client *client, struct wl_resource *resource,
+		   uint32_t id, int32_t offset, int32_t width, int32_t height,
+		   int32_t stride, uint32_t format)
+{
+	assert(0 && "unexpected request");
+}
+
+static void
+pool_destroy(struct wl_client *client, struct wl_resource *resource)
+{
+	wl_resource_destroy(resource);
+}
+
+static void
+pool_resize(struct wl_client *client, struct wl_resource *resource,
+	    int32_t size)
+{
+	assert(0 && "unexpected request");
+}
+
+static const struct wl_shm_pool_interface pool_implementation = {
+	pool_create_buffer,
+	pool_destroy,
+	pool_resize
+};
+
+static void
+shm_create_pool(struct wl_client *client, struct wl_resource *resource,
+		uint32_t id, int fd, int32_t size)
+{
+	struct server_state *state = wl_resource_get_user_data(resource);
+
+	state->pools++;
+	state->pool_size = size;
+	state->pool_fd_valid = close(fd) == 0;
+
+	wl_client_add_object(client, &wl_shm_pool_interface,
+			     &pool_implementation, id, state);
+}
+
+static const struct wl_shm_interface shm_implementation = {
+	shm_create_pool
+};
+
+static void
+bind_compositor(struct wl_client *client,
+		void *data, uint32_t version, uint32_t id)
+{
+	wl_client_add_object(client, &wl_compositor_interface,
+			     &compositor_implementation, id, data);
+}
+
+static void
+bind_shm(struct wl_client *client, void *data, uint32_t version, uint32_t id)
+{
+	wl_client_add_object(client, &wl_shm_interface,
+			     &shm_implementation, id, data);
+}
+
+static void
+client_destroy_notify(struct wl_listener *listener, void *data)
+{
+	struct server_state *state =
+		wl_container_of(listener, state, client_destroy);
+
+	wl_display_terminate(state->display);
+}
+
+static int
+server_main(int fd)
+{
+	struct server_state state;
+	struct wl_client *client;
+
+	memset(&state, 0, sizeof state);
+	state.display = wl_display_create();
+	assert(state.display);
+	wl_display_set_client_io_threads(state.display, 1);
+
+	wl_display_add_global(state.display, &wl_compositor_interface,
+			      &state, bind_compositor);
+	wl_display_add_global(state.display, &wl_shm_interface,
+			      &state, bind_shm);
+
+	client = wl_client_create(state.display, fd);
+	assert(client);
+	state.client_destroy.notify = client_destroy_notify;
+	wl_client_add_destroy_listener(client, &state.client_destroy);
+
+	wl_display_run(state.display);
+	wl_display_destroy(state.display);
+
+	assert(state.regions == 1);
+	assert(state.rects == NUM_RECTS);
+	assert(state.rect_sum == NUM_RECTS * (NUM_RECTS - 1) / 2);
+	assert(state.pools == 1);
+	assert(state.pool_size == 4096);
+	assert(state.pool_fd_valid);
+
+	return EXIT_SUCCESS;
+}
+
+static void
+wait_for(pid_t pid)
+{
+	int status;
+
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+}
+
+/* The server runs in a child process as well: glibc keeps part of the
+ * first thread's TLS allocated in its stack cache after the join, which
+ * the leak checker would otherwise report. */
+TEST(io_thread_dispatch)
+{
+	pid_t client_pid, server_pid;
+	int s[2];
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, s) == 0);
+
+	client_pid = fork();
+	assert(client_pid >= 0);
+	if (client_pid == 0) {
+		close(s[0]);
+		exit(client_main(s[1]));
+	}
+	close(s[1]);
+
+	server_pid = fork();
+	assert(server_pid >= 0);
+	if (server_pid == 0)
+		exit(server_main(s[0]));
+	close(s[0]);
+
+	wait_for(client_pid);
+	wait_for(server_pid);
+}
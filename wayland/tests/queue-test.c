@@ -22,8 +22,10 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <stdbool.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <assert.h>
@@ -48,6 +50,8 @@
 
 struct display {
 	struct wl_display *display;
+	struct wl_resource *output;
+	struct wl_listener output_destroy;
 	int child_exit_status;
 };
 
@@ -154,6 +158,317 @@ client_test_multiple_queues(void)
 	return ret == -1 ? -1 : 0;
 }
 
+static void
+default_queue_callback(void *data, struct wl_callback *callback,
+		       uint32_t serial)
+{
+	bool *done = data;
+
+	*done = true;
+	wl_callback_destroy(callback);
+}
+
+static const struct wl_callback_listener default_queue_listener = {
+	default_queue_callback
+};
+
+/* Test that a round trip on a queue only dispatches that queue. */
+static int
+client_test_queue_roundtrip(void)
+{
+	struct wl_display *display;
+	struct wl_event_queue *queue;
+	struct wl_callback *callback;
+	bool done = false;
+	int i;
+
+	display = wl_display_connect(SOCKET_NAME);
+	client_assert(display);
+	wl_display_dispatch_pending(display);
+
+	queue = wl_display_create_queue(display);
+	client_assert(queue);
+
+	callback = wl_display_sync(display);
+	wl_callback_add_listener(callback, &default_queue_listener, &done);
+
+	for (i = 0; i < 10; i++)
+		client_assert(wl_display_roundtrip_queue(display, queue) >= 0);
+	client_assert(!done);
+
+	client_assert(wl_display_roundtrip(display) >= 0);
+	client_assert(done);
+
+	/* The delete_id events for the queue's callback ids arrive after
+	 * the queue is gone. */
+	wl_event_queue_destroy(queue);
+	client_assert(wl_display_roundtrip(display) >= 0);
+
+	wl_display_disconnect(display);
+
+	return 0;
+}
+
+#define NUM_FAST_EVENTS 1000
+
+struct parallel_queues_state {
+	struct wl_display *display;
+	struct wl_event_queue *slow_queue;
+	struct wl_event_queue *fast_queue;
+	struct wl_callback *slow_callbacks[2];
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool slow_running;
+	bool fast_done;
+	int slow_count;
+	int fast_count;
+};
+
+static void
+slow_callback(void *data, struct wl_callback *callback, uint32_t serial)
+{
+	struct parallel_queues_state *state = data;
+
+	/* Block until the other thread has dispatched its whole queue and
+	 * destroyed our proxies. If dispatching held the display lock
+	 * across listeners, that thread could never get there. */
+	pthread_mutex_lock(&state->mutex);
+	state->slow_count++;
+	state->slow_running = true;
+	pthread_cond_broadcast(&state->cond);
+	while (!state->fast_done)
+		pthread_cond_wait(&state->cond, &state->mutex);
+	pthread_mutex_unlock(&state->mutex);
+}
+
+static const struct wl_callback_listener slow_listener = {
+	slow_callback
+};
+
+static void
+fast_callback(void *data, struct wl_callback *callback, uint32_t serial)
+{
+	struct parallel_queues_state *state = data;
+
+	state->fast_count++;
+	wl_callback_destroy(callback);
+}
+
+static const struct wl_callback_listener fast_listener = {
+	fast_callback
+};
+
+static void *
+slow_thread(void *data)
+{
+	struct parallel_queues_state *state = data;
+	int ret;
+
+	ret = wl_display_dispatch_queue_pending(state->display,
+						state->slow_queue);
+	client_assert(ret == 2);
+
+	return NULL;
+}
+
+static void *
+fast_thread(void *data)
+{
+	struct parallel_queues_state *state = data;
+	int i;
+
+	pthread_mutex_lock(&state->mutex);
+	while (!state->slow_running)
+		pthread_cond_wait(&state->cond, &state->mutex);
+	pthread_mutex_unlock(&state->mutex);
+
+	while (state->fast_count < NUM_FAST_EVENTS)
+		client_assert(wl_display_dispatch_queue_pending(state->display,
+								state->fast_queue) > 0);
+
+	/* Destroy the proxy whose listener is running on the other thread,
+	 * and the one whose event is still queued behind it. */
+	for (i = 0; i < 2; i++)
+		wl_callback_destroy(state->slow_callbacks[i]);
+
+	pthread_mutex_lock(&state->mutex);
+	state->fast_done = true;
+	pthread_cond_broadcast(&state->cond);
+	pthread_mutex_unlock(&state->mutex);
+
+	return NULL;
+}
+
+/* Test that a listener blocking on one queue doesn't keep another
+ * thread from dispatching its own queue, and that proxies destroyed
+ * from that other thread meanwhile are handled safely. */
+static int
+client_test_parallel_queues(void)
+{
+	struct parallel_queues_state state;
+	struct wl_callback *callback;
+	pthread_t slow, fast;
+	int i;
+
+	memset(&state, 0, sizeof state);
+	pthread_mutex_init(&state.mutex, NULL);
+	pthread_cond_init(&state.cond, NULL);
+
+	state.display = wl_display_connect(SOCKET_NAME);
+	client_assert(state.display);
+	wl_display_dispatch_pending(state.display);
+
+	state.slow_queue = wl_display_create_queue(state.display);
+	state.fast_queue = wl_display_create_queue(state.display);
+	client_assert(state.slow_queue && state.fast_queue);
+
+	for (i = 0; i < 2; i++) {
+		callback = wl_display_sync(state.display);
+		wl_callback_add_listener(callback, &slow_listener, &state);
+		wl_proxy_set_queue((struct wl_proxy *) callback,
+				   state.slow_queue);
+		state.slow_callbacks[i] = callback;
+	}
+
+	for (i = 0; i < NUM_FAST_EVENTS; i++) {
+		callback = wl_display_sync(state.display);
+		wl_callback_add_listener(callback, &fast_listener, &state);
+		wl_proxy_set_queue((struct wl_proxy *) callback,
+				   state.fast_queue);
+	}
+
+	/* The round trip on the default queue reads all the events above
+	 * into their queues. */
+	client_assert(wl_display_roundtrip(state.display) >= 0);
+
+	client_assert(pthread_create(&slow, NULL, slow_thread, &state) == 0);
+	client_assert(pthread_create(&fast, NULL, fast_thread, &state) == 0);
+	pthread_join(fast, NULL);
+	pthread_join(slow, NULL);
+
+	/* The second slow proxy was destroyed before its event was
+	 * dispatched, so its listener must not have run. */
+	client_assert(state.slow_count == 1);
+	client_assert(state.fast_count == NUM_FAST_EVENTS);
+
+	wl_event_queue_destroy(state.fast_queue);
+	wl_event_queue_destroy(state.slow_queue);
+	wl_display_disconnect(state.display);
+
+	pthread_cond_destroy(&state.cond);
+	pthread_mutex_destroy(&state.mutex);
+
+	return 0;
+}
+
+struct destroyed_argument_state {
+	struct wl_compositor *compositor;
+	struct wl_output *output;
+	struct wl_output *entered_output;
+	int enter_count;
+};
+
+static void
+destroyed_argument_handle_global(void *data, struct wl_registry *registry,
+				 uint32_t id, const char *interface,
+				 uint32_t version)
+{
+	struct destroyed_argument_state *state = data;
+
+	if (strcmp(interface, "wl_compositor") == 0)
+		state->compositor =
+			wl_registry_bind(registry, id,
+					 &wl_compositor_interface, 1);
+	else if (strcmp(interface, "wl_output") == 0)
+		state->output = wl_registry_bind(registry, id,
+						 &wl_output_interface, 1);
+}
+
+static const struct wl_registry_listener destroyed_argument_registry_listener = {
+	destroyed_argument_handle_global,
+	NULL
+};
+
+static void
+surface_enter(void *data, struct wl_surface *surface,
+	      struct wl_output *output)
+{
+	struct destroyed_argument_state *state = data;
+
+	state->enter_count++;
+	state->entered_output = output;
+}
+
+static void
+surface_leave(void *data, struct wl_surface *surface,
+	      struct wl_output *output)
+{
+	client_assert(0 && "unexpected event");
+}
+
+static const struct wl_surface_listener surface_listener = {
+	surface_enter,
+	surface_leave
+};
+
+/* Test that an object argument whose proxy was destroyed while its
+ * event sat in a queue reaches the listener as NULL, and that the
+ * reference the queued event held on the proxy is dropped so it gets
+ * freed. */
+static int
+client_test_destroyed_argument(void)
+{
+	struct destroyed_argument_state state;
+	struct test_counters counters;
+	struct wl_display *display;
+	struct wl_event_queue *queue;
+	struct wl_registry *registry;
+	struct wl_surface *surface;
+
+	memset(&state, 0, sizeof state);
+	test_counters_begin(&counters);
+
+	display = wl_display_connect(SOCKET_NAME);
+	client_assert(display);
+	wl_display_dispatch_pending(display);
+
+	queue = wl_display_create_queue(display);
+	client_assert(queue);
+
+	registry = wl_display_get_registry(display);
+	wl_registry_add_listener(registry,
+				 &destroyed_argument_registry_listener,
+				 &state);
+	client_assert(wl_display_roundtrip(display) >= 0);
+	client_assert(state.compositor && state.output);
+
+	/* The server answers the commit with an enter event for our
+	 * output, which the round trip reads into the surface's queue. */
+	surface = wl_compositor_create_surface(state.compositor);
+	wl_surface_add_listener(surface, &surface_listener, &state);
+	wl_proxy_set_queue((struct wl_proxy *) surface, queue);
+	wl_surface_commit(surface);
+	client_assert(wl_display_roundtrip(display) >= 0);
+	client_assert(state.enter_count == 0);
+
+	wl_output_destroy(state.output);
+
+	client_assert(wl_display_dispatch_queue_pending(display, queue) == 1);
+	client_assert(state.enter_count == 1);
+	client_assert(state.entered_output == NULL);
+
+	wl_surface_destroy(surface);
+	wl_compositor_destroy(state.compositor);
+	wl_registry_destroy(registry);
+	wl_event_queue_destroy(queue);
+	wl_display_disconnect(display);
+
+	test_counters_end(&counters);
+	client_assert(counters.live_allocs == 0);
+
+	return 0;
+}
+
 static void
 client_alarm_handler(int sig)
 {
@@ -196,6 +511,21 @@ client_main(int fd)
 		return EXIT_FAILURE;
 	}
 
+	if (client_test_queue_roundtrip() != 0) {
+		fprintf(stderr, "queue roundtrip test failed\n");
+		return EXIT_FAILURE;
+	}
+
+	if (client_test_parallel_queues() != 0) {
+		fprintf(stderr, "parallel queues test failed\n");
+		return EXIT_FAILURE;
+	}
+
+	if (client_test_destroyed_argument() != 0) {
+		fprintf(stderr, "destroyed argument test failed\n");
+		return EXIT_FAILURE;
+	}
+
 	return EXIT_SUCCESS;
 }
 
@@ -205,6 +535,85 @@ dummy_bind(struct wl_client *client,
 {
 }
 
+static void
+surface_destroy(struct wl_client *client, struct wl_resource *resource)
+{
+	wl_resource_destroy(resource);
+}
+
+static void
+surface_commit(struct wl_client *client, struct wl_resource *resource)
+{
+	struct display *display = wl_resource_get_user_data(resource);
+
+	assert(display->output);
+	wl_surface_send_enter(resource, display->output);
+}
+
+static const struct wl_surface_interface surface_implementation = {
+	surface_destroy,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	surface_commit,
+	NULL,
+	NULL
+};
+
+static void
+compositor_create_surface(struct wl_client *client,
+			  struct wl_resource *resource, uint32_t id)
+{
+	wl_client_add_object(client, &wl_surface_interface,
+			     &surface_implementation, id,
+			     wl_resource_get_user_data(resource));
+}
+
+static void
+compositor_create_region(struct wl_client *client,
+			 struct wl_resource *resource, uint32_t id)
+{
+	assert(0 && "unexpected request");
+}
+
+static const struct wl_compositor_interface compositor_implementation = {
+	compositor_create_surface,
+	compositor_create_region
+};
+
+static void
+compositor_bind(struct wl_client *client,
+		void *data, uint32_t version, uint32_t id)
+{
+	wl_client_add_object(client, &wl_compositor_interface,
+			     &compositor_implementation, id, data);
+}
+
+static void
+output_destroyed(struct wl_listener *listener, void *data)
+{
+	struct display *display;
+
+	display = wl_container_of(listener, display, output_destroy);
+
+	display->output = NULL;
+}
+
+static void
+output_bind(struct wl_client *client,
+	    void *data, uint32_t version, uint32_t id)
+{
+	struct display *display = data;
+
+	display->output = wl_client_add_object(client, &wl_output_interface,
+					       NULL, id, display);
+	display->output_destroy.notify = output_destroyed;
+	wl_resource_add_destroy_listener(display->output,
+					 &display->output_destroy);
+}
+
 static int
 sigchld_handler(int signal_number, void *data)
 {
@@ -259,6 +668,7 @@ TEST(queue)
 	close(fds[0]);
 
 	display.child_exit_status = EXIT_FAILURE;
+	display.output = NULL;
 	display.display = wl_display_create();
 	if (!display.display) {
 		signal_client(fds[1], false);
@@ -268,6 +678,10 @@ TEST(queue)
 	for (i = 0; i < ARRAY_LENGTH(dummy_interfaces); i++)
 		wl_display_add_global(display.display, dummy_interfaces[i],
 				      NULL, dummy_bind);
+	wl_display_add_global(display.display, &wl_compositor_interface,
+			      &display, compositor_bind);
+	wl_display_add_global(display.display, &wl_output_interface,
+			      &display, output_bind);
 
 	ret = wl_display_add_socket(display.display, SOCKET_NAME);
 	assert(ret == 0);
@@ -0,0 +1,167 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+
+#include "wayland-client.h"
+#include "wayland-server.h"
+
+#define NUM_ROUNDTRIPS 100000
+
+static void
+sync_callback(void *data, struct wl_callback *callback, uint32_t serial)
+{
+	int *done = data;
+
+	*done = 1;
+	wl_callback_destroy(callback);
+}
+
+static const struct wl_callback_listener sync_listener = {
+	sync_callback
+};
+
+/* What wl_display_roundtrip() used to do: a callback proxy per call. */
+static void
+callback_roundtrips(struct wl_display *display)
+{
+	struct wl_callback *callback;
+	int i, done;
+
+	for (i = 0; i < NUM_ROUNDTRIPS; i++) {
+		done = 0;
+		callback = wl_display_sync(display);
+		wl_callback_add_listener(callback, &sync_listener, &done);
+		while (!done)
+			assert(wl_display_dispatch(display) >= 0);
+	}
+}
+
+static void
+display_roundtrips(struct wl_display *display)
+{
+	int i;
+
+	for (i = 0; i < NUM_ROUNDTRIPS; i++)
+		assert(wl_display_roundtrip(display) >= 0);
+}
+
+static void
+queue_roundtrips(struct wl_display *display)
+{
+	struct wl_event_queue *queue;
+	int i;
+
+	queue = wl_display_create_queue(display);
+	assert(queue);
+
+	for (i = 0; i < NUM_ROUNDTRIPS; i++)
+		assert(wl_display_roundtrip_queue(display, queue) >= 0);
+
+	wl_event_queue_destroy(queue);
+}
+
+static void
+benchmark(struct wl_display *display, const char *s,
+	  void (*f)(struct wl_display *display))
+{
+	struct timespec start, stop;
+	double elapsed;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	f(display);
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	elapsed = stop.tv_sec - start.tv_sec +
+		(stop.tv_nsec - start.tv_nsec) / 1e9;
+	printf("benchmarked %s:\t%.0f roundtrips/s\n",
+	       s, NUM_ROUNDTRIPS / elapsed);
+}
+
+struct server {
+	struct wl_display *display;
+	struct wl_listener client_destroy;
+};
+
+static void
+client_destroy_notify(struct wl_listener *listener, void *data)
+{
+	struct server *server =
+		wl_container_of(listener, server, client_destroy);
+
+	wl_display_terminate(server->display);
+}
+
+static void
+run_server(int fd)
+{
+	struct server server;
+	struct wl_client *client;
+
+	server.display = wl_display_create();
+	assert(server.display);
+	client = wl_client_create(server.display, fd);
+	assert(client);
+
+	server.client_destroy.notify = client_destroy_notify;
+	wl_client_add_destroy_listener(client, &server.client_destroy);
+
+	wl_display_run(server.display);
+	wl_display_destroy(server.display);
+}
+
+int main(int argc, char *argv[])
+{
+	struct wl_display *display;
+	pid_t pid;
+	int status, s[2];
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, s) == 0);
+
+	pid = fork();
+	assert(pid >= 0);
+	if (pid == 0) {
+		close(s[0]);
+		run_server(s[1]);
+		exit(EXIT_SUCCESS);
+	}
+	close(s[1]);
+
+	display = wl_display_connect_to_fd(s[0]);
+	assert(display);
+
+	benchmark(display, "callback", callback_roundtrips);
+	benchmark(display, "roundtrip", display_roundtrips);
+	benchmark(display, "queue", queue_roundtrips);
+
+	wl_display_disconnect(display);
+	assert(waitpid(pid, &status, 0) == pid);
+
+	return 0;
+}
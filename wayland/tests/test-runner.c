@@ -31,14 +31,26 @@
 #include <assert.h>
 #include <dlfcn.h>
 #include <errno.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
 #include "test-runner.h"
 
 static int num_alloc;
+static int num_alloc_calls;
+static int num_syscalls;
 static void* (*sys_malloc)(size_t);
 static void (*sys_free)(void*);
 static void* (*sys_realloc)(void*, size_t);
 static void* (*sys_calloc)(size_t, size_t);
 
+static ssize_t (*sys_read)(int, void *, size_t);
+static ssize_t (*sys_write)(int, const void *, size_t);
+static ssize_t (*sys_sendmsg)(int, const struct msghdr *, int);
+static ssize_t (*sys_recvmsg)(int, struct msghdr *, int);
+static int (*sys_epoll_wait)(int, struct epoll_event *, int, int);
+static int (*sys_poll)(struct pollfd *, nfds_t, int);
+
 int leak_check_enabled;
 
 extern const struct test __start_test_section, __stop_test_section;
@@ -47,6 +59,7 @@ __attribute__ ((visibility("default"))) void *
 malloc(size_t size)
 {
 	num_alloc++;
+	num_alloc_calls++;
 	return sys_malloc(size);
 }
 
@@ -63,6 +76,7 @@ realloc(void* mem, size_t size)
 {
 	if (mem == NULL)
 		num_alloc++;
+	num_alloc_calls++;
 	return sys_realloc(mem, size);
 }
 
@@ -73,10 +87,72 @@ calloc(size_t nmemb, size_t size)
 		return NULL;
 
 	num_alloc++;
+	num_alloc_calls++;
 
 	return sys_calloc(nmemb, size);
 }
 
+/* The syscall wrappers are weak so tests that interpose the same
+ * functions themselves, like os-wrappers-test, take precedence. */
+
+__attribute__ ((visibility("default"), weak)) ssize_t
+read(int fd, void *buf, size_t count)
+{
+	num_syscalls++;
+	return sys_read(fd, buf, count);
+}
+
+__attribute__ ((visibility("default"), weak)) ssize_t
+write(int fd, const void *buf, size_t count)
+{
+	num_syscalls++;
+	return sys_write(fd, buf, count);
+}
+
+__attribute__ ((visibility("default"), weak)) ssize_t
+sendmsg(int sockfd, const struct msghdr *msg, int flags)
+{
+	num_syscalls++;
+	return sys_sendmsg(sockfd, msg, flags);
+}
+
+__attribute__ ((visibility("default"), weak)) ssize_t
+recvmsg(int sockfd, struct msghdr *msg, int flags)
+{
+	num_syscalls++;
+	return sys_recvmsg(sockfd, msg, flags);
+}
+
+__attribute__ ((visibility("default"), weak)) int
+epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout)
+{
+	num_syscalls++;
+	return sys_epoll_wait(epfd, events, maxevents, timeout);
+}
+
+__attribute__ ((visibility("default"), weak)) int
+poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+	num_syscalls++;
+	return sys_poll(fds, nfds, timeout);
+}
+
+void
+test_counters_begin(struct test_counters *counters)
+{
+	counters->allocs = num_alloc_calls;
+	counters->syscalls = num_syscalls;
+	counters->live_allocs = num_alloc;
+}
+
+void
+test_counters_end(struct test_counters *counters)
+{
+	counters->allocs = num_alloc_calls - counters->allocs;
+	counters->syscalls = num_syscalls - counters->syscalls;
+	counters->live_allocs = num_alloc - counters->live_allocs;
+}
+
 static const struct test *
 find_test(const char *name)
 {
@@ -135,6 +211,13 @@ int main(int argc, char *argv[])
 	sys_malloc = dlsym(RTLD_NEXT, "malloc");
 	sys_free = dlsym(RTLD_NEXT, "free");
 
+	sys_read = dlsym(RTLD_NEXT, "read");
+	sys_write = dlsym(RTLD_NEXT, "write");
+	sys_sendmsg = dlsym(RTLD_NEXT, "sendmsg");
+	sys_recvmsg = dlsym(RTLD_NEXT, "recvmsg");
+	sys_epoll_wait = dlsym(RTLD_NEXT, "epoll_wait");
+	sys_poll = dlsym(RTLD_NEXT, "poll");
+
 	leak_check_enabled = !getenv("NO_ASSERT_LEAK_CHECK");
 
 	if (argc == 2 && strcmp(argv[1], "--help") == 0)
@@ -31,6 +31,32 @@ struct test {
 								\
 	static void name(void)
 
+/* Scoped counters for allocations (malloc, calloc and realloc calls) and
+ * the syscalls the libraries use on hot paths (read, write, sendmsg,
+ * recvmsg, epoll_wait and poll).  test_counters_begin() starts counting
+ * and test_counters_end() leaves the number of calls made since then in
+ * the struct, along with how many more allocations are live than at the
+ * start. */
+struct test_counters {
+	int allocs;
+	int syscalls;
+	int live_allocs;
+};
+
+void
+test_counters_begin(struct test_counters *counters);
+
+void
+test_counters_end(struct test_counters *counters);
+
+#define assert_alloc_budget(counters, max)				\
+	assert((counters)->allocs <= (max) &&				\
+	       "allocation budget exceeded")
+
+#define assert_syscall_budget(counters, max)				\
+	assert((counters)->syscalls <= (max) &&				\
+	       "syscall budget exceeded")
+
 int
 count_open_fds(void);
 
@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <math.h>
@@ -46,6 +47,10 @@
 
 extern char **environ; /* defined by libc */
 
+#ifndef TFD_TIMER_CANCEL_ON_SET
+#define TFD_TIMER_CANCEL_ON_SET (1 << 1)
+#endif
+
 struct desktop {
 	struct display *display;
 	struct desktop_shell *shell;
@@ -339,6 +344,9 @@ panel_launcher_button_handler(struct widget *widget,
 		panel_launcher_activate(launcher);
 }
 
+static int
+clock_timer_reset(struct panel_clock *clock);
+
 static void
 clock_func(struct task *task, uint32_t events)
 {
@@ -346,8 +354,12 @@ clock_func(struct task *task, uint32_t events)
 		container_of(task, struct panel_clock, clock_task);
 	uint64_t exp;
 
-	if (read(clock->clock_fd, &exp, sizeof exp) != sizeof exp)
+	/* ECANCELED means the wall clock was set, the minute shown may
+	 * have changed and the timer needs re-arming either way. */
+	if (read(clock->clock_fd, &exp, sizeof exp) != sizeof exp &&
+	    errno != ECANCELED)
 		abort();
+	clock_timer_reset(clock);
 	widget_schedule_redraw(clock->widget);
 }
 
@@ -371,7 +383,17 @@ panel_clock_redraw_handler(struct widget *widget, void *data)
 	if (allocation.width == 0)
 		return;
 
-	cr = widget_cairo_create(clock->panel->widget);
+	cr = widget_cairo_create(widget);
+
+	/* On its own surface, the clock is drawn over the panel by the
+	 * compositor. */
+	if (widget_get_wl_surface(widget) !=
+	    widget_get_wl_surface(clock->panel->widget)) {
+		cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+		cairo_paint(cr);
+		cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+	}
+
 	cairo_select_font_face(cr, "sans",
 			       CAIRO_FONT_SLANT_NORMAL,
 			       CAIRO_FONT_WEIGHT_NORMAL);
@@ -393,12 +415,18 @@ static int
 clock_timer_reset(struct panel_clock *clock)
 {
 	struct itimerspec its;
+	struct timespec now;
 
-	its.it_interval.tv_sec = 60;
+	/* Wake up when the minute shown changes, and not in between, or
+	 * when the wall clock is set. */
+	clock_gettime(CLOCK_REALTIME, &now);
+	its.it_interval.tv_sec = 0;
 	its.it_interval.tv_nsec = 0;
-	its.it_value.tv_sec = 60;
+	its.it_value.tv_sec = (now.tv_sec / 60 + 1) * 60;
 	its.it_value.tv_nsec = 0;
-	if (timerfd_settime(clock->clock_fd, 0, &its, NULL) < 0) {
+	if (timerfd_settime(clock->clock_fd,
+			    TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET,
+			    &its, NULL) < 0) {
 		fprintf(stderr, "could not set timerfd\n: %m");
 		return -1;
 	}
@@ -419,10 +447,13 @@ panel_destroy_clock(struct panel_clock *clock)
 static void
 panel_add_clock(struct panel *panel)
 {
+	struct display *display = window_get_display(panel->window);
+	struct wl_compositor *compositor;
+	struct wl_region *region;
 	struct panel_clock *clock;
 	int timerfd;
 
-	timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	timerfd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC);
 	if (timerfd < 0) {
 		fprintf(stderr, "could not create timerfd\n: %m");
 		return;
@@ -435,11 +466,24 @@ panel_add_clock(struct panel *panel)
 	clock->clock_fd = timerfd;
 
 	clock->clock_task.run = clock_func;
-	display_watch_fd(window_get_display(panel->window), clock->clock_fd,
+	display_watch_fd(display, clock->clock_fd,
 			 EPOLLIN, &clock->clock_task);
 	clock_timer_reset(clock);
 
-	clock->widget = widget_add_widget(panel->widget, clock);
+	/* A surface of its own lets the clock update without redrawing,
+	 * uploading and recompositing the whole panel every minute.
+	 * Input goes to the panel underneath. */
+	clock->widget = window_add_subsurface(panel->window, clock,
+					      SUBSURFACE_DESYNCHRONIZED);
+	if (clock->widget) {
+		compositor = display_get_compositor(display);
+		region = wl_compositor_create_region(compositor);
+		wl_surface_set_input_region(widget_get_wl_surface(clock->widget),
+					    region);
+		wl_region_destroy(region);
+	} else {
+		clock->widget = widget_add_widget(panel->widget, clock);
+	}
 	widget_set_redraw_handler(clock->widget, panel_clock_redraw_handler);
 }
 
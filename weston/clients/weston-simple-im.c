@@ -72,6 +72,10 @@ struct simple_im {
 	keyboard_input_key_handler_t key_handler;
 
 	uint32_t serial;
+	uint32_t key_serial;
+
+	uint32_t interface_version;
+	int key_filter;
 };
 
 static const struct compose_seq compose_seqs[] = {
@@ -100,6 +104,37 @@ static const uint32_t ignore_keys_on_compose[] = {
 	XKB_KEY_Shift_R
 };
 
+/* Outside of a compose sequence only the compose key itself needs to
+ * go through the input method, everything else can go to the client
+ * directly. Passing the serial of the last key we got also tells the
+ * compositor that we are done with it. */
+static void
+simple_im_update_key_filter(struct simple_im *keyboard)
+{
+	struct wl_array keysyms;
+	uint32_t *sym;
+
+	if (!keyboard->key_filter || !keyboard->context ||
+	    keyboard->interface_version < 2)
+		return;
+
+	if (keyboard->compose_state == state_compose) {
+		wl_input_method_context_clear_key_filter(keyboard->context,
+							 keyboard->key_serial);
+		return;
+	}
+
+	wl_array_init(&keysyms);
+	sym = wl_array_add(&keysyms, sizeof *sym);
+	if (sym) {
+		*sym = XKB_KEY_Multi_key;
+		wl_input_method_context_set_key_filter(keyboard->context,
+						       keyboard->key_serial,
+						       &keysyms, 0);
+	}
+	wl_array_release(&keysyms);
+}
+
 static void
 handle_surrounding_text(void *data,
 			struct wl_input_method_context *context,
@@ -119,6 +154,7 @@ handle_reset(void *data,
 	fprintf(stderr, "Reset pre-edit buffer\n");
 
 	keyboard->compose_state = state_normal;
+	simple_im_update_key_filter(keyboard);
 }
 
 static void
@@ -238,9 +274,13 @@ input_method_keyboard_key(void *data,
 	if (num_syms == 1)
 		sym = syms[0];
 
+	keyboard->key_serial = serial;
+
 	if (keyboard->key_handler)
 		(*keyboard->key_handler)(keyboard, serial, time, key, sym,
 					 state);
+
+	simple_im_update_key_filter(keyboard);
 }
 
 static void
@@ -296,6 +336,7 @@ input_method_activate(void *data,
 	keyboard->compose_state = state_normal;
 
 	keyboard->serial = 0;
+	keyboard->key_serial = 0;
 
 	keyboard->context = context;
 	wl_input_method_context_add_listener(context,
@@ -305,6 +346,7 @@ input_method_activate(void *data,
 	wl_keyboard_add_listener(keyboard->keyboard,
 				 &input_method_keyboard_listener,
 				 keyboard);
+	simple_im_update_key_filter(keyboard);
 }
 
 static void
@@ -333,9 +375,11 @@ registry_handle_global(void *data, struct wl_registry *registry,
 	struct simple_im *keyboard = data;
 
 	if (!strcmp(interface, "wl_input_method")) {
+		keyboard->interface_version = (version < 2) ? version : 2;
 		keyboard->input_method =
 			wl_registry_bind(registry, name,
-					 &wl_input_method_interface, 1);
+					 &wl_input_method_interface,
+					 keyboard->interface_version);
 		wl_input_method_add_listener(keyboard->input_method,
 					     &input_method_listener, keyboard);
 	}
@@ -396,7 +440,7 @@ simple_im_key_handler(struct simple_im *keyboard,
 
 		for (i = 0; i < sizeof(ignore_keys_on_compose) / sizeof(ignore_keys_on_compose[0]); i++) {
 			if (sym == ignore_keys_on_compose[i]) {
-				wl_input_method_context_key(context, keyboard->serial, time, key, state);
+				wl_input_method_context_key(context, serial, time, key, state);
 				return;
 			}
 		}
@@ -504,6 +548,10 @@ main(int argc, char *argv[])
 	simple_im.context = NULL;
 	simple_im.key_handler =  simple_im_key_handler;
 
+	/* The input method is started by the compositor without
+	 * arguments, so this is set through the environment. */
+	simple_im.key_filter = !getenv("WESTON_SIMPLE_IM_GRAB_ALL_KEYS");
+
 	while (ret != -1)
 		ret = wl_display_dispatch(simple_im.display);
 
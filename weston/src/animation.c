@@ -32,72 +32,6 @@
 
 #include "compositor.h"
 
-WL_EXPORT void
-weston_spring_init(struct weston_spring *spring,
-		 double k, double current, double target)
-{
-	spring->k = k;
-	spring->friction = 400.0;
-	spring->current = current;
-	spring->previous = current;
-	spring->target = target;
-}
-
-WL_EXPORT void
-weston_spring_update(struct weston_spring *spring, uint32_t msec)
-{
-	double force, v, current, step;
-
-	/* Limit the number of executions of the loop below by ensuring that
-	 * the timestamp for last update of the spring is no more than 1s ago.
-	 * This handles the case where time moves backwards or forwards in
-	 * large jumps.
-	 */
-	if (msec - spring->timestamp > 1000) {
-		weston_log("unexpectedly large timestamp jump (from %u to %u)\n",
-			   spring->timestamp, msec);
-		spring->timestamp = msec - 1000;
-	}
-
-	step = 0.01;
-	while (4 < msec - spring->timestamp) {
-		current = spring->current;
-		v = current - spring->previous;
-		force = spring->k * (spring->target - current) / 10.0 +
-			(spring->previous - current) - v * spring->friction;
-
-		spring->current =
-			current + (current - spring->previous) +
-			force * step * step;
-		spring->previous = current;
-
-#if 0
-		if (spring->current >= 1.0) {
-#ifdef TWEENER_BOUNCE
-			spring->current = 2.0 - spring->current;
-			spring->previous = 2.0 - spring->previous;
-#else
-			spring->current = 1.0;
-			spring->previous = 1.0;
-#endif
-		}
-
-		if (spring->current <= 0.0) {
-			spring->current = 0.0;
-			spring->previous = 0.0;
-		}
-#endif
-		spring->timestamp += 4;
-	}
-}
-
-WL_EXPORT int
-weston_spring_done(struct weston_spring *spring)
-{
-	return fabs(spring->previous - spring->target) < 0.0002 &&
-		fabs(spring->current - spring->target) < 0.0002;
-}
-
 typedef	void (*weston_surface_animation_frame_func_t)(struct weston_surface_animation *animation);
 
 struct weston_surface_animation {
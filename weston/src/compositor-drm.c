@@ -48,6 +48,7 @@
 #include "pixman-renderer.h"
 #include "udev-seat.h"
 #include "launcher-util.h"
+#include "plane-planner.h"
 
 #ifndef DRM_CAP_TIMESTAMP_MONOTONIC
 #define DRM_CAP_TIMESTAMP_MONOTONIC 0x6
@@ -758,12 +759,11 @@ drm_surface_transform_supported(struct weston_surface *es)
 
 static struct weston_plane *
 drm_output_prepare_overlay_surface(struct weston_output *output_base,
-				   struct weston_surface *es)
+				   struct weston_surface *es,
+				   struct drm_sprite *s)
 {
 	struct weston_compositor *ec = output_base->compositor;
 	struct drm_compositor *c =(struct drm_compositor *) ec;
-	struct drm_sprite *s;
-	int found = 0;
 	struct gbm_bo *bo;
 	pixman_region32_t dest_rect, src_rect;
 	pixman_box32_t *box, tbox;
@@ -797,20 +797,6 @@ drm_output_prepare_overlay_surface(struct weston_output *output_base,
 	if (!drm_surface_transform_supported(es))
 		return NULL;
 
-	wl_list_for_each(s, &c->sprite_list, link) {
-		if (!drm_sprite_crtc_supported(output_base, s->possible_crtcs))
-			continue;
-
-		if (!s->next) {
-			found = 1;
-			break;
-		}
-	}
-
-	/* No sprites available */
-	if (!found)
-		return NULL;
-
 	bo = gbm_bo_import(c->gbm, GBM_BO_IMPORT_WL_BUFFER,
 			   es->buffer_ref.buffer, GBM_BO_USE_SCANOUT);
 	if (!bo)
@@ -979,30 +965,173 @@ drm_output_set_cursor(struct drm_output *output)
 	}
 }
 
+/* Describes the planes the surfaces of the output could go on, in the
+ * order the planner should try them: the cursor, then the scanout
+ * buffer, then the sprites that are still free. */
+static int
+drm_output_get_planner_planes(struct drm_output *output,
+			      struct planner_plane *planes,
+			      struct drm_sprite **sprites)
+{
+	struct drm_compositor *c =
+		(struct drm_compositor *) output->base.compositor;
+	struct drm_sprite *s;
+	int count = 0;
+
+	if (c->gbm == NULL)
+		return 0;
+
+	if (!c->cursors_are_broken &&
+	    output->base.transform == WL_OUTPUT_TRANSFORM_NORMAL) {
+		planes[count].type = PLANNER_PLANE_CURSOR;
+		planes[count].formats = NULL;
+		planes[count].format_count = 0;
+		planes[count].max_width = 64;
+		planes[count].max_height = 64;
+		planes[count].can_scale = 0;
+		planes[count].z = 2;
+		sprites[count++] = NULL;
+	}
+
+	planes[count].type = PLANNER_PLANE_SCANOUT;
+	planes[count].formats = NULL;
+	planes[count].format_count = 0;
+	planes[count].max_width = 0;
+	planes[count].max_height = 0;
+	planes[count].can_scale = 0;
+	planes[count].z = 0;
+	sprites[count++] = NULL;
+
+	if (c->sprites_are_broken)
+		return count;
+
+	/* The stacking order of sprites among themselves isn't defined,
+	 * so they all get the same z. */
+	wl_list_for_each(s, &c->sprite_list, link) {
+		if (count == PLANNER_MAX_PLANES)
+			break;
+		if (!drm_sprite_crtc_supported(&output->base,
+					       s->possible_crtcs) || s->next)
+			continue;
+
+		planes[count].type = PLANNER_PLANE_OVERLAY;
+		planes[count].formats = s->formats;
+		planes[count].format_count = s->count_formats;
+		planes[count].max_width = 0;
+		planes[count].max_height = 0;
+		planes[count].can_scale = 1;
+		planes[count].z = 1;
+		sprites[count++] = s;
+	}
+
+	return count;
+}
+
+static void
+drm_output_get_planner_surface(struct weston_output *output,
+			       struct weston_surface *es,
+			       struct planner_surface *surface)
+{
+	struct wl_buffer *buffer = es->buffer_ref.buffer;
+
+	surface->box = *pixman_region32_extents(&es->transform.boundingbox);
+	/* Finding out the format means importing the buffer, the prepare
+	 * functions do that for the surfaces that get a plane. */
+	surface->format = 0;
+	surface->flags = 0;
+
+	if (buffer == NULL || es->alpha != 1.0f ||
+	    es->output_mask != (1u << output->id))
+		surface->flags |= PLANNER_SURFACE_PRIMARY_ONLY;
+	else if (wl_buffer_is_shm(buffer))
+		surface->flags |= PLANNER_SURFACE_SHM;
+
+	if (!drm_surface_transform_supported(es) ||
+	    es->buffer_transform != output->transform ||
+	    es->buffer_scale != output->scale)
+		surface->flags |= PLANNER_SURFACE_TRANSFORMED;
+
+	if (es->transform.enabled &&
+	    (es->transform.matrix.type & WESTON_MATRIX_TRANSFORM_SCALE))
+		surface->flags |= PLANNER_SURFACE_SCALED;
+}
+
+static struct weston_plane *
+drm_output_prepare_plane(struct weston_output *output,
+			 struct weston_surface *es,
+			 const struct planner_plane *plane,
+			 struct drm_sprite *sprite)
+{
+	switch (plane->type) {
+	case PLANNER_PLANE_CURSOR:
+		return drm_output_prepare_cursor_surface(output, es);
+	case PLANNER_PLANE_SCANOUT:
+		return drm_output_prepare_scanout_surface(output, es);
+	case PLANNER_PLANE_OVERLAY:
+		return drm_output_prepare_overlay_surface(output, es, sprite);
+	}
+
+	return NULL;
+}
+
 static void
 drm_assign_planes(struct weston_output *output)
 {
 	struct drm_compositor *c =
 		(struct drm_compositor *) output->compositor;
+	struct planner_plane planes[PLANNER_MAX_PLANES];
+	struct drm_sprite *sprites[PLANNER_MAX_PLANES];
+	struct planner_surface *surfaces;
+	struct planner_scene scene;
 	struct weston_surface *es, *next;
 	pixman_region32_t overlap, surface_overlap;
 	struct weston_plane *primary, *next_plane;
+	int *assignment;
+	int i, count;
 
 	/*
-	 * Find a surface for each sprite in the output using some heuristics:
-	 * 1) size
-	 * 2) frequency of update
-	 * 3) opacity (though some hw might support alpha blending)
-	 * 4) clipping (this can be fixed with color keys)
-	 *
-	 * The idea is to save on blitting since this should save power.
-	 * If we can get a large video surface on the sprite for example,
-	 * the main display surface may not need to update at all, and
-	 * the client buffer can be used directly for the sprite surface
-	 * as we do for flipping full screen surfaces.
+	 * The planner picks the surfaces that go on the cursor, the
+	 * scanout buffer and the sprites so that as little as possible
+	 * has to be composited, which saves on blitting and power.  If
+	 * we can get a large video surface on a sprite for example, the
+	 * primary plane may not need to update at all, and the client
+	 * buffer can be used directly for the sprite as we do for
+	 * flipping full screen surfaces.
 	 */
-	pixman_region32_init(&overlap);
 	primary = &c->base.primary_plane;
+	count = wl_list_length(&c->base.surface_list);
+	surfaces = malloc(count * sizeof *surfaces + 1);
+	assignment = malloc(count * sizeof *assignment + 1);
+	if (surfaces == NULL || assignment == NULL) {
+		free(surfaces);
+		free(assignment);
+		wl_list_for_each(es, &c->base.surface_list, link) {
+			es->keep_buffer = 0;
+			weston_surface_move_to_plane(es, primary);
+		}
+		return;
+	}
+
+	i = 0;
+	wl_list_for_each(es, &c->base.surface_list, link)
+		drm_output_get_planner_surface(output, es, &surfaces[i++]);
+
+	scene.output = *pixman_region32_extents(&output->region);
+	scene.planes = planes;
+	scene.plane_count =
+		drm_output_get_planner_planes((struct drm_output *) output,
+					      planes, sprites);
+	scene.surfaces = surfaces;
+	scene.surface_count = count;
+	planner_assign_planes(&scene, assignment);
+	free(surfaces);
+
+	/* Setting up a plane can still fail, for buffers that can't be
+	 * imported or have a format the plane doesn't take.  Those go
+	 * to the primary plane, and so does anything below them that
+	 * they overlap. */
+	pixman_region32_init(&overlap);
+	i = 0;
 	wl_list_for_each_safe(es, next, &c->base.surface_list, link) {
 		/* test whether this buffer can ever go into a plane:
 		 * non-shm, or small enough to be a cursor
@@ -1019,14 +1148,12 @@ drm_assign_planes(struct weston_output *output)
 					  &es->transform.boundingbox);
 
 		next_plane = NULL;
-		if (pixman_region32_not_empty(&surface_overlap))
-			next_plane = primary;
-		if (next_plane == NULL)
-			next_plane = drm_output_prepare_cursor_surface(output, es);
-		if (next_plane == NULL)
-			next_plane = drm_output_prepare_scanout_surface(output, es);
-		if (next_plane == NULL)
-			next_plane = drm_output_prepare_overlay_surface(output, es);
+		if (assignment[i] != PLANNER_PRIMARY &&
+		    !pixman_region32_not_empty(&surface_overlap))
+			next_plane =
+				drm_output_prepare_plane(output, es,
+							 &planes[assignment[i]],
+							 sprites[assignment[i]]);
 		if (next_plane == NULL)
 			next_plane = primary;
 		weston_surface_move_to_plane(es, next_plane);
@@ -1035,8 +1162,10 @@ drm_assign_planes(struct weston_output *output)
 					      &es->transform.boundingbox);
 
 		pixman_region32_fini(&surface_overlap);
+		i++;
 	}
 	pixman_region32_fini(&overlap);
+	free(assignment);
 }
 
 static void
@@ -2520,6 +2649,10 @@ drm_compositor_create(struct wl_display *display,
 	ec->drm_source =
 		wl_event_loop_add_fd(loop, ec->drm.fd,
 				     WL_EVENT_READABLE, on_drm_input, ec);
+	/* Page flip and vblank events shouldn't wait behind clients. */
+	if (ec->drm_source)
+		wl_event_source_set_priority(ec->drm_source,
+					     WL_EVENT_PRIORITY_HIGH);
 
 	ec->udev_monitor = udev_monitor_new_from_netlink(ec->udev, "udev");
 	if (ec->udev_monitor == NULL) {
@@ -25,7 +25,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/ioctl.h>
 #include <linux/input.h>
+#include <linux/sockios.h>
 
 #include <freerdp/freerdp.h>
 #include <freerdp/listener.h>
@@ -42,6 +44,24 @@
 #define MAX_FREERDP_FDS 32
 #define DEFAULT_AXIS_STEP_DISTANCE wl_fixed_from_int(10)
 
+/* largest cursor a 32bpp new pointer update can carry */
+#define RDP_CURSOR_MAX_SIZE 96
+#define RDP_CURSOR_CACHE_SIZE 16
+#define RDP_CURSOR_HIDDEN -1
+
+/* what a surface bits command costs on top of its pixels, in pixels;
+ * used to decide how to split NSCodec damage */
+#define RDP_NSC_COMMAND_COST 256
+
+/* bytes a peer's socket may have queued before we stop sending it
+ * frames and let its damage pile up */
+#define RDP_PEER_MAX_BACKLOG (256 * 1024)
+
+/* bounds in ms of the backoff between checks whether a peer that is
+ * behind has drained its socket */
+#define RDP_BACKLOG_MIN_DELAY 32
+#define RDP_BACKLOG_MAX_DELAY 512
+
 struct rdp_compositor_config {
 	int width;
 	int height;
@@ -72,6 +92,7 @@ struct rdp_compositor {
 enum peer_item_flags {
 	RDP_PEER_ACTIVATED      = (1 << 0),
 	RDP_PEER_OUTPUT_ENABLED = (1 << 1),
+	RDP_PEER_FRAME_ENCODED  = (1 << 2),
 };
 
 struct rdp_peers_item {
@@ -85,11 +106,27 @@ struct rdp_peers_item {
 struct rdp_output {
 	struct weston_output base;
 	struct wl_event_source *finish_frame_timer;
+	struct wl_event_source *backlog_timer;
+	int backlog_delay;
 	pixman_image_t *shadow_surface;
 
 	struct wl_list peers;
 };
 
+struct rdp_cursor_cache_entry {
+	uint32_t hash;
+	int32_t width, height;
+	int32_t hotspot_x, hotspot_y;
+	uint32_t last_used;
+};
+
+/* One surface bits command of an encoded frame, its data is at offset
+ * in the encode stream. */
+struct rdp_surface_bits {
+	SURFACE_BITS_COMMAND cmd;
+	size_t offset;
+};
+
 struct rdp_peer_context {
 	rdpContext _p;
 
@@ -99,6 +136,25 @@ struct rdp_peer_context {
 	wStream *encode_stream;
 	RFX_RECT *rfx_rects;
 	NSC_CONTEXT *nsc_context;
+	pixman_box32_t *nsc_boxes;
+
+	/* the last frame encoded with this peer's codec contexts */
+	struct rdp_surface_bits *frame_bits;
+	int frame_bits_count, frame_bits_size;
+	int frame_markers;
+
+	/* damage the peer hasn't been sent yet because it is behind */
+	pixman_region32_t pending_damage;
+
+	/* The seat's pointer sprite is drawn by the client, it lives on
+	 * its own plane so that it never damages the shadow surface. */
+	struct weston_plane cursor_plane;
+	struct weston_surface *cursor_surface;
+	struct rdp_cursor_cache_entry cursor_cache[RDP_CURSOR_CACHE_SIZE];
+	uint32_t cursor_serial;
+	int cursor_index;
+	int cursor_dirty;
+	int32_t input_x, input_y;
 
 	struct rdp_peers_item item;
 };
@@ -117,32 +173,55 @@ rdp_compositor_config_init(struct rdp_compositor_config *config) {
 	config->env_socket = 0;
 }
 
+static struct rdp_surface_bits *
+rdp_peer_frame_add_bits(RdpPeerContext *context, const pixman_box32_t *box,
+		UINT16 codecID)
+{
+	struct rdp_surface_bits *bits;
+	int size;
+
+	if (context->frame_bits_count == context->frame_bits_size) {
+		size = context->frame_bits_size ? context->frame_bits_size * 2 : 8;
+		bits = realloc(context->frame_bits, size * sizeof *bits);
+		if (!bits)
+			return NULL;
+		context->frame_bits = bits;
+		context->frame_bits_size = size;
+	}
+
+	bits = &context->frame_bits[context->frame_bits_count++];
+	memset(&bits->cmd, 0, sizeof bits->cmd);
+	bits->cmd.destLeft = box->x1;
+	bits->cmd.destTop = box->y1;
+	bits->cmd.destRight = box->x2;
+	bits->cmd.destBottom = box->y2;
+	bits->cmd.bpp = 32;
+	bits->cmd.codecID = codecID;
+	bits->cmd.width = box->x2 - box->x1;
+	bits->cmd.height = box->y2 - box->y1;
+	bits->offset = Stream_GetPosition(context->encode_stream);
+
+	return bits;
+}
+
 static void
-rdp_peer_refresh_rfx(pixman_region32_t *damage, pixman_image_t *image, freerdp_peer *peer)
+rdp_peer_encode_rfx(pixman_region32_t *damage, pixman_image_t *image, freerdp_peer *peer)
 {
 	int width, height, nrects, i;
 	pixman_box32_t *region, *rects;
 	uint32_t *ptr;
 	RFX_RECT *rfxRect;
-	rdpUpdate *update = peer->update;
-	SURFACE_BITS_COMMAND *cmd = &update->surface_bits_command;
+	struct rdp_surface_bits *bits;
 	RdpPeerContext *context = (RdpPeerContext *)peer->context;
 
-	Stream_Clear(context->encode_stream);
-	Stream_SetPosition(context->encode_stream, 0);
+	bits = rdp_peer_frame_add_bits(context, &damage->extents,
+			peer->settings->RemoteFxCodecId);
+	if (!bits)
+		return;
 
 	width = (damage->extents.x2 - damage->extents.x1);
 	height = (damage->extents.y2 - damage->extents.y1);
 
-	cmd->destLeft = damage->extents.x1;
-	cmd->destTop = damage->extents.y1;
-	cmd->destRight = damage->extents.x2;
-	cmd->destBottom = damage->extents.y2;
-	cmd->bpp = 32;
-	cmd->codecID = peer->settings->RemoteFxCodecId;
-	cmd->width = width;
-	cmd->height = height;
-
 	ptr = pixman_image_get_data(image) + damage->extents.x1 +
 				damage->extents.y1 * (pixman_image_get_stride(image) / sizeof(uint32_t));
 
@@ -164,46 +243,90 @@ rdp_peer_refresh_rfx(pixman_region32_t *damage, pixman_image_t *image, freerdp_p
 			pixman_image_get_stride(image)
 	);
 
-	cmd->bitmapDataLength = Stream_GetPosition(context->encode_stream);
-	cmd->bitmapData = Stream_Buffer(context->encode_stream);
+	bits->cmd.bitmapDataLength = Stream_GetPosition(context->encode_stream) - bits->offset;
+}
+
+static void
+rdp_peer_encode_nsc_box(const pixman_box32_t *box, pixman_image_t *image, freerdp_peer *peer)
+{
+	uint32_t *ptr;
+	struct rdp_surface_bits *bits;
+	RdpPeerContext *context = (RdpPeerContext *)peer->context;
 
-	update->SurfaceBits(update->context, cmd);
+	bits = rdp_peer_frame_add_bits(context, box, peer->settings->NSCodecId);
+	if (!bits)
+		return;
+
+	ptr = pixman_image_get_data(image) + box->x1 +
+				box->y1 * (pixman_image_get_stride(image) / sizeof(uint32_t));
+
+	nsc_compose_message(context->nsc_context, context->encode_stream, (BYTE *)ptr,
+			bits->cmd.width, bits->cmd.height,
+			pixman_image_get_stride(image));
+	bits->cmd.bitmapDataLength = Stream_GetPosition(context->encode_stream) - bits->offset;
 }
 
+static int
+box_cost(const pixman_box32_t *box)
+{
+	return (box->x2 - box->x1) * (box->y2 - box->y1) + RDP_NSC_COMMAND_COST;
+}
 
+/* NSCodec only knows about rectangles. Sending every damage rectangle
+ * on its own pays the command overhead for each of them, the bounding
+ * box pays for everything in between; pick whatever of that, or one
+ * command per band of the region, encodes the fewest pixels. */
 static void
-rdp_peer_refresh_nsc(pixman_region32_t *damage, pixman_image_t *image, freerdp_peer *peer)
+rdp_peer_encode_nsc(pixman_region32_t *damage, pixman_image_t *image, freerdp_peer *peer)
 {
-	int width, height;
-	uint32_t *ptr;
-	rdpUpdate *update = peer->update;
-	SURFACE_BITS_COMMAND *cmd = &update->surface_bits_command;
 	RdpPeerContext *context = (RdpPeerContext *)peer->context;
+	pixman_box32_t *rects, *bands, *boxes;
+	int nrects, nbands, nboxes, i;
+	int rectsCost, bandsCost, extentsCost;
+
+	rects = pixman_region32_rectangles(damage, &nrects);
+	bands = realloc(context->nsc_boxes, nrects * sizeof *bands);
+	if (!bands)
+		return;
+	context->nsc_boxes = bands;
 
-	Stream_Clear(context->encode_stream);
-	Stream_SetPosition(context->encode_stream, 0);
+	/* the rectangles of a pixman region are sorted in y-x bands,
+	 * each band shares y1 and y2 */
+	rectsCost = 0;
+	nbands = 0;
+	for (i = 0; i < nrects; i++) {
+		rectsCost += box_cost(&rects[i]);
 
-	width = (damage->extents.x2 - damage->extents.x1);
-	height = (damage->extents.y2 - damage->extents.y1);
+		if (nbands && bands[nbands - 1].y1 == rects[i].y1) {
+			if (rects[i].x1 < bands[nbands - 1].x1)
+				bands[nbands - 1].x1 = rects[i].x1;
+			if (rects[i].x2 > bands[nbands - 1].x2)
+				bands[nbands - 1].x2 = rects[i].x2;
+		} else {
+			bands[nbands++] = rects[i];
+		}
+	}
 
-	cmd->destLeft = damage->extents.x1;
-	cmd->destTop = damage->extents.y1;
-	cmd->destRight = damage->extents.x2;
-	cmd->destBottom = damage->extents.y2;
-	cmd->bpp = 32;
-	cmd->codecID = peer->settings->NSCodecId;
-	cmd->width = width;
-	cmd->height = height;
+	bandsCost = 0;
+	for (i = 0; i < nbands; i++)
+		bandsCost += box_cost(&bands[i]);
 
-	ptr = pixman_image_get_data(image) + damage->extents.x1 +
-				damage->extents.y1 * (pixman_image_get_stride(image) / sizeof(uint32_t));
+	extentsCost = box_cost(&damage->extents);
 
-	nsc_compose_message(context->nsc_context, context->encode_stream, (BYTE *)ptr,
-			cmd->width,	cmd->height,
-			pixman_image_get_stride(image));
-	cmd->bitmapDataLength = Stream_GetPosition(context->encode_stream);
-	cmd->bitmapData = Stream_Buffer(context->encode_stream);
-	update->SurfaceBits(update->context, cmd);
+	if (extentsCost <= rectsCost && extentsCost <= bandsCost) {
+		boxes = &damage->extents;
+		nboxes = 1;
+	} else if (bandsCost < rectsCost) {
+		boxes = bands;
+		nboxes = nbands;
+	} else {
+		boxes = rects;
+		nboxes = nrects;
+	}
+
+	context->frame_markers = 1;
+	for (i = 0; i < nboxes; i++)
+		rdp_peer_encode_nsc_box(&boxes[i], image, peer);
 }
 
 static void
@@ -276,6 +399,38 @@ rdp_peer_refresh_raw(pixman_region32_t *region, pixman_image_t *image, freerdp_p
 	update->SurfaceFrameMarker(peer->context, marker);
 }
 
+/* Sends peer the surface bits of the frame last encoded by encoder,
+ * which is either the peer itself or one using the same codec. */
+static void
+rdp_peer_send_frame(freerdp_peer *peer, RdpPeerContext *encoder)
+{
+	rdpUpdate *update = peer->update;
+	SURFACE_BITS_COMMAND *cmd = &update->surface_bits_command;
+	SURFACE_FRAME_MARKER *marker = &update->surface_frame_marker;
+	BYTE *data = Stream_Buffer(encoder->encode_stream);
+	int i;
+
+	if (!encoder->frame_bits_count)
+		return;
+
+	if (encoder->frame_markers) {
+		marker->frameId++;
+		marker->frameAction = SURFACECMD_FRAMEACTION_BEGIN;
+		update->SurfaceFrameMarker(peer->context, marker);
+	}
+
+	for (i = 0; i < encoder->frame_bits_count; i++) {
+		*cmd = encoder->frame_bits[i].cmd;
+		cmd->bitmapData = data + encoder->frame_bits[i].offset;
+		update->SurfaceBits(update->context, cmd);
+	}
+
+	if (encoder->frame_markers) {
+		marker->frameAction = SURFACECMD_FRAMEACTION_END;
+		update->SurfaceFrameMarker(peer->context, marker);
+	}
+}
+
 static void
 rdp_peer_refresh_region(pixman_region32_t *region, freerdp_peer *peer)
 {
@@ -283,12 +438,318 @@ rdp_peer_refresh_region(pixman_region32_t *region, freerdp_peer *peer)
 	struct rdp_output *output = context->rdpCompositor->output;
 	rdpSettings *settings = peer->settings;
 
-	if (settings->RemoteFxCodec)
-		rdp_peer_refresh_rfx(region, output->shadow_surface, peer);
-	else if (settings->NSCodec)
-		rdp_peer_refresh_nsc(region, output->shadow_surface, peer);
-	else
+	if (!settings->RemoteFxCodec && !settings->NSCodec) {
 		rdp_peer_refresh_raw(region, output->shadow_surface, peer);
+	} else {
+		Stream_SetPosition(context->encode_stream, 0);
+		context->frame_bits_count = 0;
+		context->frame_markers = 0;
+
+		if (settings->RemoteFxCodec)
+			rdp_peer_encode_rfx(region, output->shadow_surface, peer);
+		else
+			rdp_peer_encode_nsc(region, output->shadow_surface, peer);
+
+		rdp_peer_send_frame(peer, context);
+	}
+
+	/* whatever the peer was owed is covered now */
+	pixman_region32_subtract(&context->pending_damage,
+			&context->pending_damage, region);
+}
+
+static int
+rdp_peer_is_congested(freerdp_peer *peer)
+{
+	int queued;
+
+	if (ioctl(peer->sockfd, SIOCOUTQ, &queued) < 0)
+		return 0;
+
+	return queued > RDP_PEER_MAX_BACKLOG;
+}
+
+static int
+rdp_peer_has_backlog(struct rdp_peers_item *item)
+{
+	RdpPeerContext *context = (RdpPeerContext *)item->peer->context;
+
+	return (item->flags & RDP_PEER_ACTIVATED) &&
+		(item->flags & RDP_PEER_OUTPUT_ENABLED) &&
+		pixman_region32_not_empty(&context->pending_damage);
+}
+
+static int
+rdp_output_has_backlog(struct rdp_output *output)
+{
+	struct rdp_peers_item *item;
+
+	wl_list_for_each(item, &output->peers, link) {
+		if (rdp_peer_has_backlog(item))
+			return 1;
+	}
+
+	return 0;
+}
+
+/* Whether a peer that is owed damage can be sent it now. */
+static int
+rdp_output_backlog_drained(struct rdp_output *output)
+{
+	struct rdp_peers_item *item;
+
+	wl_list_for_each(item, &output->peers, link) {
+		if (rdp_peer_has_backlog(item) &&
+				!rdp_peer_is_congested(item->peer))
+			return 1;
+	}
+
+	return 0;
+}
+
+/* Whether a and b can be sent the same encoded surface bits. Raw
+ * updates aren't encoded, so there is nothing to share there. */
+static int
+rdp_peer_same_encoding(freerdp_peer *a, freerdp_peer *b)
+{
+	rdpSettings *sa = a->settings, *sb = b->settings;
+
+	if (sa->RemoteFxCodec || sb->RemoteFxCodec)
+		return sa->RemoteFxCodec && sb->RemoteFxCodec &&
+			sa->RemoteFxCodecId == sb->RemoteFxCodecId;
+
+	if (sa->NSCodec || sb->NSCodec)
+		return sa->NSCodec && sb->NSCodec &&
+			sa->NSCodecId == sb->NSCodecId;
+
+	return 0;
+}
+
+static struct rdp_peers_item *
+rdp_output_find_encoder(struct rdp_output *output, struct rdp_peers_item *peer)
+{
+	struct rdp_peers_item *item;
+
+	wl_list_for_each(item, &output->peers, link) {
+		if (item == peer)
+			break;
+		if ((item->flags & RDP_PEER_FRAME_ENCODED) &&
+				rdp_peer_same_encoding(item->peer, peer->peer))
+			return item;
+	}
+
+	return NULL;
+}
+
+static int
+rdp_peer_cursor_cache_size(freerdp_peer *peer)
+{
+	int size = peer->settings->PointerCacheSize;
+
+	return size < RDP_CURSOR_CACHE_SIZE ? size : RDP_CURSOR_CACHE_SIZE;
+}
+
+static struct weston_plane *
+rdp_peer_prepare_cursor_surface(freerdp_peer *peer, struct weston_surface *es)
+{
+	RdpPeerContext *context = (RdpPeerContext *)peer->context;
+	struct weston_pointer *pointer = context->item.seat.pointer;
+
+	if (!(context->item.flags & RDP_PEER_ACTIVATED) || !pointer)
+		return NULL;
+	if (pointer->sprite != es || context->cursor_surface)
+		return NULL;
+	if (rdp_peer_cursor_cache_size(peer) == 0)
+		return NULL;
+	if (!weston_surface_is_cursor_candidate(es, RDP_CURSOR_MAX_SIZE))
+		return NULL;
+
+	context->cursor_surface = es;
+
+	return &context->cursor_plane;
+}
+
+static void
+rdp_output_assign_planes(struct weston_output *output_base)
+{
+	struct rdp_output *output = container_of(output_base, struct rdp_output, base);
+	struct weston_compositor *ec = output->base.compositor;
+	struct weston_surface *es;
+	struct weston_plane *plane;
+	struct rdp_peers_item *item;
+	RdpPeerContext *context;
+
+	wl_list_for_each(item, &output->peers, link) {
+		context = (RdpPeerContext *)item->peer->context;
+		context->cursor_surface = NULL;
+	}
+
+	wl_list_for_each(es, &ec->surface_list, link) {
+		/* keep the buffer of a sprite that can be a cursor, so
+		 * the image can be sent again without waiting for a
+		 * commit, e.g. to a peer that just connected */
+		es->keep_buffer =
+			weston_surface_is_cursor_candidate(es, RDP_CURSOR_MAX_SIZE);
+
+		plane = NULL;
+		wl_list_for_each(item, &output->peers, link) {
+			plane = rdp_peer_prepare_cursor_surface(item->peer, es);
+			if (plane)
+				break;
+		}
+		if (plane == NULL)
+			plane = &ec->primary_plane;
+
+		weston_surface_move_to_plane(es, plane);
+	}
+}
+
+static void
+rdp_peer_send_new_cursor(freerdp_peer *peer, struct wl_buffer *buffer,
+			 int index, struct rdp_cursor_cache_entry *entry)
+{
+	rdpPointerUpdate *pointer = peer->update->pointer;
+	POINTER_NEW_UPDATE *pointerNew = &pointer->pointer_new;
+	POINTER_COLOR_UPDATE *color = &pointerNew->colorPtrAttr;
+	uint32_t xorMask[RDP_CURSOR_MAX_SIZE * RDP_CURSOR_MAX_SIZE];
+	BYTE andMask[RDP_CURSOR_MAX_SIZE * ((RDP_CURSOR_MAX_SIZE + 15) / 16) * 2];
+	int width = entry->width, height = entry->height;
+	int stride = wl_shm_buffer_get_stride(buffer);
+	int opaque = wl_shm_buffer_get_format(buffer) == WL_SHM_FORMAT_XRGB8888;
+	int andStride = ((width + 15) / 16) * 2;
+	uint8_t *src = wl_shm_buffer_get_data(buffer);
+	uint32_t *xorRow, pixel;
+	BYTE *andRow;
+	int x, y;
+
+	/* Both masks are stored bottom-up. The xor mask carries the
+	 * premultiplied image, the and mask is set where the screen
+	 * shows through. */
+	memset(andMask, 0, andStride * height);
+	for (y = 0; y < height; y++, src += stride) {
+		xorRow = xorMask + (height - 1 - y) * width;
+		andRow = andMask + (height - 1 - y) * andStride;
+		for (x = 0; x < width; x++) {
+			pixel = ((uint32_t *)src)[x];
+			if (opaque)
+				pixel |= 0xff000000;
+			else if ((pixel >> 24) == 0)
+				andRow[x / 8] |= 0x80 >> (x % 8);
+			xorRow[x] = pixel;
+		}
+	}
+
+	pointerNew->xorBpp = 32;
+	color->cacheIndex = index;
+	color->xPos = entry->hotspot_x;
+	color->yPos = entry->hotspot_y;
+	color->width = width;
+	color->height = height;
+	color->lengthXorMask = width * height * 4;
+	color->lengthAndMask = andStride * height;
+	color->xorMaskData = (BYTE *)xorMask;
+	color->andMaskData = andMask;
+	pointer->PointerNew(peer->context, pointerNew);
+}
+
+static void
+rdp_peer_update_cursor_image(freerdp_peer *peer, struct weston_surface *es)
+{
+	RdpPeerContext *context = (RdpPeerContext *)peer->context;
+	rdpPointerUpdate *pointer = peer->update->pointer;
+	struct weston_pointer *wpointer = context->item.seat.pointer;
+	struct wl_buffer *buffer = es->buffer_ref.buffer;
+	struct rdp_cursor_cache_entry *entry;
+	int width = wl_shm_buffer_get_width(buffer);
+	int height = wl_shm_buffer_get_height(buffer);
+	int hotspot_x, hotspot_y, i, index, size;
+	uint32_t hash;
+
+	hotspot_x = wpointer->hotspot_x;
+	hotspot_y = wpointer->hotspot_y;
+	if (hotspot_x < 0 || hotspot_x >= width)
+		hotspot_x = 0;
+	if (hotspot_y < 0 || hotspot_y >= height)
+		hotspot_y = 0;
+	hash = weston_cursor_hash(buffer, hotspot_x, hotspot_y);
+
+	/* Switching between cursors the client already has, such as the
+	 * arrow and the text beam, only costs a cached pointer update. */
+	size = rdp_peer_cursor_cache_size(peer);
+	index = 0;
+	for (i = 0; i < size; i++) {
+		entry = &context->cursor_cache[i];
+		if (entry->last_used && entry->hash == hash &&
+		    entry->width == width && entry->height == height &&
+		    entry->hotspot_x == hotspot_x &&
+		    entry->hotspot_y == hotspot_y) {
+			entry->last_used = ++context->cursor_serial;
+			if (context->cursor_index != i) {
+				pointer->pointer_cached.cacheIndex = i;
+				pointer->PointerCached(peer->context,
+						       &pointer->pointer_cached);
+				context->cursor_index = i;
+			}
+			return;
+		}
+
+		if (entry->last_used < context->cursor_cache[index].last_used)
+			index = i;
+	}
+
+	entry = &context->cursor_cache[index];
+	entry->hash = hash;
+	entry->width = width;
+	entry->height = height;
+	entry->hotspot_x = hotspot_x;
+	entry->hotspot_y = hotspot_y;
+	entry->last_used = ++context->cursor_serial;
+
+	rdp_peer_send_new_cursor(peer, buffer, index, entry);
+	context->cursor_index = index;
+}
+
+static void
+rdp_peer_update_cursor(freerdp_peer *peer)
+{
+	RdpPeerContext *context = (RdpPeerContext *)peer->context;
+	rdpPointerUpdate *pointer = peer->update->pointer;
+	struct weston_pointer *wpointer = context->item.seat.pointer;
+	struct weston_surface *es = context->cursor_surface;
+	int dirty, x, y;
+
+	dirty = context->cursor_dirty ||
+		pixman_region32_not_empty(&context->cursor_plane.damage);
+	pixman_region32_clear(&context->cursor_plane.damage);
+	context->cursor_dirty = 0;
+
+	if (es == NULL) {
+		if (context->cursor_index != RDP_CURSOR_HIDDEN) {
+			pointer->pointer_system.type = SYSPTR_NULL;
+			pointer->PointerSystem(peer->context,
+					       &pointer->pointer_system);
+			context->cursor_index = RDP_CURSOR_HIDDEN;
+		}
+		return;
+	}
+
+	/* The plane is damaged by motion as well as by new content, the
+	 * cache lookup takes care of the former. */
+	if (dirty || context->cursor_index == RDP_CURSOR_HIDDEN)
+		rdp_peer_update_cursor_image(peer, es);
+
+	/* The client moves its cursor itself, only tell it about
+	 * positions it didn't report, like a constrained pointer. */
+	x = wl_fixed_to_int(wpointer->x);
+	y = wl_fixed_to_int(wpointer->y);
+	if (x != context->input_x || y != context->input_y) {
+		pointer->pointer_position.xPos = x;
+		pointer->pointer_position.yPos = y;
+		pointer->PointerPosition(peer->context,
+					 &pointer->pointer_position);
+		context->input_x = x;
+		context->input_y = y;
+	}
 }
 
 static void
@@ -307,22 +768,65 @@ rdp_output_repaint(struct weston_output *output_base, pixman_region32_t *damage)
 {
 	struct rdp_output *output = container_of(output_base, struct rdp_output, base);
 	struct weston_compositor *ec = output->base.compositor;
-	struct rdp_peers_item *outputPeer;
+	struct rdp_peers_item *outputPeer, *encoder;
+	RdpPeerContext *context;
+	int shared;
 
 	pixman_renderer_output_set_buffer(output_base, output->shadow_surface);
 	ec->renderer->repaint_output(&output->base, damage);
 
+	wl_list_for_each(outputPeer, &output->peers, link)
+		outputPeer->flags &= ~RDP_PEER_FRAME_ENCODED;
+
 	wl_list_for_each(outputPeer, &output->peers, link) {
-		if ((outputPeer->flags & RDP_PEER_ACTIVATED) &&
-				(outputPeer->flags & RDP_PEER_OUTPUT_ENABLED))
+		if (!(outputPeer->flags & RDP_PEER_ACTIVATED))
+			continue;
+
+		context = (RdpPeerContext *)outputPeer->peer->context;
+		if (outputPeer->flags & RDP_PEER_OUTPUT_ENABLED)
+			pixman_region32_union(&context->pending_damage,
+					&context->pending_damage, damage);
+
+		/* A peer that is behind keeps collecting damage and gets
+		 * it in one go once its socket drains. A moving cursor
+		 * doesn't damage the primary plane at all. */
+		if ((outputPeer->flags & RDP_PEER_OUTPUT_ENABLED) &&
+				pixman_region32_not_empty(&context->pending_damage) &&
+				!rdp_peer_is_congested(outputPeer->peer))
 		{
-			rdp_peer_refresh_region(damage, outputPeer->peer);
+			/* encode the damage once per codec, peers
+			 * sharing it get a copy of the first one's
+			 * surface bits */
+			shared = pixman_region32_equal(&context->pending_damage, damage);
+			encoder = NULL;
+			if (shared)
+				encoder = rdp_output_find_encoder(output, outputPeer);
+			if (encoder) {
+				rdp_peer_send_frame(outputPeer->peer,
+					(RdpPeerContext *)encoder->peer->context);
+			} else {
+				rdp_peer_refresh_region(&context->pending_damage,
+						outputPeer->peer);
+				if (shared)
+					outputPeer->flags |= RDP_PEER_FRAME_ENCODED;
+			}
+			pixman_region32_clear(&context->pending_damage);
 		}
+
+		rdp_peer_update_cursor(outputPeer->peer);
 	}
 
 	pixman_region32_subtract(&ec->primary_plane.damage,
 				 &ec->primary_plane.damage, damage);
 
+	/* poll for peers that are behind to catch up, unless that is
+	 * already going on */
+	if (output->backlog_delay == 0 && rdp_output_has_backlog(output)) {
+		output->backlog_delay = RDP_BACKLOG_MIN_DELAY;
+		wl_event_source_timer_update(output->backlog_timer,
+					     output->backlog_delay);
+	}
+
 	wl_event_source_timer_update(output->finish_frame_timer, 16);
 }
 
@@ -332,6 +836,7 @@ rdp_output_destroy(struct weston_output *output_base)
 	struct rdp_output *output = (struct rdp_output *)output_base;
 
 	wl_event_source_remove(output->finish_frame_timer);
+	wl_event_source_remove(output->backlog_timer);
 	free(output);
 }
 
@@ -343,6 +848,34 @@ finish_frame_handler(void *data)
 	return 1;
 }
 
+static int
+backlog_handler(void *data)
+{
+	struct rdp_output *output = data;
+
+	if (!rdp_output_has_backlog(output)) {
+		output->backlog_delay = 0;
+		return 1;
+	}
+
+	/* repaint once a peer has drained, the repaint sends it what it
+	 * is owed and starts polling again if needed; until then check
+	 * less and less often */
+	if (rdp_output_backlog_drained(output)) {
+		output->backlog_delay = 0;
+		weston_output_schedule_repaint(&output->base);
+		return 1;
+	}
+
+	output->backlog_delay *= 2;
+	if (output->backlog_delay > RDP_BACKLOG_MAX_DELAY)
+		output->backlog_delay = RDP_BACKLOG_MAX_DELAY;
+	wl_event_source_timer_update(output->backlog_timer,
+				     output->backlog_delay);
+
+	return 1;
+}
+
 
 static struct weston_mode *
 find_matching_mode(struct weston_output *output, struct weston_mode *target) {
@@ -489,12 +1022,14 @@ rdp_compositor_create_output(struct rdp_compositor *c, int width, int height,
 
 	loop = wl_display_get_event_loop(c->base.wl_display);
 	output->finish_frame_timer = wl_event_loop_add_timer(loop, finish_frame_handler, output);
+	output->backlog_timer = wl_event_loop_add_timer(loop, backlog_handler, output);
+	output->backlog_delay = 0;
 
 	output->base.origin = output->base.current;
 	output->base.start_repaint_loop = rdp_output_start_repaint_loop;
 	output->base.repaint = rdp_output_repaint;
 	output->base.destroy = rdp_output_destroy;
-	output->base.assign_planes = NULL;
+	output->base.assign_planes = rdp_output_assign_planes;
 	output->base.set_backlight = NULL;
 	output->base.set_dpms = NULL;
 	output->base.switch_mode = rdp_switch_mode;
@@ -584,11 +1119,19 @@ rdp_peer_context_new(freerdp_peer* client, RdpPeerContext* context)
 	nsc_context_set_pixel_format(context->nsc_context, RDP_PIXEL_FORMAT_B8G8R8A8);
 
 	context->encode_stream = Stream_New(NULL, 65536);
+
+	pixman_region32_init(&context->pending_damage);
+
+	weston_plane_init(&context->cursor_plane, 0, 0);
+	wl_list_init(&context->cursor_plane.link);
+	context->cursor_index = RDP_CURSOR_HIDDEN;
 }
 
 static void
 rdp_peer_context_free(freerdp_peer* client, RdpPeerContext* context)
 {
+	struct weston_compositor *ec;
+	struct weston_surface *es;
 	int i;
 	if(!context)
 		return;
@@ -599,12 +1142,23 @@ rdp_peer_context_free(freerdp_peer* client, RdpPeerContext* context)
 			wl_event_source_remove(context->events[i]);
 	}
 
+	ec = &context->rdpCompositor->base;
+	wl_list_for_each(es, &ec->surface_list, link) {
+		if (es->plane == &context->cursor_plane)
+			weston_surface_move_to_plane(es, &ec->primary_plane);
+	}
+	wl_list_remove(&context->cursor_plane.link);
+	weston_plane_release(&context->cursor_plane);
+
 	if(context->item.flags & RDP_PEER_ACTIVATED)
 		weston_seat_release(&context->item.seat);
 	Stream_Free(context->encode_stream, TRUE);
 	nsc_context_free(context->nsc_context);
 	rfx_context_free(context->rfx_context);
 	free(context->rfx_rects);
+	free(context->nsc_boxes);
+	free(context->frame_bits);
+	pixman_region32_fini(&context->pending_damage);
 }
 
 
@@ -728,7 +1282,9 @@ xf_peer_post_connect(freerdp_peer* client)
 
 	peerCtx->item.flags |= RDP_PEER_ACTIVATED;
 
-	/* disable pointer on the client side */
+	/* hide the client side pointer until rdp_output_repaint() sends
+	 * the sprite, clients that can't take pointer updates keep seeing
+	 * it composited into the frame buffer */
 	pointer = client->update->pointer;
 	pointer->pointer_system.type = SYSPTR_NULL;
 	pointer->PointerSystem(client->context, &pointer->pointer_system);
@@ -752,6 +1308,12 @@ xf_peer_activate(freerdp_peer *client)
 {
 	RdpPeerContext *context = (RdpPeerContext *)client->context;
 	rfx_context_reset(context->rfx_context);
+
+	/* the client starts over with an empty pointer cache */
+	memset(context->cursor_cache, 0, sizeof context->cursor_cache);
+	context->cursor_index = RDP_CURSOR_HIDDEN;
+	context->cursor_dirty = 1;
+	weston_output_schedule_repaint(&context->rdpCompositor->output->base);
 	return TRUE;
 }
 
@@ -767,6 +1329,8 @@ xf_mouseEvent(rdpInput *input, UINT16 flags, UINT16 x, UINT16 y) {
 		if(x < output->base.width && y < output->base.height) {
 			wl_x = wl_fixed_from_int((int)x);
 			wl_y = wl_fixed_from_int((int)y);
+			peerContext->input_x = x;
+			peerContext->input_y = y;
 			notify_motion_absolute(&peerContext->item.seat, weston_compositor_get_time(),
 					wl_x, wl_y);
 		}
@@ -812,6 +1376,8 @@ xf_extendedMouseEvent(rdpInput *input, UINT16 flags, UINT16 x, UINT16 y) {
 	if(x < output->base.width && y < output->base.height) {
 		wl_x = wl_fixed_from_int((int)x);
 		wl_y = wl_fixed_from_int((int)y);
+		peerContext->input_x = x;
+		peerContext->input_y = y;
 		notify_motion_absolute(&peerContext->item.seat, weston_compositor_get_time(),
 				wl_x, wl_y);
 	}
@@ -922,6 +1488,7 @@ rdp_peer_init(freerdp_peer *client, struct rdp_compositor *c)
 
 	peerCtx = (RdpPeerContext *) client->context;
 	peerCtx->rdpCompositor = c;
+	weston_compositor_stack_plane(&c->base, &peerCtx->cursor_plane, NULL);
 
 	settings = client->settings;
 	settings->RdpKeyFile = c->rdp_key;
@@ -202,6 +202,8 @@ rpi_flippipe_init(struct rpi_flippipe *flippipe, struct rpi_output *output)
 		return -1;
 	}
 
+	wl_event_source_set_priority(flippipe->source, WL_EVENT_PRIORITY_HIGH);
+
 	return 0;
 }
 
@@ -777,6 +777,9 @@ wayland_compositor_create(struct wl_display *display,
 				     wayland_compositor_handle_event, c);
 	if (c->parent.wl_source == NULL)
 		goto err_gl;
+	/* Carries both input and frame callbacks from the parent. */
+	wl_event_source_set_priority(c->parent.wl_source,
+				     WL_EVENT_PRIORITY_HIGH);
 
 	wl_event_source_check(c->parent.wl_source);
 
@@ -31,15 +31,21 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
 #include <sys/time.h>
 #include <sys/shm.h>
 #include <linux/input.h>
 
 #include <xcb/xcb.h>
 #include <xcb/shm.h>
+#include <xcb/render.h>
 #ifdef HAVE_XCB_XKB
 #include <xcb/xkb.h>
 #endif
+#ifdef HAVE_XCB_PRESENT
+#include <xcb/present.h>
+#include <xcb/xfixes.h>
+#endif
 
 #include <X11/Xlib.h>
 #include <X11/Xlib-xcb.h>
@@ -54,6 +60,9 @@
 
 #define DEFAULT_AXIS_STEP_DISTANCE wl_fixed_from_int(10)
 
+/* largest sprite we hand to the host X server as a cursor */
+#define MAX_CURSOR_SIZE 128
+
 static int option_width;
 static int option_height;
 static int option_count;
@@ -66,11 +75,21 @@ struct x11_compositor {
 	xcb_screen_t		*screen;
 	xcb_cursor_t		 null_cursor;
 	struct wl_array		 keys;
+
+	/* The pointer sprite is shown as the host cursor of the output
+	 * windows, so that the host server moves it. */
+	xcb_render_pictformat_t	 cursor_format;
+	struct weston_plane	 cursor_plane;
+	struct weston_surface	*cursor_surface;
+	xcb_cursor_t		 cursor;
+	uint32_t		 cursor_hash;
 	struct wl_event_source	*xcb_source;
 	struct xkb_keymap	*xkb_keymap;
 	unsigned int		 has_xkb;
 	uint8_t			 xkb_event_base;
 	int			 use_pixman;
+	unsigned int		 has_present;
+	uint8_t			 present_opcode;
 
 	int			 has_net_wm_state_fullscreen;
 
@@ -113,6 +132,17 @@ struct x11_output {
 	void		       *buf;
 	uint8_t			depth;
 	int32_t                 scale;
+	xcb_cursor_t		cursor;
+
+#ifdef HAVE_XCB_PRESENT
+	/* with Present, frames finish on CompleteNotify rather than on
+	 * finish_frame_timer */
+	xcb_present_event_t	present_eid;
+	uint32_t		present_serial;
+	uint64_t		present_msc;
+	xcb_pixmap_t		present_pixmap;
+	xcb_xfixes_region_t	present_region;
+#endif
 };
 
 static struct xkb_keymap *
@@ -324,39 +354,181 @@ x11_output_start_repaint_loop(struct weston_output *output)
 	weston_output_finish_frame(output, msec);
 }
 
+static int
+x11_compositor_cursor_plane_usable(struct x11_compositor *c)
+{
+	struct x11_output *output;
+
+	if (!c->cursor_format || !c->core_seat.pointer)
+		return 0;
+
+	/* the host cursor isn't transformed along with the output */
+	wl_list_for_each(output, &c->base.output_list, base.link) {
+		if (output->base.transform != WL_OUTPUT_TRANSFORM_NORMAL ||
+		    output->base.scale != 1 || output->scale != 1)
+			return 0;
+	}
+
+	return 1;
+}
+
+static struct weston_plane *
+x11_compositor_prepare_cursor_surface(struct x11_compositor *c,
+				      struct weston_surface *es)
+{
+	if (c->cursor_surface)
+		return NULL;
+	if (c->core_seat.pointer->sprite != es)
+		return NULL;
+	if (!weston_surface_is_cursor_candidate(es, MAX_CURSOR_SIZE))
+		return NULL;
+
+	c->cursor_surface = es;
+
+	return &c->cursor_plane;
+}
+
 static void
-x11_output_repaint_gl(struct weston_output *output_base,
-		      pixman_region32_t *damage)
+x11_output_assign_planes(struct weston_output *output_base)
 {
-	struct x11_output *output = (struct x11_output *)output_base;
-	struct weston_compositor *ec = output->base.compositor;
+	struct x11_compositor *c =
+		(struct x11_compositor *)output_base->compositor;
+	struct weston_surface *es;
+	struct weston_plane *plane;
+	int usable;
+
+	usable = x11_compositor_cursor_plane_usable(c);
+	c->cursor_surface = NULL;
+
+	wl_list_for_each(es, &c->base.surface_list, link) {
+		/* keep the sprite's buffer, so the cursor can be
+		 * re-created without waiting for a commit */
+		es->keep_buffer =
+			weston_surface_is_cursor_candidate(es, MAX_CURSOR_SIZE);
+
+		plane = NULL;
+		if (usable)
+			plane = x11_compositor_prepare_cursor_surface(c, es);
+		if (plane == NULL)
+			plane = &c->base.primary_plane;
+
+		weston_surface_move_to_plane(es, plane);
+	}
+}
 
-	ec->renderer->repaint_output(output_base, damage);
+static xcb_cursor_t
+x11_compositor_create_cursor(struct x11_compositor *c,
+			     struct wl_buffer *buffer,
+			     int hotspot_x, int hotspot_y)
+{
+	int width = wl_shm_buffer_get_width(buffer);
+	int height = wl_shm_buffer_get_height(buffer);
+	int stride = wl_shm_buffer_get_stride(buffer);
+	int opaque = wl_shm_buffer_get_format(buffer) == WL_SHM_FORMAT_XRGB8888;
+	uint8_t *src = wl_shm_buffer_get_data(buffer);
+	uint32_t *data, *d;
+	xcb_pixmap_t pixmap;
+	xcb_gc_t gc;
+	xcb_render_picture_t picture;
+	xcb_cursor_t cursor;
+	int x, y;
+
+	data = malloc(width * height * 4);
+	if (data == NULL)
+		return XCB_NONE;
+
+	for (y = 0, d = data; y < height; y++, src += stride, d += width) {
+		memcpy(d, src, width * 4);
+		if (opaque)
+			for (x = 0; x < width; x++)
+				d[x] |= 0xff000000;
+	}
 
-	pixman_region32_subtract(&ec->primary_plane.damage,
-				 &ec->primary_plane.damage, damage);
+	pixmap = xcb_generate_id(c->conn);
+	xcb_create_pixmap(c->conn, 32, pixmap, c->screen->root, width, height);
+	gc = xcb_generate_id(c->conn);
+	xcb_create_gc(c->conn, gc, pixmap, 0, NULL);
+	xcb_put_image(c->conn, XCB_IMAGE_FORMAT_Z_PIXMAP, pixmap, gc,
+		      width, height, 0, 0, 0, 32,
+		      width * height * 4, (uint8_t *) data);
+
+	picture = xcb_generate_id(c->conn);
+	xcb_render_create_picture(c->conn, picture, pixmap,
+				  c->cursor_format, 0, NULL);
+	cursor = xcb_generate_id(c->conn);
+	xcb_render_create_cursor(c->conn, cursor, picture,
+				 hotspot_x, hotspot_y);
+
+	xcb_render_free_picture(c->conn, picture);
+	xcb_free_gc(c->conn, gc);
+	xcb_free_pixmap(c->conn, pixmap);
+	free(data);
 
-	wl_event_source_timer_update(output->finish_frame_timer, 10);
+	return cursor;
 }
 
+/* Installs the cursor for the current sprite on the output window,
+ * re-creating it only when the sprite image or hotspot changed. The
+ * host server moves it, so pointer motion costs no image transfer. */
 static void
-set_clip_for_output(struct weston_output *output_base, pixman_region32_t *region)
+x11_output_set_cursor(struct x11_output *output)
+{
+	struct x11_compositor *c =
+		(struct x11_compositor *)output->base.compositor;
+	struct weston_surface *es = c->cursor_surface;
+	struct weston_pointer *pointer = c->core_seat.pointer;
+	xcb_cursor_t cursor;
+	uint32_t hash;
+	int hotspot_x, hotspot_y;
+
+	/* the plane is damaged by motion too, the hash tells new images
+	 * apart from those */
+	if (pixman_region32_not_empty(&c->cursor_plane.damage) && es) {
+		hotspot_x = pointer->hotspot_x;
+		hotspot_y = pointer->hotspot_y;
+		if (hotspot_x < 0 || hotspot_x >= es->geometry.width)
+			hotspot_x = 0;
+		if (hotspot_y < 0 || hotspot_y >= es->geometry.height)
+			hotspot_y = 0;
+
+		hash = weston_cursor_hash(es->buffer_ref.buffer,
+					  hotspot_x, hotspot_y);
+		if (c->cursor == XCB_NONE || hash != c->cursor_hash) {
+			cursor = x11_compositor_create_cursor(c,
+							      es->buffer_ref.buffer,
+							      hotspot_x, hotspot_y);
+			if (c->cursor != XCB_NONE)
+				xcb_free_cursor(c->conn, c->cursor);
+			c->cursor = cursor;
+			c->cursor_hash = hash;
+		}
+	}
+	pixman_region32_clear(&c->cursor_plane.damage);
+
+	cursor = es && c->cursor != XCB_NONE ? c->cursor : c->null_cursor;
+	if (output->cursor != cursor) {
+		xcb_change_window_attributes(c->conn, output->window,
+					     XCB_CW_CURSOR, &cursor);
+		output->cursor = cursor;
+	}
+}
+
+/* Returns the rectangles of region in window coordinates, the caller
+ * frees them. */
+static xcb_rectangle_t *
+region_to_output_rects(struct weston_output *output_base,
+		       pixman_region32_t *region, int *nrects_out)
 {
-	struct x11_output *output = (struct x11_output *)output_base;
-	struct weston_compositor *ec = output->base.compositor;
-	struct x11_compositor *c = (struct x11_compositor *)ec;
 	pixman_box32_t *rects;
 	xcb_rectangle_t *output_rects;
 	pixman_box32_t rect, transformed_rect;
-	xcb_void_cookie_t cookie;
 	int width, height, nrects, i;
-	xcb_generic_error_t *err;
 
 	rects = pixman_region32_rectangles(region, &nrects);
 	output_rects = calloc(nrects, sizeof(xcb_rectangle_t));
 
 	if (output_rects == NULL)
-		return;
+		return NULL;
 
 	width = output_base->width;
 	height = output_base->height;
@@ -431,6 +603,93 @@ set_clip_for_output(struct weston_output *output_base, pixman_region32_t *region
 		output_rects[i].height = transformed_rect.y2 - transformed_rect.y1;
 	}
 
+	*nrects_out = nrects;
+
+	return output_rects;
+}
+
+#ifdef HAVE_XCB_PRESENT
+static void
+x11_output_present_shm(struct x11_output *output, pixman_region32_t *damage)
+{
+	struct x11_compositor *c =
+		(struct x11_compositor *)output->base.compositor;
+	xcb_xfixes_region_t update = XCB_NONE;
+	xcb_rectangle_t *rects;
+	int nrects;
+
+	/* without the damage rectangles the whole pixmap is copied */
+	rects = region_to_output_rects(&output->base, damage, &nrects);
+	if (rects) {
+		xcb_xfixes_set_region(c->conn, output->present_region,
+				      nrects, rects);
+		update = output->present_region;
+		free(rects);
+	}
+
+	xcb_present_pixmap(c->conn, output->window, output->present_pixmap,
+			   ++output->present_serial,
+			   XCB_NONE, update, 0, 0,
+			   XCB_NONE, XCB_NONE, XCB_NONE,
+			   XCB_PRESENT_OPTION_NONE, 0, 0, 0, 0, NULL);
+}
+#endif
+
+/* Arranges for weston_output_finish_frame() to be called once the
+ * frame is shown. With Present that is the CompleteNotify for the next
+ * vblank of the host; otherwise a timer approximates it. */
+static void
+x11_output_schedule_finish(struct x11_output *output)
+{
+#ifdef HAVE_XCB_PRESENT
+	struct x11_compositor *c =
+		(struct x11_compositor *)output->base.compositor;
+
+	if (c->has_present) {
+		xcb_present_notify_msc(c->conn, output->window,
+				       ++output->present_serial,
+				       output->present_msc + 1, 0, 0);
+		return;
+	}
+#endif
+
+	wl_event_source_timer_update(output->finish_frame_timer, 10);
+}
+
+static void
+x11_output_repaint_gl(struct weston_output *output_base,
+		      pixman_region32_t *damage)
+{
+	struct x11_output *output = (struct x11_output *)output_base;
+	struct weston_compositor *ec = output->base.compositor;
+
+	x11_output_set_cursor(output);
+
+	/* nothing to swap when only the cursor moved */
+	if (pixman_region32_not_empty(damage))
+		ec->renderer->repaint_output(output_base, damage);
+
+	pixman_region32_subtract(&ec->primary_plane.damage,
+				 &ec->primary_plane.damage, damage);
+
+	x11_output_schedule_finish(output);
+}
+
+static void
+set_clip_for_output(struct weston_output *output_base, pixman_region32_t *region)
+{
+	struct x11_output *output = (struct x11_output *)output_base;
+	struct weston_compositor *ec = output->base.compositor;
+	struct x11_compositor *c = (struct x11_compositor *)ec;
+	xcb_rectangle_t *output_rects;
+	xcb_void_cookie_t cookie;
+	xcb_generic_error_t *err;
+	int nrects;
+
+	output_rects = region_to_output_rects(output_base, region, &nrects);
+	if (output_rects == NULL)
+		return;
+
 	cookie = xcb_set_clip_rectangles_checked(c->conn, XCB_CLIP_ORDERING_UNSORTED,
 					output->gc,
 					0, 0, nrects,
@@ -454,11 +713,27 @@ x11_output_repaint_shm(struct weston_output *output_base,
 	xcb_void_cookie_t cookie;
 	xcb_generic_error_t *err;
 
+	x11_output_set_cursor(output);
+
+	if (!pixman_region32_not_empty(damage)) {
+		x11_output_schedule_finish(output);
+		return;
+	}
+
 	pixman_renderer_output_set_buffer(output_base, output->hw_surface);
 	ec->renderer->repaint_output(output_base, damage);
 
 	pixman_region32_subtract(&ec->primary_plane.damage,
 				 &ec->primary_plane.damage, damage);
+
+#ifdef HAVE_XCB_PRESENT
+	if (c->has_present) {
+		/* completes with a CompleteNotify */
+		x11_output_present_shm(output, damage);
+		return;
+	}
+#endif
+
 	set_clip_for_output(output_base, damage);
 	cookie = xcb_shm_put_image_checked(c->conn, output->window, output->gc,
 					pixman_image_get_width(output->hw_surface),
@@ -474,7 +749,7 @@ x11_output_repaint_shm(struct weston_output *output_base,
 		free(err);
 	}
 
-	wl_event_source_timer_update(output->finish_frame_timer, 10);
+	x11_output_schedule_finish(output);
 }
 
 static int
@@ -505,6 +780,48 @@ x11_output_deinit_shm(struct x11_compositor *c, struct x11_output *output)
 	shmdt(output->buf);
 }
 
+#ifdef HAVE_XCB_PRESENT
+static void
+x11_output_init_present(struct x11_compositor *c, struct x11_output *output,
+			int width, int height)
+{
+	output->present_eid = xcb_generate_id(c->conn);
+	xcb_present_select_input(c->conn, output->present_eid, output->window,
+				 XCB_PRESENT_EVENT_MASK_COMPLETE_NOTIFY);
+
+	if (!c->use_pixman)
+		return;
+
+	output->present_pixmap = xcb_generate_id(c->conn);
+	xcb_shm_create_pixmap(c->conn, output->present_pixmap, output->window,
+			      width, height, output->depth,
+			      output->segment, 0);
+	output->present_region = xcb_generate_id(c->conn);
+	xcb_xfixes_create_region(c->conn, output->present_region, 0, NULL);
+}
+
+static uint32_t
+present_ust_to_msec(uint64_t ust)
+{
+	struct timeval tv;
+	struct timespec ts;
+	uint64_t now;
+	uint32_t msec;
+
+	/* UST is CLOCK_MONOTONIC microseconds, frame times are in the
+	 * gettimeofday() milliseconds weston uses everywhere else */
+	gettimeofday(&tv, NULL);
+	msec = tv.tv_sec * 1000 + tv.tv_usec / 1000;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	now = (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	if (ust && ust <= now)
+		msec -= (now - ust) / 1000;
+
+	return msec;
+}
+#endif
+
 static void
 x11_output_destroy(struct weston_output *output_base)
 {
@@ -515,6 +832,14 @@ x11_output_destroy(struct weston_output *output_base)
 	wl_list_remove(&output->base.link);
 	wl_event_source_remove(output->finish_frame_timer);
 
+#ifdef HAVE_XCB_PRESENT
+	if (output->present_pixmap)
+		xcb_free_pixmap(compositor->conn, output->present_pixmap);
+	if (output->present_region)
+		xcb_xfixes_destroy_region(compositor->conn,
+					  output->present_region);
+#endif
+
 	if (compositor->use_pixman) {
 		pixman_renderer_output_destroy(output_base);
 		x11_output_deinit_shm(compositor, output);
@@ -830,6 +1155,7 @@ x11_compositor_create_output(struct x11_compositor *c, int x, int y,
 	wl_list_insert(&output->base.mode_list, &output->mode.link);
 
 	values[1] = c->null_cursor;
+	output->cursor = c->null_cursor;
 	output->window = xcb_generate_id(c->conn);
 	iter = xcb_setup_roots_iterator(xcb_get_setup(c->conn));
 	xcb_create_window(c->conn,
@@ -889,7 +1215,7 @@ x11_compositor_create_output(struct x11_compositor *c, int x, int y,
 	else
 		output->base.repaint = x11_output_repaint_gl;
 	output->base.destroy = x11_output_destroy;
-	output->base.assign_planes = NULL;
+	output->base.assign_planes = x11_output_assign_planes;
 	output->base.set_backlight = NULL;
 	output->base.set_dpms = NULL;
 	output->base.switch_mode = NULL;
@@ -912,6 +1238,12 @@ x11_compositor_create_output(struct x11_compositor *c, int x, int y,
 			return NULL;
 	}
 
+#ifdef HAVE_XCB_PRESENT
+	if (c->has_present)
+		x11_output_init_present(c, output,
+					output_width, output_height);
+#endif
+
 	loop = wl_display_get_event_loop(c->base.wl_display);
 	output->finish_frame_timer =
 		wl_event_loop_add_timer(loop, finish_frame_handler, output);
@@ -937,6 +1269,32 @@ x11_compositor_find_output(struct x11_compositor *c, xcb_window_t window)
 	return NULL;
 }
 
+#ifdef HAVE_XCB_PRESENT
+static void
+x11_compositor_handle_present_event(struct x11_compositor *c,
+				    xcb_ge_generic_event_t *ge)
+{
+	xcb_present_complete_notify_event_t *complete;
+	struct x11_output *output;
+
+	if (ge->extension != c->present_opcode ||
+	    ge->event_type != XCB_PRESENT_COMPLETE_NOTIFY)
+		return;
+
+	complete = (xcb_present_complete_notify_event_t *) ge;
+	output = x11_compositor_find_output(c, complete->window);
+	if (output == NULL)
+		return;
+
+	output->present_msc = complete->msc;
+	if (complete->serial != output->present_serial)
+		return;
+
+	weston_output_finish_frame(&output->base,
+				   present_ust_to_msec(complete->ust));
+}
+#endif
+
 #ifdef HAVE_XCB_XKB
 static void
 update_xkb_state(struct x11_compositor *c, xcb_xkb_state_notify_event_t *state)
@@ -1341,6 +1699,12 @@ x11_compositor_handle_event(int fd, uint32_t mask, void *data)
 			break;
 		}
 
+#ifdef HAVE_XCB_PRESENT
+		if (c->has_present && response_type == XCB_GE_GENERIC)
+			x11_compositor_handle_present_event(c,
+					(xcb_ge_generic_event_t *) event);
+#endif
+
 #ifdef HAVE_XCB_XKB
 		if (c->has_xkb &&
 		    response_type == c->xkb_event_base) {
@@ -1430,6 +1794,114 @@ x11_compositor_get_resources(struct x11_compositor *c)
 	xcb_free_pixmap(c->conn, pixmap);
 }
 
+static void
+x11_compositor_setup_present(struct x11_compositor *c)
+{
+#ifndef HAVE_XCB_PRESENT
+	weston_log("XCB-Present not available during build\n");
+	c->has_present = 0;
+	return;
+#else
+	const xcb_query_extension_reply_t *ext;
+	xcb_present_query_version_reply_t *present_reply;
+	xcb_xfixes_query_version_reply_t *xfixes_reply;
+	xcb_shm_query_version_reply_t *shm_reply;
+	int ok;
+
+	c->has_present = 0;
+
+	ext = xcb_get_extension_data(c->conn, &xcb_present_id);
+	if (!ext || !ext->present) {
+		weston_log("Present extension not available on host X11 server, "
+			   "using a timer for frame pacing\n");
+		return;
+	}
+	c->present_opcode = ext->major_opcode;
+
+	present_reply = xcb_present_query_version_reply(c->conn,
+			xcb_present_query_version(c->conn, 1, 0), NULL);
+	if (present_reply == NULL)
+		return;
+	free(present_reply);
+
+	/* The pixman path presents its shm image as a pixmap, and
+	 * passes the damage as an XFixes region. */
+	if (c->use_pixman) {
+		ext = xcb_get_extension_data(c->conn, &xcb_xfixes_id);
+		if (!ext || !ext->present)
+			return;
+
+		xfixes_reply = xcb_xfixes_query_version_reply(c->conn,
+				xcb_xfixes_query_version(c->conn, 2, 0), NULL);
+		ok = xfixes_reply && xfixes_reply->major_version >= 2;
+		free(xfixes_reply);
+		if (!ok)
+			return;
+
+		shm_reply = xcb_shm_query_version_reply(c->conn,
+				xcb_shm_query_version(c->conn), NULL);
+		ok = shm_reply && shm_reply->shared_pixmaps;
+		free(shm_reply);
+		if (!ok)
+			return;
+	}
+
+	weston_log("Using the Present extension for frame timing\n");
+	c->has_present = 1;
+#endif
+}
+
+static void
+x11_compositor_init_render_cursor(struct x11_compositor *c)
+{
+	const xcb_query_extension_reply_t *ext;
+	xcb_render_query_version_reply_t *version;
+	xcb_render_query_pict_formats_reply_t *formats;
+	xcb_render_pictforminfo_iterator_t i;
+	xcb_render_pictforminfo_t *f;
+
+	c->cursor_format = 0;
+
+	ext = xcb_get_extension_data(c->conn, &xcb_render_id);
+	if (!ext || !ext->present) {
+		weston_log("RENDER extension not available on host X11 server, "
+			   "drawing the cursor ourselves\n");
+		return;
+	}
+
+	/* ARGB cursors came with RENDER 0.5 */
+	version = xcb_render_query_version_reply(c->conn,
+			xcb_render_query_version(c->conn, 0, 5), NULL);
+	if (version == NULL)
+		return;
+	if (version->major_version == 0 && version->minor_version < 5) {
+		free(version);
+		return;
+	}
+	free(version);
+
+	formats = xcb_render_query_pict_formats_reply(c->conn,
+			xcb_render_query_pict_formats(c->conn), NULL);
+	if (formats == NULL)
+		return;
+
+	for (i = xcb_render_query_pict_formats_formats_iterator(formats);
+	     i.rem; xcb_render_pictforminfo_next(&i)) {
+		f = i.data;
+		if (f->type == XCB_RENDER_PICT_TYPE_DIRECT &&
+		    f->depth == 32 &&
+		    f->direct.alpha_shift == 24 && f->direct.alpha_mask == 0xff &&
+		    f->direct.red_shift == 16 && f->direct.red_mask == 0xff &&
+		    f->direct.green_shift == 8 && f->direct.green_mask == 0xff &&
+		    f->direct.blue_shift == 0 && f->direct.blue_mask == 0xff) {
+			c->cursor_format = f->id;
+			break;
+		}
+	}
+
+	free(formats);
+}
+
 static void
 x11_compositor_get_wm_info(struct x11_compositor *c)
 {
@@ -1468,6 +1940,10 @@ x11_destroy(struct weston_compositor *ec)
 
 	weston_compositor_shutdown(ec); /* destroys outputs, too */
 
+	if (compositor->cursor != XCB_NONE)
+		xcb_free_cursor(compositor->conn, compositor->cursor);
+	weston_plane_release(&compositor->cursor_plane);
+
 	ec->renderer->destroy(ec);
 
 	XCloseDisplay(compositor->dpy);
@@ -1544,6 +2020,7 @@ x11_compositor_create(struct wl_display *display,
 
 	x11_compositor_get_resources(c);
 	x11_compositor_get_wm_info(c);
+	x11_compositor_init_render_cursor(c);
 
 	if (!c->has_net_wm_state_fullscreen && fullscreen) {
 		weston_log("Can not fullscreen without window manager support"
@@ -1564,6 +2041,11 @@ x11_compositor_create(struct wl_display *display,
 	}
 	weston_log("Using %s renderer\n", use_pixman ? "pixman" : "gl");
 
+	weston_plane_init(&c->cursor_plane, 0, 0);
+	weston_compositor_stack_plane(&c->base, &c->cursor_plane, NULL);
+
+	x11_compositor_setup_present(c);
+
 	c->base.destroy = x11_destroy;
 	c->base.restore = x11_restore;
 
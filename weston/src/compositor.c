@@ -38,6 +38,9 @@
 #include <sys/socket.h>
 #include <sys/utsname.h>
 #include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <errno.h>
+#include <spawn.h>
 #include <unistd.h>
 #include <math.h>
 #include <linux/input.h>
@@ -159,34 +162,75 @@ weston_watch_process(struct weston_process *process)
 	wl_list_insert(&child_process_list, &process->link);
 }
 
-static void
-child_client_exec(int sockfd, const char *path)
+extern char **environ;
+
+/* posix_spawn() doesn't copy the compositor's page tables the way fork()
+ * does, which with all the buffers the compositor has mapped is what
+ * makes launching a client stall the main loop. */
+WL_EXPORT pid_t
+weston_client_spawn(const char *path, char * const argv[], int sockfd)
 {
-	int clientfd;
-	char s[32];
+	posix_spawnattr_t attr;
+	struct timespec start, end;
 	sigset_t allsigs;
-
-	/* do not give our signal mask to the new process */
-	sigfillset(&allsigs);
-	sigprocmask(SIG_UNBLOCK, &allsigs, NULL);
-
-	/* Launch clients as the user. */
-	seteuid(getuid());
+	char **envp, s[32];
+	int clientfd, i, n, ret;
+	short flags;
+	pid_t pid;
 
 	/* SOCK_CLOEXEC closes both ends, so we dup the fd to get a
 	 * non-CLOEXEC fd to pass through exec. */
 	clientfd = dup(sockfd);
 	if (clientfd == -1) {
 		weston_log("compositor: dup failed: %m\n");
-		return;
+		return -1;
 	}
 
-	snprintf(s, sizeof s, "%d", clientfd);
-	setenv("WAYLAND_SOCKET", s, 1);
+	for (n = 0; environ[n]; n++)
+		;
+	envp = malloc((n + 2) * sizeof *envp);
+	if (envp == NULL) {
+		close(clientfd);
+		return -1;
+	}
 
-	if (execl(path, path, NULL) < 0)
-		weston_log("compositor: executing '%s' failed: %m\n",
-			path);
+	snprintf(s, sizeof s, "WAYLAND_SOCKET=%d", clientfd);
+	for (i = 0, n = 0; environ[i]; i++)
+		if (strncmp(environ[i], "WAYLAND_SOCKET=", 15) != 0)
+			envp[n++] = environ[i];
+	envp[n++] = s;
+	envp[n] = NULL;
+
+	/* Do not give our signal mask to the new process, and launch
+	 * clients as the user. */
+	sigemptyset(&allsigs);
+	flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_RESETIDS;
+#ifdef POSIX_SPAWN_USEVFORK
+	flags |= POSIX_SPAWN_USEVFORK;
+#endif
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setsigmask(&attr, &allsigs);
+	posix_spawnattr_setflags(&attr, flags);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ret = posix_spawn(&pid, path, NULL, &attr, argv, envp);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	posix_spawnattr_destroy(&attr);
+	free(envp);
+	close(clientfd);
+
+	if (ret != 0) {
+		errno = ret;
+		weston_log("compositor: executing '%s' failed: %m\n", path);
+		return -1;
+	}
+
+	weston_log("spawned '%s' as pid %d in %ld us\n", path, pid,
+		   (end.tv_sec - start.tv_sec) * 1000000 +
+		   (end.tv_nsec - start.tv_nsec) / 1000);
+
+	return pid;
 }
 
 WL_EXPORT struct wl_client *
@@ -197,6 +241,7 @@ weston_client_launch(struct weston_compositor *compositor,
 {
 	int sv[2];
 	pid_t pid;
+	char *argv[2];
 	struct wl_client *client;
 
 	weston_log("launching '%s'\n", path);
@@ -208,22 +253,18 @@ weston_client_launch(struct weston_compositor *compositor,
 		return NULL;
 	}
 
-	pid = fork();
+	argv[0] = (char *) path;
+	argv[1] = NULL;
+
+	pid = weston_client_spawn(path, argv, sv[1]);
+	close(sv[1]);
 	if (pid == -1) {
 		close(sv[0]);
-		close(sv[1]);
 		weston_log("weston_client_launch: "
-			"fork failed while launching '%s': %m\n", path);
+			"spawn failed while launching '%s'\n", path);
 		return NULL;
 	}
 
-	if (pid == 0) {
-		child_client_exec(sv[1], path);
-		_exit(-1);
-	}
-
-	close(sv[1]);
-
 	client = wl_client_create(compositor->wl_display, sv[0]);
 	if (!client) {
 		close(sv[0]);
@@ -1099,11 +1140,16 @@ weston_buffer_reference(struct weston_buffer_reference *ref,
 	ref->destroy_listener.notify = weston_buffer_reference_handle_destroy;
 }
 
-static void
+WL_EXPORT void
 weston_surface_attach(struct weston_surface *surface, struct wl_buffer *buffer)
 {
 	weston_buffer_reference(&surface->buffer_ref, buffer);
 
+	/* remembered here, the reference may be dropped after repaint
+	 * while the contents stay on screen */
+	surface->buffer_opaque = buffer && wl_buffer_is_shm(buffer) &&
+		wl_shm_buffer_get_format(buffer) == WL_SHM_FORMAT_XRGB8888;
+
 	if (!buffer) {
 		if (weston_surface_is_mapped(surface))
 			weston_surface_unmap(surface);
@@ -1145,6 +1191,8 @@ static void
 surface_accumulate_damage(struct weston_surface *surface,
 			  pixman_region32_t *opaque)
 {
+	struct weston_region_pool *pool = &surface->compositor->region_pool;
+
 	if (surface->buffer_ref.buffer &&
 	    wl_buffer_is_shm(surface->buffer_ref.buffer))
 		surface->compositor->renderer->flush_damage(surface);
@@ -1166,12 +1214,12 @@ surface_accumulate_damage(struct weston_surface *surface,
 					  surface->geometry.y - surface->plane->y);
 	}
 
-	pixman_region32_subtract(&surface->damage, &surface->damage, opaque);
-	pixman_region32_union(&surface->plane->damage,
-			      &surface->plane->damage, &surface->damage);
-	empty_region(&surface->damage);
+	weston_region_pool_subtract(pool, &surface->damage, opaque);
+	weston_region_pool_union(pool, &surface->plane->damage,
+				 &surface->damage);
+	weston_region_clear(&surface->damage);
 	pixman_region32_copy(&surface->clip, opaque);
-	pixman_region32_union(opaque, opaque, &surface->transform.opaque);
+	weston_region_pool_union(pool, opaque, &surface->transform.opaque);
 }
 
 static void
@@ -1179,27 +1227,27 @@ compositor_accumulate_damage(struct weston_compositor *ec)
 {
 	struct weston_plane *plane;
 	struct weston_surface *es;
-	pixman_region32_t opaque, clip;
+	pixman_region32_t *opaque, *clip;
 
-	pixman_region32_init(&clip);
+	opaque = weston_region_pool_get(&ec->region_pool);
+	clip = weston_region_pool_get(&ec->region_pool);
 
 	wl_list_for_each(plane, &ec->plane_list, link) {
-		pixman_region32_copy(&plane->clip, &clip);
-
-		pixman_region32_init(&opaque);
+		pixman_region32_copy(&plane->clip, clip);
 
 		wl_list_for_each(es, &ec->surface_list, link) {
 			if (es->plane != plane)
 				continue;
 
-			surface_accumulate_damage(es, &opaque);
+			surface_accumulate_damage(es, opaque);
 		}
 
-		pixman_region32_union(&clip, &clip, &opaque);
-		pixman_region32_fini(&opaque);
+		weston_region_pool_union(&ec->region_pool, clip, opaque);
+		weston_region_clear(opaque);
 	}
 
-	pixman_region32_fini(&clip);
+	weston_region_pool_put(&ec->region_pool, clip);
+	weston_region_pool_put(&ec->region_pool, opaque);
 
 	wl_list_for_each(es, &ec->surface_list, link) {
 		/* Both the renderer and the backend have seen the buffer
@@ -1263,7 +1311,7 @@ weston_output_repaint(struct weston_output *output, uint32_t msecs)
 	struct weston_animation *animation, *next;
 	struct weston_frame_callback *cb, *cnext;
 	struct wl_list frame_callback_list;
-	pixman_region32_t output_damage;
+	pixman_region32_t *output_damage;
 
 	/* Rebuild the surface list and update surface transforms up front. */
 	weston_compositor_build_surface_list(ec);
@@ -1285,18 +1333,20 @@ weston_output_repaint(struct weston_output *output, uint32_t msecs)
 
 	compositor_accumulate_damage(ec);
 
-	pixman_region32_init(&output_damage);
-	pixman_region32_intersect(&output_damage,
-				  &ec->primary_plane.damage, &output->region);
-	pixman_region32_subtract(&output_damage,
-				 &output_damage, &ec->primary_plane.clip);
+	output_damage = weston_region_pool_get(&ec->region_pool);
+	weston_region_pool_copy(&ec->region_pool,
+				output_damage, &ec->primary_plane.damage);
+	weston_region_pool_intersect(&ec->region_pool,
+				     output_damage, &output->region);
+	weston_region_pool_subtract(&ec->region_pool,
+				    output_damage, &ec->primary_plane.clip);
 
 	if (output->dirty)
 		weston_output_update_matrix(output);
 
-	output->repaint(output, &output_damage);
+	output->repaint(output, output_damage);
 
-	pixman_region32_fini(&output_damage);
+	weston_region_pool_put(&ec->region_pool, output_damage);
 
 	output->repaint_needed = 0;
 
@@ -1346,6 +1396,9 @@ weston_output_finish_frame(struct weston_output *output, uint32_t msecs)
 	compositor->input_loop_source =
 		wl_event_loop_add_fd(loop, fd, WL_EVENT_READABLE,
 				     weston_compositor_read_input, compositor);
+	if (compositor->input_loop_source)
+		wl_event_source_set_priority(compositor->input_loop_source,
+					     WL_EVENT_PRIORITY_HIGH);
 }
 
 static void
@@ -1520,10 +1573,82 @@ weston_surface_commit_subsurface_order(struct weston_surface *surface)
 	}
 }
 
+/* Clients rarely set an opaque region for buffers without an alpha
+ * channel, but those are opaque whatever the region says. */
+WL_EXPORT void
+weston_surface_update_opaque(struct weston_surface *surface,
+			     pixman_region32_t *requested)
+{
+	pixman_region32_t opaque;
+
+	pixman_region32_init_rect(&opaque, 0, 0,
+				  surface->geometry.width,
+				  surface->geometry.height);
+	if (!surface->buffer_opaque)
+		pixman_region32_intersect(&opaque, &opaque, requested);
+
+	if (!pixman_region32_equal(&opaque, &surface->opaque)) {
+		pixman_region32_copy(&surface->opaque, &opaque);
+		weston_surface_geometry_dirty(surface);
+	}
+
+	pixman_region32_fini(&opaque);
+}
+
+/* Whether a backend can show the surface as the cursor image of a seat:
+ * it is a pointer sprite with an shm buffer of at most max_size pixels
+ * square that is drawn without scaling or transforms. */
+WL_EXPORT int
+weston_surface_is_cursor_candidate(struct weston_surface *surface,
+				   int32_t max_size)
+{
+	struct wl_buffer *buffer = surface->buffer_ref.buffer;
+	struct weston_seat *seat;
+
+	if (buffer == NULL || !wl_buffer_is_shm(buffer))
+		return 0;
+	if (surface->buffer_scale != 1 ||
+	    surface->buffer_transform != WL_OUTPUT_TRANSFORM_NORMAL ||
+	    surface->transform.enabled)
+		return 0;
+	if (wl_shm_buffer_get_width(buffer) > max_size ||
+	    wl_shm_buffer_get_height(buffer) > max_size)
+		return 0;
+
+	wl_list_for_each(seat, &surface->compositor->seat_list, link)
+		if (seat->pointer && seat->pointer->sprite == surface)
+			return 1;
+
+	return 0;
+}
+
+/* FNV-1a hash of a cursor image and its hotspot, so that backends can
+ * tell new cursor images from ones they already uploaded. */
+WL_EXPORT uint32_t
+weston_cursor_hash(struct wl_buffer *buffer,
+		   int32_t hotspot_x, int32_t hotspot_y)
+{
+	uint8_t *data = wl_shm_buffer_get_data(buffer);
+	int32_t stride = wl_shm_buffer_get_stride(buffer);
+	int32_t width = wl_shm_buffer_get_width(buffer);
+	int32_t height = wl_shm_buffer_get_height(buffer);
+	uint32_t hash = 2166136261u;
+	int32_t x, y;
+
+	hash = (hash ^ width) * 16777619u;
+	hash = (hash ^ height) * 16777619u;
+	hash = (hash ^ hotspot_x) * 16777619u;
+	hash = (hash ^ hotspot_y) * 16777619u;
+	for (y = 0; y < height; y++, data += stride)
+		for (x = 0; x < width * 4; x++)
+			hash = (hash ^ data[x]) * 16777619u;
+
+	return hash;
+}
+
 static void
 weston_surface_commit(struct weston_surface *surface)
 {
-	pixman_region32_t opaque;
 	int surface_width = 0;
 	int surface_height = 0;
 
@@ -1564,18 +1689,7 @@ weston_surface_commit(struct weston_surface *surface)
 	empty_region(&surface->pending.damage);
 
 	/* wl_surface.set_opaque_region */
-	pixman_region32_init_rect(&opaque, 0, 0,
-				  surface->geometry.width,
-				  surface->geometry.height);
-	pixman_region32_intersect(&opaque,
-				  &opaque, &surface->pending.opaque);
-
-	if (!pixman_region32_equal(&opaque, &surface->opaque)) {
-		pixman_region32_copy(&surface->opaque, &opaque);
-		weston_surface_geometry_dirty(surface);
-	}
-
-	pixman_region32_fini(&opaque);
+	weston_surface_update_opaque(surface, &surface->pending.opaque);
 
 	/* wl_surface.set_input_region */
 	pixman_region32_fini(&surface->input);
@@ -1749,7 +1863,6 @@ static void
 weston_subsurface_commit_from_cache(struct weston_subsurface *sub)
 {
 	struct weston_surface *surface = sub->surface;
-	pixman_region32_t opaque;
 	int surface_width = 0;
 	int surface_height = 0;
 
@@ -1786,18 +1899,7 @@ weston_subsurface_commit_from_cache(struct weston_subsurface *sub)
 	empty_region(&sub->cached.damage);
 
 	/* wl_surface.set_opaque_region */
-	pixman_region32_init_rect(&opaque, 0, 0,
-				  surface->geometry.width,
-				  surface->geometry.height);
-	pixman_region32_intersect(&opaque,
-				  &opaque, &sub->cached.opaque);
-
-	if (!pixman_region32_equal(&opaque, &surface->opaque)) {
-		pixman_region32_copy(&surface->opaque, &opaque);
-		weston_surface_geometry_dirty(surface);
-	}
-
-	pixman_region32_fini(&opaque);
+	weston_surface_update_opaque(surface, &sub->cached.opaque);
 
 	/* wl_surface.set_input_region */
 	pixman_region32_fini(&surface->input);
@@ -2764,6 +2866,45 @@ weston_environment_get_fd(const char *env)
 	return fd;
 }
 
+static int
+focus_flush_handler(int fd, uint32_t mask, void *data)
+{
+	struct weston_compositor *ec = data;
+	struct weston_seat *seat;
+
+	wl_list_for_each(seat, &ec->seat_list, link)
+		weston_seat_flush_focus(seat);
+
+	return 0;
+}
+
+/* Focus changes are sent to clients once per main loop iteration, so
+ * that a grab or shell juggling focus in one go doesn't make clients
+ * see a storm of enter/leave pairs.  The eventfd is never signalled;
+ * the source only exists to be on the loop's check list, which runs
+ * after every dispatch and before clients are flushed. */
+static int
+weston_compositor_init_focus_flush(struct weston_compositor *ec,
+				   struct wl_event_loop *loop)
+{
+	int fd;
+
+	fd = eventfd(0, EFD_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	ec->focus_flush_source =
+		wl_event_loop_add_fd(loop, fd, WL_EVENT_READABLE,
+				     focus_flush_handler, ec);
+	close(fd);
+	if (!ec->focus_flush_source)
+		return -1;
+
+	wl_event_source_check(ec->focus_flush_source);
+
+	return 0;
+}
+
 WL_EXPORT int
 weston_compositor_init(struct weston_compositor *ec,
 		       struct wl_display *display,
@@ -2810,6 +2951,7 @@ weston_compositor_init(struct weston_compositor *ec,
 
 	weston_plane_init(&ec->primary_plane, 0, 0);
 	weston_compositor_stack_plane(ec, &ec->primary_plane, NULL);
+	weston_region_pool_init(&ec->region_pool);
 
 	s = weston_config_get_section(ec->config, "keyboard", NULL, NULL);
 	weston_config_section_get_string(s, "keymap_rules",
@@ -2841,6 +2983,10 @@ weston_compositor_init(struct weston_compositor *ec,
 
 	ec->input_loop = wl_event_loop_create();
 
+	/* Without it, focus changes are simply sent right away. */
+	if (weston_compositor_init_focus_flush(ec, loop) < 0)
+		weston_log("failed to create focus flush source: %m\n");
+
 	weston_layer_init(&ec->fade_layer, &ec->layer_list);
 	weston_layer_init(&ec->cursor_layer, &ec->fade_layer.link);
 
@@ -2857,6 +3003,9 @@ weston_compositor_shutdown(struct weston_compositor *ec)
 	wl_event_source_remove(ec->idle_source);
 	if (ec->input_loop_source)
 		wl_event_source_remove(ec->input_loop_source);
+	if (ec->focus_flush_source)
+		wl_event_source_remove(ec->focus_flush_source);
+	ec->focus_flush_source = NULL;
 
 	/* Destroy all outputs associated with this compositor */
 	wl_list_for_each_safe(output, next, &ec->output_list, link)
@@ -2868,6 +3017,7 @@ weston_compositor_shutdown(struct weston_compositor *ec)
 	weston_binding_list_destroy_all(&ec->debug_binding_list);
 
 	weston_plane_release(&ec->primary_plane);
+	weston_region_pool_release(&ec->region_pool);
 
 	wl_event_loop_destroy(ec->input_loop);
 
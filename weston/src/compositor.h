@@ -35,6 +35,7 @@ extern "C" {
 #include "version.h"
 #include "matrix.h"
 #include "config-parser.h"
+#include "region-pool.h"
 
 #define ARRAY_LENGTH(a) (sizeof (a) / sizeof (a)[0])
 
@@ -287,6 +288,13 @@ struct weston_pointer {
 	uint32_t focus_serial;
 	struct wl_signal focus_signal;
 
+	/* The surface focus_resource got an enter for, see
+	 * weston_seat_flush_focus(). */
+	struct weston_surface *sent_focus;
+	struct wl_listener sent_focus_listener;
+	wl_fixed_t focus_sx, focus_sy;
+	int focus_pending;
+
 	struct weston_surface *sprite;
 	struct wl_listener sprite_destroy_listener;
 	int32_t hotspot_x, hotspot_y;
@@ -396,6 +404,10 @@ struct weston_keyboard {
 	uint32_t focus_serial;
 	struct wl_signal focus_signal;
 
+	struct weston_surface *sent_focus;
+	struct wl_listener sent_focus_listener;
+	int focus_pending;
+
 	struct weston_keyboard_grab *grab;
 	struct weston_keyboard_grab default_grab;
 	uint32_t grab_key;
@@ -516,6 +528,7 @@ struct weston_compositor {
 
 	struct wl_event_loop *input_loop;
 	struct wl_event_source *input_loop_source;
+	struct wl_event_source *focus_flush_source;
 
 	struct weston_layer fade_layer;
 	struct weston_layer cursor_layer;
@@ -537,6 +550,7 @@ struct weston_compositor {
 
 	/* Repaint state. */
 	struct weston_plane primary_plane;
+	struct weston_region_pool region_pool;
 	uint32_t capabilities; /* combination of enum weston_capability */
 
 	uint32_t focus;
@@ -721,6 +735,7 @@ struct weston_surface {
 	uint32_t buffer_transform;
 	int32_t buffer_scale;
 	int keep_buffer; /* bool for backends to prevent early release */
+	int buffer_opaque; /* bool, the attached buffer has no alpha */
 
 	/* All the pending state, that wl_surface.commit will apply. */
 	struct {
@@ -814,6 +829,20 @@ pixman_box32_t
 weston_surface_to_buffer_rect(struct weston_surface *surface,
 			      pixman_box32_t rect);
 
+void
+weston_surface_attach(struct weston_surface *surface, struct wl_buffer *buffer);
+
+void
+weston_surface_update_opaque(struct weston_surface *surface,
+			     pixman_region32_t *requested);
+
+int
+weston_surface_is_cursor_candidate(struct weston_surface *surface,
+				   int32_t max_size);
+uint32_t
+weston_cursor_hash(struct wl_buffer *buffer,
+		   int32_t hotspot_x, int32_t hotspot_y);
+
 void
 weston_spring_init(struct weston_spring *spring,
 		   double k, double current, double target);
@@ -1043,6 +1072,8 @@ void
 weston_seat_init_touch(struct weston_seat *seat);
 void
 weston_seat_repick(struct weston_seat *seat);
+void
+weston_seat_flush_focus(struct weston_seat *seat);
 
 void
 weston_seat_release(struct weston_seat *seat);
@@ -1108,6 +1139,9 @@ struct weston_process {
 	struct wl_list link;
 };
 
+pid_t
+weston_client_spawn(const char *path, char * const argv[], int sockfd);
+
 struct wl_client *
 weston_client_launch(struct weston_compositor *compositor,
 		     struct weston_process *proc,
@@ -45,6 +45,12 @@ struct gl_shader {
 	GLint alpha_uniform;
 	GLint color_uniform;
 	const char *vertex_source, *fragment_source;
+
+	/* Uniform values last given to the program, so that surfaces
+	 * drawn one after the other don't upload the same ones again. */
+	GLfloat proj[16];
+	GLfloat color[4];
+	GLfloat alpha;
 };
 
 #define BUFFER_DAMAGE_COUNT 2
@@ -60,6 +66,7 @@ struct gl_surface_state {
 
 	GLuint textures[3];
 	int num_textures;
+	GLint filter; /* 0 until set on the textures */
 	pixman_region32_t texture_damage;
 
 	EGLImageKHR images[3];
@@ -87,7 +94,7 @@ struct gl_renderer {
 	} border;
 
 	struct wl_array vertices;
-	struct wl_array indices; /* only used in compositor-wayland */
+	struct wl_array indices;
 	struct wl_array vtxcnt;
 
 	PFNGLEGLIMAGETARGETTEXTURE2DOESPROC image_target_texture_2d;
@@ -641,6 +648,10 @@ triangle_fan_debug(struct weston_surface *surface, int first, int count)
 	free(buffer);
 }
 
+/* The fans are drawn as indexed triangles with a single call, except
+ * when there are more vertices than GLushort indices can address. */
+#define MAX_BATCH_VERTICES 65536
+
 static void
 repaint_region(struct weston_surface *es, pixman_region32_t *region,
 		pixman_region32_t *surf_region)
@@ -648,8 +659,9 @@ repaint_region(struct weston_surface *es, pixman_region32_t *region,
 	struct weston_compositor *ec = es->compositor;
 	struct gl_renderer *gr = get_renderer(ec);
 	GLfloat *v;
+	GLushort *indices, *p;
 	unsigned int *vtxcnt;
-	int i, first, nfans;
+	int i, k, first, base, nfans;
 
 	/* The final region to be painted is the intersection of
 	 * 'region' and 'surf_region'. However, 'region' is in the global
@@ -664,19 +676,43 @@ repaint_region(struct weston_surface *es, pixman_region32_t *region,
 	v = gr->vertices.data;
 	vtxcnt = gr->vtxcnt.data;
 
-	/* position: */
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof *v, &v[0]);
-	glEnableVertexAttribArray(0);
+	/* a fan of at most 8 vertices is at most 6 triangles */
+	indices = wl_array_add(&gr->indices, nfans * 6 * 3 * sizeof *indices);
 
-	/* texcoord: */
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof *v, &v[2]);
+	glEnableVertexAttribArray(0);
 	glEnableVertexAttribArray(1);
 
-	for (i = 0, first = 0; i < nfans; i++) {
-		glDrawArrays(GL_TRIANGLE_FAN, first, vtxcnt[i]);
-		if (gr->fan_debug)
+	for (i = 0, first = 0; i < nfans; ) {
+		base = first;
+		p = indices;
+		for (; i < nfans &&
+		       first + vtxcnt[i] - base <= MAX_BATCH_VERTICES; i++) {
+			for (k = 2; k < (int) vtxcnt[i]; k++) {
+				*p++ = first - base;
+				*p++ = first - base + k - 1;
+				*p++ = first - base + k;
+			}
+			first += vtxcnt[i];
+		}
+
+		/* position: */
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE,
+				      4 * sizeof *v, &v[base * 4]);
+		/* texcoord: */
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE,
+				      4 * sizeof *v, &v[base * 4 + 2]);
+
+		glDrawElements(GL_TRIANGLES, p - indices,
+			       GL_UNSIGNED_SHORT, indices);
+	}
+
+	if (gr->fan_debug) {
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE,
+				      4 * sizeof *v, &v[0]);
+		for (i = 0, first = 0; i < nfans; i++) {
 			triangle_fan_debug(es, first, vtxcnt[i]);
-		first += vtxcnt[i];
+			first += vtxcnt[i];
+		}
 	}
 
 	glDisableVertexAttribArray(1);
@@ -684,6 +720,7 @@ repaint_region(struct weston_surface *es, pixman_region32_t *region,
 
 	gr->vertices.size = 0;
 	gr->vtxcnt.size = 0;
+	gr->indices.size = 0;
 }
 
 static int
@@ -738,16 +775,23 @@ shader_uniforms(struct gl_shader *shader,
 		       struct weston_surface *surface,
 		       struct weston_output *output)
 {
-	int i;
 	struct gl_surface_state *gs = get_surface_state(surface);
 
-	glUniformMatrix4fv(shader->proj_uniform,
-			   1, GL_FALSE, output->matrix.d);
-	glUniform4fv(shader->color_uniform, 1, gs->color);
-	glUniform1f(shader->alpha_uniform, surface->alpha);
+	if (memcmp(shader->proj, output->matrix.d, sizeof shader->proj)) {
+		memcpy(shader->proj, output->matrix.d, sizeof shader->proj);
+		glUniformMatrix4fv(shader->proj_uniform,
+				   1, GL_FALSE, shader->proj);
+	}
 
-	for (i = 0; i < gs->num_textures; i++)
-		glUniform1i(shader->tex_uniforms[i], i);
+	if (memcmp(shader->color, gs->color, sizeof shader->color)) {
+		memcpy(shader->color, gs->color, sizeof shader->color);
+		glUniform4fv(shader->color_uniform, 1, shader->color);
+	}
+
+	if (shader->alpha != surface->alpha) {
+		shader->alpha = surface->alpha;
+		glUniform1f(shader->alpha_uniform, shader->alpha);
+	}
 }
 
 static void
@@ -757,19 +801,20 @@ draw_surface(struct weston_surface *es, struct weston_output *output,
 	struct weston_compositor *ec = es->compositor;
 	struct gl_renderer *gr = get_renderer(ec);
 	struct gl_surface_state *gs = get_surface_state(es);
+	struct weston_region_pool *pool = &ec->region_pool;
 	/* repaint bounding region in global coordinates: */
-	pixman_region32_t repaint;
+	pixman_region32_t *repaint;
 	/* non-opaque region in surface coordinates: */
-	pixman_region32_t surface_blend;
+	pixman_region32_t *surface_blend, surface_rect;
 	GLint filter;
 	int i;
 
-	pixman_region32_init(&repaint);
-	pixman_region32_intersect(&repaint,
-				  &es->transform.boundingbox, damage);
-	pixman_region32_subtract(&repaint, &repaint, &es->clip);
+	repaint = weston_region_pool_get(pool);
+	weston_region_pool_copy(pool, repaint, &es->transform.boundingbox);
+	weston_region_pool_intersect(pool, repaint, damage);
+	weston_region_pool_subtract(pool, repaint, &es->clip);
 
-	if (!pixman_region32_not_empty(&repaint))
+	if (!pixman_region32_not_empty(repaint))
 		goto out;
 
 	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
@@ -790,14 +835,20 @@ draw_surface(struct weston_surface *es, struct weston_output *output,
 	for (i = 0; i < gs->num_textures; i++) {
 		glActiveTexture(GL_TEXTURE0 + i);
 		glBindTexture(gs->target, gs->textures[i]);
+		if (gs->filter == filter)
+			continue;
 		glTexParameteri(gs->target, GL_TEXTURE_MIN_FILTER, filter);
 		glTexParameteri(gs->target, GL_TEXTURE_MAG_FILTER, filter);
 	}
+	gs->filter = filter;
 
 	/* blended region is whole surface minus opaque region: */
-	pixman_region32_init_rect(&surface_blend, 0, 0,
+	pixman_region32_init_rect(&surface_rect, 0, 0,
 				  es->geometry.width, es->geometry.height);
-	pixman_region32_subtract(&surface_blend, &surface_blend, &es->opaque);
+	surface_blend = weston_region_pool_get(pool);
+	weston_region_pool_copy(pool, surface_blend, &surface_rect);
+	weston_region_pool_subtract(pool, surface_blend, &es->opaque);
+	pixman_region32_fini(&surface_rect);
 
 	if (pixman_region32_not_empty(&es->opaque)) {
 		if (gs->shader == &gr->texture_shader_rgba) {
@@ -815,19 +866,19 @@ draw_surface(struct weston_surface *es, struct weston_output *output,
 		else
 			glDisable(GL_BLEND);
 
-		repaint_region(es, &repaint, &es->opaque);
+		repaint_region(es, repaint, &es->opaque);
 	}
 
-	if (pixman_region32_not_empty(&surface_blend)) {
+	if (pixman_region32_not_empty(surface_blend)) {
 		use_shader(gr, gs->shader);
 		glEnable(GL_BLEND);
-		repaint_region(es, &repaint, &surface_blend);
+		repaint_region(es, repaint, surface_blend);
 	}
 
-	pixman_region32_fini(&surface_blend);
+	weston_region_pool_put(pool, surface_blend);
 
 out:
-	pixman_region32_fini(&repaint);
+	weston_region_pool_put(pool, repaint);
 }
 
 static void
@@ -848,7 +899,7 @@ texture_border(struct weston_output *output)
 	struct weston_compositor *ec = output->compositor;
 	struct gl_renderer *gr = get_renderer(ec);
 	GLfloat *d;
-	unsigned int *p;
+	GLushort *p;
 	int i, j, k, n;
 	GLfloat x[4], y[4], u[4], v[4];
 
@@ -930,11 +981,16 @@ draw_border(struct weston_output *output)
 	glDisable(GL_BLEND);
 	use_shader(gr, shader);
 
-	glUniformMatrix4fv(shader->proj_uniform,
-			   1, GL_FALSE, output->matrix.d);
+	if (memcmp(shader->proj, output->matrix.d, sizeof shader->proj)) {
+		memcpy(shader->proj, output->matrix.d, sizeof shader->proj);
+		glUniformMatrix4fv(shader->proj_uniform,
+				   1, GL_FALSE, shader->proj);
+	}
 
-	glUniform1i(shader->tex_uniforms[0], 0);
-	glUniform1f(shader->alpha_uniform, 1);
+	if (shader->alpha != 1.0) {
+		shader->alpha = 1.0;
+		glUniform1f(shader->alpha_uniform, shader->alpha);
+	}
 
 	n = texture_border(output);
 
@@ -948,7 +1004,7 @@ draw_border(struct weston_output *output)
 	glEnableVertexAttribArray(1);
 
 	glDrawElements(GL_TRIANGLES, n * 6,
-		       GL_UNSIGNED_INT, gr->indices.data);
+		       GL_UNSIGNED_SHORT, gr->indices.data);
 
 	glDisableVertexAttribArray(1);
 	glDisableVertexAttribArray(0);
@@ -1095,18 +1151,52 @@ gl_renderer_read_pixels(struct weston_output *output,
 	return 0;
 }
 
+/* A texture upload costs about as much as uploading this many more
+ * pixels, so uploading a few undamaged pixels is cheaper than making
+ * another call for the damaged ones next to them. */
+#define UPLOAD_CALL_COST 4096
+
+static int
+upload_cost(const pixman_box32_t *box)
+{
+	return UPLOAD_CALL_COST + (box->x2 - box->x1) * (box->y2 - box->y1);
+}
+
+static void
+texture_upload_box(struct gl_renderer *gr, struct gl_surface_state *gs,
+		   void *data, pixman_box32_t *box)
+{
+	if (box->x1 >= box->x2 || box->y1 >= box->y2)
+		return;
+
+#ifdef GL_UNPACK_ROW_LENGTH
+	if (gr->has_unpack_subimage) {
+		glPixelStorei(GL_UNPACK_SKIP_PIXELS, box->x1);
+		glPixelStorei(GL_UNPACK_SKIP_ROWS, box->y1);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, box->x1, box->y1,
+				box->x2 - box->x1, box->y2 - box->y1,
+				GL_BGRA_EXT, GL_UNSIGNED_BYTE, data);
+		return;
+	}
+#endif
+
+	/* Without GL_EXT_unpack_subimage, whole rows are contiguous in
+	 * the buffer, so those can still be uploaded on their own. */
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, box->y1,
+			gs->pitch, box->y2 - box->y1,
+			GL_BGRA_EXT, GL_UNSIGNED_BYTE,
+			(uint32_t *) data + box->y1 * gs->pitch);
+}
+
 static void
 gl_renderer_flush_damage(struct weston_surface *surface)
 {
 	struct gl_renderer *gr = get_renderer(surface->compositor);
 	struct gl_surface_state *gs = get_surface_state(surface);
 	struct wl_buffer *buffer = gs->buffer_ref.buffer;
-
-#ifdef GL_UNPACK_ROW_LENGTH
-	pixman_box32_t *rectangles;
+	pixman_box32_t *rectangles, pending, merged, r;
 	void *data;
-	int i, n;
-#endif
+	int i, n, full_rows;
 
 	pixman_region32_union(&gs->texture_damage,
 			      &gs->texture_damage, &surface->damage);
@@ -1127,32 +1217,52 @@ gl_renderer_flush_damage(struct weston_surface *surface)
 
 	glBindTexture(GL_TEXTURE_2D, gs->textures[0]);
 
-	if (!gr->has_unpack_subimage) {
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_BGRA_EXT,
-			     gs->pitch, buffer->height, 0,
-			     GL_BGRA_EXT, GL_UNSIGNED_BYTE,
-			     wl_shm_buffer_get_data(buffer));
-
-		goto done;
-	}
-
+	full_rows = 1;
 #ifdef GL_UNPACK_ROW_LENGTH
 	/* Mesa does not define GL_EXT_unpack_subimage */
-	glPixelStorei(GL_UNPACK_ROW_LENGTH, gs->pitch);
+	if (gr->has_unpack_subimage) {
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, gs->pitch);
+		full_rows = 0;
+	}
+#endif
+
+	/* Fragmented damage, like text being edited, would otherwise
+	 * mean one upload per rectangle.  Going through the rectangles
+	 * in order, which is band by band, merge each one into the box
+	 * before it whenever uploading the box around both is cheaper
+	 * than uploading them separately. */
 	data = wl_shm_buffer_get_data(buffer);
 	rectangles = pixman_region32_rectangles(&gs->texture_damage, &n);
 	for (i = 0; i < n; i++) {
-		pixman_box32_t r;
-
 		r = weston_surface_to_buffer_rect(surface, rectangles[i]);
+		if (full_rows) {
+			r.x1 = 0;
+			r.x2 = gs->pitch;
+		}
+		r.x1 = max(r.x1, 0);
+		r.y1 = max(r.y1, 0);
+		r.x2 = min(r.x2, gs->pitch);
+		r.y2 = min(r.y2, gs->height);
 
-		glPixelStorei(GL_UNPACK_SKIP_PIXELS, r.x1);
-		glPixelStorei(GL_UNPACK_SKIP_ROWS, r.y1);
-		glTexSubImage2D(GL_TEXTURE_2D, 0, r.x1, r.y1,
-				r.x2 - r.x1, r.y2 - r.y1,
-				GL_BGRA_EXT, GL_UNSIGNED_BYTE, data);
+		if (i == 0) {
+			pending = r;
+			continue;
+		}
+
+		merged.x1 = min(pending.x1, r.x1);
+		merged.y1 = min(pending.y1, r.y1);
+		merged.x2 = max(pending.x2, r.x2);
+		merged.y2 = max(pending.y2, r.y2);
+		if (upload_cost(&merged) <=
+		    upload_cost(&pending) + upload_cost(&r)) {
+			pending = merged;
+			continue;
+		}
+
+		texture_upload_box(gr, gs, data, &pending);
+		pending = r;
 	}
-#endif
+	texture_upload_box(gr, gs, data, &pending);
 
 done:
 	pixman_region32_fini(&gs->texture_damage);
@@ -1178,6 +1288,7 @@ ensure_textures(struct gl_surface_state *gs, int num_textures)
 				GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	}
 	gs->num_textures = num_textures;
+	gs->filter = 0;
 	glBindTexture(gs->target, 0);
 }
 
@@ -1479,7 +1590,7 @@ shader_init(struct gl_shader *shader, struct gl_renderer *renderer,
 {
 	char msg[512];
 	GLint status;
-	int count;
+	int i, count;
 	const char *sources[3];
 
 	shader->vertex_shader =
@@ -1520,6 +1631,17 @@ shader_init(struct gl_shader *shader, struct gl_renderer *renderer,
 	shader->alpha_uniform = glGetUniformLocation(shader->program, "alpha");
 	shader->color_uniform = glGetUniformLocation(shader->program, "color");
 
+	/* The samplers always use the same texture units, and the other
+	 * uniforms start out as zero in a newly linked program. */
+	glUseProgram(shader->program);
+	for (i = 0; i < 3; i++)
+		glUniform1i(shader->tex_uniforms[i], i);
+	renderer->current_shader = shader;
+
+	memset(shader->proj, 0, sizeof shader->proj);
+	memset(shader->color, 0, sizeof shader->color);
+	shader->alpha = 0.0;
+
 	return 0;
 }
 
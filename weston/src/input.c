@@ -307,6 +307,38 @@ pointer_handle_sprite_destroy(struct wl_listener *listener, void *data)
 	pointer->sprite = NULL;
 }
 
+static void
+pointer_sent_focus_destroyed(struct wl_listener *listener, void *data)
+{
+	struct weston_pointer *pointer =
+		container_of(listener, struct weston_pointer,
+			     sent_focus_listener);
+
+	/* The client destroyed the surface, so there is nothing to send
+	 * a leave for any more. */
+	if (pointer->focus_resource) {
+		wl_list_remove(&pointer->focus_listener.link);
+		pointer->focus_resource = NULL;
+	}
+	pointer->sent_focus = NULL;
+	pointer->focus_pending = 1;
+}
+
+static void
+keyboard_sent_focus_destroyed(struct wl_listener *listener, void *data)
+{
+	struct weston_keyboard *keyboard =
+		container_of(listener, struct weston_keyboard,
+			     sent_focus_listener);
+
+	if (keyboard->focus_resource) {
+		wl_list_remove(&keyboard->focus_listener.link);
+		keyboard->focus_resource = NULL;
+	}
+	keyboard->sent_focus = NULL;
+	keyboard->focus_pending = 1;
+}
+
 WL_EXPORT struct weston_pointer *
 weston_pointer_create(void)
 {
@@ -319,6 +351,7 @@ weston_pointer_create(void)
 	memset(pointer, 0, sizeof *pointer);
 	wl_list_init(&pointer->resource_list);
 	pointer->focus_listener.notify = lose_pointer_focus;
+	pointer->sent_focus_listener.notify = pointer_sent_focus_destroyed;
 	pointer->default_grab.interface = &default_pointer_grab_interface;
 	pointer->default_grab.pointer = pointer;
 	pointer->grab = &pointer->default_grab;
@@ -342,6 +375,8 @@ weston_pointer_destroy(struct weston_pointer *pointer)
 	/* XXX: What about pointer->resource_list? */
 	if (pointer->focus_resource)
 		wl_list_remove(&pointer->focus_listener.link);
+	if (pointer->sent_focus)
+		wl_list_remove(&pointer->sent_focus_listener.link);
 	free(pointer);
 }
 
@@ -358,6 +393,7 @@ weston_keyboard_create(void)
 	wl_list_init(&keyboard->resource_list);
 	wl_array_init(&keyboard->keys);
 	keyboard->focus_listener.notify = lose_keyboard_focus;
+	keyboard->sent_focus_listener.notify = keyboard_sent_focus_destroyed;
 	keyboard->default_grab.interface = &default_keyboard_grab_interface;
 	keyboard->default_grab.keyboard = keyboard;
 	keyboard->grab = &keyboard->default_grab;
@@ -372,6 +408,8 @@ weston_keyboard_destroy(struct weston_keyboard *keyboard)
 	/* XXX: What about keyboard->resource_list? */
 	if (keyboard->focus_resource)
 		wl_list_remove(&keyboard->focus_listener.link);
+	if (keyboard->sent_focus)
+		wl_list_remove(&keyboard->sent_focus_listener.link);
 	wl_array_release(&keyboard->keys);
 	free(keyboard);
 }
@@ -422,30 +460,36 @@ seat_send_updated_caps(struct weston_seat *seat)
 		wl_seat_send_capabilities(r, caps);
 }
 
-WL_EXPORT void
-weston_pointer_set_focus(struct weston_pointer *pointer,
-			 struct weston_surface *surface,
-			 wl_fixed_t sx, wl_fixed_t sy)
+static void
+pointer_flush_focus(struct weston_pointer *pointer)
 {
 	struct weston_keyboard *kbd = pointer->seat->keyboard;
+	struct weston_surface *surface = pointer->focus;
 	struct wl_resource *resource, *kr;
 	struct wl_display *display;
 	uint32_t serial;
 
-	resource = pointer->focus_resource;
-	if (resource && pointer->focus != surface) {
-		display = wl_client_get_display(resource->client);
-		serial = wl_display_next_serial(display);
-		wl_pointer_send_leave(resource, serial,
-				      pointer->focus->resource);
-		wl_list_remove(&pointer->focus_listener.link);
-	}
+	if (!pointer->focus_pending)
+		return;
+	pointer->focus_pending = 0;
 
 	resource = find_resource_for_surface(&pointer->resource_list,
 					     surface);
-	if (resource &&
-	    (pointer->focus != surface ||
-	     pointer->focus_resource != resource)) {
+	if (pointer->sent_focus == surface &&
+	    pointer->focus_resource == resource)
+		return;
+
+	if (pointer->focus_resource) {
+		if (pointer->sent_focus != surface) {
+			display = wl_client_get_display(pointer->focus_resource->client);
+			serial = wl_display_next_serial(display);
+			wl_pointer_send_leave(pointer->focus_resource, serial,
+					      pointer->sent_focus->resource);
+		}
+		wl_list_remove(&pointer->focus_listener.link);
+	}
+
+	if (resource) {
 		display = wl_client_get_display(resource->client);
 		serial = wl_display_next_serial(display);
 		if (kbd) {
@@ -461,39 +505,52 @@ weston_pointer_set_focus(struct weston_pointer *pointer,
 			}
 		}
 		wl_pointer_send_enter(resource, serial, surface->resource,
-				      sx, sy);
+				      pointer->focus_sx, pointer->focus_sy);
 		wl_signal_add(&resource->destroy_signal,
 			      &pointer->focus_listener);
 		pointer->focus_serial = serial;
 	}
 
+	if (pointer->sent_focus)
+		wl_list_remove(&pointer->sent_focus_listener.link);
+	if (surface)
+		wl_signal_add(&surface->destroy_signal,
+			      &pointer->sent_focus_listener);
+
 	pointer->focus_resource = resource;
-	pointer->focus = surface;
+	pointer->sent_focus = surface;
 	wl_signal_emit(&pointer->focus_signal, pointer);
 }
 
-WL_EXPORT void
-weston_keyboard_set_focus(struct weston_keyboard *keyboard,
-			  struct weston_surface *surface)
+static void
+keyboard_flush_focus(struct weston_keyboard *keyboard)
 {
+	struct weston_surface *surface = keyboard->focus;
 	struct wl_resource *resource;
 	struct wl_display *display;
 	uint32_t serial;
 
-	if (keyboard->focus_resource && keyboard->focus != surface) {
-		resource = keyboard->focus_resource;
-		display = wl_client_get_display(resource->client);
-		serial = wl_display_next_serial(display);
-		wl_keyboard_send_leave(resource, serial,
-				       keyboard->focus->resource);
-		wl_list_remove(&keyboard->focus_listener.link);
-	}
+	if (!keyboard->focus_pending)
+		return;
+	keyboard->focus_pending = 0;
 
 	resource = find_resource_for_surface(&keyboard->resource_list,
 					     surface);
-	if (resource &&
-	    (keyboard->focus != surface ||
-	     keyboard->focus_resource != resource)) {
+	if (keyboard->sent_focus == surface &&
+	    keyboard->focus_resource == resource)
+		return;
+
+	if (keyboard->focus_resource) {
+		if (keyboard->sent_focus != surface) {
+			display = wl_client_get_display(keyboard->focus_resource->client);
+			serial = wl_display_next_serial(display);
+			wl_keyboard_send_leave(keyboard->focus_resource, serial,
+					       keyboard->sent_focus->resource);
+		}
+		wl_list_remove(&keyboard->focus_listener.link);
+	}
+
+	if (resource) {
 		display = wl_client_get_display(resource->client);
 		serial = wl_display_next_serial(display);
 		wl_keyboard_send_modifiers(resource, serial,
@@ -508,11 +565,61 @@ weston_keyboard_set_focus(struct weston_keyboard *keyboard,
 		keyboard->focus_serial = serial;
 	}
 
+	if (keyboard->sent_focus)
+		wl_list_remove(&keyboard->sent_focus_listener.link);
+	if (surface)
+		wl_signal_add(&surface->destroy_signal,
+			      &keyboard->sent_focus_listener);
+
 	keyboard->focus_resource = resource;
-	keyboard->focus = surface;
+	keyboard->sent_focus = surface;
+
+	if (resource)
+		wl_data_device_set_keyboard_focus(keyboard->seat);
 	wl_signal_emit(&keyboard->focus_signal, keyboard);
 }
 
+/* Sends the leave and enter events that take the clients from the
+ * focus they were last told about to the current pointer and keyboard
+ * focus. weston_pointer_set_focus() and weston_keyboard_set_focus()
+ * only record the new focus, and this runs once per main loop
+ * iteration before clients are flushed, and before any input event is
+ * delivered. A surface that gains and loses focus in between never
+ * hears about it. */
+WL_EXPORT void
+weston_seat_flush_focus(struct weston_seat *seat)
+{
+	if (seat->pointer)
+		pointer_flush_focus(seat->pointer);
+	if (seat->keyboard)
+		keyboard_flush_focus(seat->keyboard);
+}
+
+WL_EXPORT void
+weston_pointer_set_focus(struct weston_pointer *pointer,
+			 struct weston_surface *surface,
+			 wl_fixed_t sx, wl_fixed_t sy)
+{
+	pointer->focus = surface;
+	pointer->focus_sx = sx;
+	pointer->focus_sy = sy;
+	pointer->focus_pending = 1;
+
+	if (!pointer->seat->compositor->focus_flush_source)
+		pointer_flush_focus(pointer);
+}
+
+WL_EXPORT void
+weston_keyboard_set_focus(struct weston_keyboard *keyboard,
+			  struct weston_surface *surface)
+{
+	keyboard->focus = surface;
+	keyboard->focus_pending = 1;
+
+	if (!keyboard->seat->compositor->focus_flush_source)
+		keyboard_flush_focus(keyboard);
+}
+
 WL_EXPORT void
 weston_keyboard_start_grab(struct weston_keyboard *keyboard,
 			   struct weston_keyboard_grab *grab)
@@ -644,6 +751,7 @@ notify_motion(struct weston_seat *seat,
 
 	interface = pointer->grab->interface;
 	interface->focus(pointer->grab);
+	weston_seat_flush_focus(seat);
 	interface->motion(pointer->grab, time);
 }
 
@@ -661,6 +769,7 @@ notify_motion_absolute(struct weston_seat *seat,
 
 	interface = pointer->grab->interface;
 	interface->focus(pointer->grab);
+	weston_seat_flush_focus(seat);
 	interface->motion(pointer->grab, time);
 }
 
@@ -670,10 +779,8 @@ weston_surface_activate(struct weston_surface *surface,
 {
 	struct weston_compositor *compositor = seat->compositor;
 
-	if (seat->keyboard) {
+	if (seat->keyboard)
 		weston_keyboard_set_focus(seat->keyboard, surface);
-		wl_data_device_set_keyboard_focus(seat);
-	}
 
 	wl_signal_emit(&compositor->activate_signal, surface);
 }
@@ -707,6 +814,7 @@ notify_button(struct weston_seat *seat, uint32_t time, int32_t button,
 	weston_compositor_run_button_binding(compositor, seat, time, button,
 					     state);
 
+	weston_seat_flush_focus(seat);
 	pointer->grab->interface->button(pointer->grab, time, button, state);
 
 	if (pointer->button_count == 1)
@@ -736,6 +844,7 @@ notify_axis(struct weston_seat *seat, uint32_t time, uint32_t axis,
 						   time, axis, value))
 		return;
 
+	weston_seat_flush_focus(seat);
 	if (pointer->focus_resource)
 		wl_pointer_send_axis(pointer->focus_resource, time, axis,
 				     value);
@@ -800,6 +909,7 @@ notify_modifiers(struct weston_seat *seat, uint32_t serial)
 	seat->xkb_state.leds = leds;
 
 	if (changed) {
+		weston_seat_flush_focus(seat);
 		grab->interface->modifiers(grab,
 					   serial,
 					   keyboard->modifiers.mods_depressed,
@@ -873,6 +983,7 @@ notify_key(struct weston_seat *seat, uint32_t time, uint32_t key,
 		grab = keyboard->grab;
 	}
 
+	weston_seat_flush_focus(seat);
 	grab->interface->key(grab, time, key, state);
 
 	if (update_state == STATE_UPDATE_AUTOMATIC) {
@@ -1207,7 +1318,6 @@ seat_get_keyboard(struct wl_client *client, struct wl_resource *resource,
 	    wl_resource_get_client(seat->keyboard->focus->resource) == client) {
 		weston_keyboard_set_focus(seat->keyboard,
 					  seat->keyboard->focus);
-		wl_data_device_set_keyboard_focus(seat);
 	}
 }
 
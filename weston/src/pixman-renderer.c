@@ -25,6 +25,7 @@
 
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "pixman-renderer.h"
 
@@ -34,11 +35,19 @@ struct pixman_output_state {
 	void *shadow_buffer;
 	pixman_image_t *shadow_image;
 	pixman_image_t *hw_buffer;
+	int shadow_stale;
 };
 
 struct pixman_surface_state {
 	pixman_image_t *image;
 	struct weston_buffer_reference buffer_ref;
+
+	/* The image resampled into output coordinates, with the source
+	 * transform and output box it was last drawn with. */
+	pixman_image_t *transformed_image;
+	pixman_transform_t transformed_key;
+	pixman_box32_t transformed_box;
+	int transformed_stale;
 };
 
 struct pixman_renderer {
@@ -220,6 +229,90 @@ region_global_to_output(struct weston_output *output, pixman_region32_t *region)
 	scale_region (region, output->scale);
 }
 
+static void
+surface_drop_transformed_image(struct pixman_surface_state *ps)
+{
+	if (ps->transformed_image) {
+		pixman_image_unref(ps->transformed_image);
+		ps->transformed_image = NULL;
+	}
+}
+
+/* Resampling a buffer through a transform with a bilinear filter is one
+ * of the slowest things pixman does.  When a surface is drawn with the
+ * same transform and contents twice in a row, resample it once into an
+ * image in output coordinates and blit that from then on.  Surfaces
+ * whose transform or contents change every frame never get one, for
+ * them it would only add a copy. */
+static pixman_image_t *
+get_transformed_image(struct weston_surface *es, struct weston_output *output,
+		      pixman_transform_t *transform, pixman_box32_t *box)
+{
+	struct pixman_surface_state *ps = get_surface_state(es);
+	struct pixman_output_state *po = get_output_state(output);
+	pixman_region32_t region;
+	pixman_transform_t offset;
+	int width, height;
+
+	/* The part of the surface this output shows */
+	pixman_region32_init(&region);
+	pixman_region32_copy(&region, &es->transform.boundingbox);
+	region_global_to_output(output, &region);
+	*box = *pixman_region32_extents(&region);
+	pixman_region32_fini(&region);
+
+	width = pixman_image_get_width(po->shadow_image);
+	height = pixman_image_get_height(po->shadow_image);
+	box->x1 = box->x1 < 0 ? 0 : box->x1;
+	box->y1 = box->y1 < 0 ? 0 : box->y1;
+	box->x2 = box->x2 > width ? width : box->x2;
+	box->y2 = box->y2 > height ? height : box->y2;
+
+	if (ps->transformed_stale ||
+	    memcmp(transform, &ps->transformed_key, sizeof *transform) ||
+	    memcmp(box, &ps->transformed_box, sizeof *box)) {
+		surface_drop_transformed_image(ps);
+		ps->transformed_key = *transform;
+		ps->transformed_box = *box;
+		ps->transformed_stale = 0;
+		return NULL;
+	}
+
+	if (ps->transformed_image)
+		return ps->transformed_image;
+
+	width = box->x2 - box->x1;
+	height = box->y2 - box->y1;
+	if (width <= 0 || height <= 0)
+		return NULL;
+
+	ps->transformed_image =
+		pixman_image_create_bits(PIXMAN_a8r8g8b8, width, height,
+					 NULL, 0);
+	if (!ps->transformed_image)
+		return NULL;
+
+	pixman_transform_init_translate(&offset,
+					pixman_int_to_fixed(box->x1),
+					pixman_int_to_fixed(box->y1));
+	pixman_transform_multiply(&offset, transform, &offset);
+	pixman_image_set_transform(ps->image, &offset);
+	pixman_image_set_filter(ps->image, PIXMAN_FILTER_BILINEAR, NULL, 0);
+
+	pixman_image_composite32(PIXMAN_OP_SRC,
+				 ps->image, /* src */
+				 NULL /* mask */,
+				 ps->transformed_image, /* dest */
+				 0, 0, /* src_x, src_y */
+				 0, 0, /* mask_x, mask_y */
+				 0, 0, /* dest_x, dest_y */
+				 width, /* width */
+				 height /* height */);
+	pixman_image_set_transform(ps->image, NULL);
+
+	return ps->transformed_image;
+}
+
 #define D2F(v) pixman_double_to_fixed((double)v)
 
 static void
@@ -231,40 +324,43 @@ repaint_region(struct weston_surface *es, struct weston_output *output,
 		(struct pixman_renderer *) output->compositor->renderer;
 	struct pixman_surface_state *ps = get_surface_state(es);
 	struct pixman_output_state *po = get_output_state(output);
-	pixman_region32_t final_region;
+	struct weston_region_pool *pool = &output->compositor->region_pool;
+	pixman_region32_t *final_region;
 	float surface_x, surface_y;
 	pixman_transform_t transform;
 	pixman_fixed_t fw, fh;
+	pixman_image_t *transformed;
+	pixman_box32_t box;
 
 	/* The final region to be painted is the intersection of
 	 * 'region' and 'surf_region'. However, 'region' is in the global
 	 * coordinates, and 'surf_region' is in the surface-local
 	 * coordinates
 	 */
-	pixman_region32_init(&final_region);
+	final_region = weston_region_pool_get(pool);
 	if (surf_region) {
-		pixman_region32_copy(&final_region, surf_region);
+		weston_region_pool_copy(pool, final_region, surf_region);
 
 		/* Convert from surface to global coordinates */
 		if (!es->transform.enabled) {
-			pixman_region32_translate(&final_region, es->geometry.x, es->geometry.y);
+			pixman_region32_translate(final_region, es->geometry.x, es->geometry.y);
 		} else {
 			weston_surface_to_global_float(es, 0, 0, &surface_x, &surface_y);
-			pixman_region32_translate(&final_region, (int)surface_x, (int)surface_y);
+			pixman_region32_translate(final_region, (int)surface_x, (int)surface_y);
 		}
 
 		/* We need to paint the intersection */
-		pixman_region32_intersect(&final_region, &final_region, region);
+		weston_region_pool_intersect(pool, final_region, region);
 	} else {
 		/* If there is no surface region, just use the global region */
-		pixman_region32_copy(&final_region, region);
+		weston_region_pool_copy(pool, final_region, region);
 	}
 
 	/* Convert from global to output coord */
-	region_global_to_output(output, &final_region);
+	region_global_to_output(output, final_region);
 
 	/* And clip to it */
-	pixman_image_set_clip_region32 (po->shadow_image, &final_region);
+	pixman_image_set_clip_region32 (po->shadow_image, final_region);
 
 	/* Set up the source transformation based on the surface
 	   position, the output position/transform/scale and the client
@@ -383,22 +479,40 @@ repaint_region(struct weston_surface *es, struct weston_output *output,
 			       pixman_double_to_fixed ((double)es->buffer_scale),
 			       pixman_double_to_fixed ((double)es->buffer_scale));
 
-	pixman_image_set_transform(ps->image, &transform);
+	transformed = NULL;
+	if (ps->buffer_ref.buffer && es->transform.enabled &&
+	    es->transform.matrix.type != WESTON_MATRIX_TRANSFORM_TRANSLATE)
+		transformed = get_transformed_image(es, output,
+						    &transform, &box);
 
-	if (es->transform.enabled || output->scale != es->buffer_scale)
-		pixman_image_set_filter(ps->image, PIXMAN_FILTER_BILINEAR, NULL, 0);
-	else
-		pixman_image_set_filter(ps->image, PIXMAN_FILTER_NEAREST, NULL, 0);
+	if (transformed) {
+		pixman_image_composite32(pixman_op,
+					 transformed, /* src */
+					 NULL /* mask */,
+					 po->shadow_image, /* dest */
+					 0, 0, /* src_x, src_y */
+					 0, 0, /* mask_x, mask_y */
+					 box.x1, box.y1, /* dest_x, dest_y */
+					 box.x2 - box.x1, /* width */
+					 box.y2 - box.y1 /* height */);
+	} else {
+		pixman_image_set_transform(ps->image, &transform);
 
-	pixman_image_composite32(pixman_op,
-				 ps->image, /* src */
-				 NULL /* mask */,
-				 po->shadow_image, /* dest */
-				 0, 0, /* src_x, src_y */
-				 0, 0, /* mask_x, mask_y */
-				 0, 0, /* dest_x, dest_y */
-				 pixman_image_get_width (po->shadow_image), /* width */
-				 pixman_image_get_height (po->shadow_image) /* height */);
+		if (es->transform.enabled || output->scale != es->buffer_scale)
+			pixman_image_set_filter(ps->image, PIXMAN_FILTER_BILINEAR, NULL, 0);
+		else
+			pixman_image_set_filter(ps->image, PIXMAN_FILTER_NEAREST, NULL, 0);
+
+		pixman_image_composite32(pixman_op,
+					 ps->image, /* src */
+					 NULL /* mask */,
+					 po->shadow_image, /* dest */
+					 0, 0, /* src_x, src_y */
+					 0, 0, /* mask_x, mask_y */
+					 0, 0, /* dest_x, dest_y */
+					 pixman_image_get_width (po->shadow_image), /* width */
+					 pixman_image_get_height (po->shadow_image) /* height */);
+	}
 
 	if (pr->repaint_debug)
 		pixman_image_composite32(PIXMAN_OP_OVER,
@@ -413,7 +527,7 @@ repaint_region(struct weston_surface *es, struct weston_output *output,
 
 	pixman_image_set_clip_region32 (po->shadow_image, NULL);
 
-	pixman_region32_fini(&final_region);
+	weston_region_pool_put(pool, final_region);
 }
 
 static void
@@ -421,21 +535,22 @@ draw_surface(struct weston_surface *es, struct weston_output *output,
 	     pixman_region32_t *damage) /* in global coordinates */
 {
 	struct pixman_surface_state *ps = get_surface_state(es);
+	struct weston_region_pool *pool = &es->compositor->region_pool;
 	/* repaint bounding region in global coordinates: */
-	pixman_region32_t repaint;
+	pixman_region32_t *repaint;
 	/* non-opaque region in surface coordinates: */
-	pixman_region32_t surface_blend;
+	pixman_region32_t *surface_blend, surface_rect;
 
 	/* No buffer attached */
 	if (!ps->image)
 		return;
 
-	pixman_region32_init(&repaint);
-	pixman_region32_intersect(&repaint,
-				  &es->transform.boundingbox, damage);
-	pixman_region32_subtract(&repaint, &repaint, &es->clip);
+	repaint = weston_region_pool_get(pool);
+	weston_region_pool_copy(pool, repaint, &es->transform.boundingbox);
+	weston_region_pool_intersect(pool, repaint, damage);
+	weston_region_pool_subtract(pool, repaint, &es->clip);
 
-	if (!pixman_region32_not_empty(&repaint))
+	if (!pixman_region32_not_empty(repaint))
 		goto out;
 
 	if (output->zoom.active) {
@@ -446,26 +561,29 @@ draw_surface(struct weston_surface *es, struct weston_output *output,
 	/* TODO: Implement repaint_region_complex() using pixman_composite_trapezoids() */
 	if (es->transform.enabled &&
 	    es->transform.matrix.type != WESTON_MATRIX_TRANSFORM_TRANSLATE) {
-		repaint_region(es, output, &repaint, NULL, PIXMAN_OP_OVER);
+		repaint_region(es, output, repaint, NULL, PIXMAN_OP_OVER);
 	} else {
 		/* blended region is whole surface minus opaque region: */
-		pixman_region32_init_rect(&surface_blend, 0, 0,
+		pixman_region32_init_rect(&surface_rect, 0, 0,
 					  es->geometry.width, es->geometry.height);
-		pixman_region32_subtract(&surface_blend, &surface_blend, &es->opaque);
+		surface_blend = weston_region_pool_get(pool);
+		weston_region_pool_copy(pool, surface_blend, &surface_rect);
+		weston_region_pool_subtract(pool, surface_blend, &es->opaque);
+		pixman_region32_fini(&surface_rect);
 
 		if (pixman_region32_not_empty(&es->opaque)) {
-			repaint_region(es, output, &repaint, &es->opaque, PIXMAN_OP_SRC);
+			repaint_region(es, output, repaint, &es->opaque, PIXMAN_OP_SRC);
 		}
 
-		if (pixman_region32_not_empty(&surface_blend)) {
-			repaint_region(es, output, &repaint, &surface_blend, PIXMAN_OP_OVER);
+		if (pixman_region32_not_empty(surface_blend)) {
+			repaint_region(es, output, repaint, surface_blend, PIXMAN_OP_OVER);
 		}
-		pixman_region32_fini(&surface_blend);
+		weston_region_pool_put(pool, surface_blend);
 	}
 
 
 out:
-	pixman_region32_fini(&repaint);
+	weston_region_pool_put(pool, repaint);
 }
 static void
 repaint_surfaces(struct weston_output *output, pixman_region32_t *damage)
@@ -504,17 +622,126 @@ copy_to_hw_buffer(struct weston_output *output, pixman_region32_t *region)
 	pixman_image_set_clip_region32 (po->hw_buffer, NULL);
 }
 
+/* Returns the surface if the output shows nothing but its buffer, as
+ * is: a fullscreen video or game for example.  What the renderer would
+ * composite into the shadow image is then the buffer itself. */
+static struct weston_surface *
+find_fullscreen_surface(struct weston_output *output)
+{
+	struct weston_compositor *ec = output->compositor;
+	struct pixman_renderer *pr = get_renderer(ec);
+	struct pixman_surface_state *ps;
+	struct weston_surface *es;
+	struct wl_buffer *buffer;
+	pixman_box32_t box;
+	int found = 0;
+
+	if (pr->repaint_debug || output->zoom.active ||
+	    output->transform != WL_OUTPUT_TRANSFORM_NORMAL)
+		return NULL;
+
+	/* Surfaces on other planes aren't drawn by the renderer. */
+	wl_list_for_each(es, &ec->surface_list, link) {
+		if (es->plane == &ec->primary_plane &&
+		    (es->output_mask & (1u << output->id))) {
+			found = 1;
+			break;
+		}
+	}
+
+	if (!found)
+		return NULL;
+
+	ps = get_surface_state(es);
+	buffer = ps->buffer_ref.buffer;
+	if (!ps->image || !buffer)
+		return NULL;
+
+	if (es->transform.enabled || es->alpha != 1.0 ||
+	    es->buffer_transform != WL_OUTPUT_TRANSFORM_NORMAL ||
+	    es->buffer_scale != output->scale)
+		return NULL;
+
+	if (es->geometry.x != output->x || es->geometry.y != output->y ||
+	    wl_shm_buffer_get_width(buffer) != output->current->width ||
+	    wl_shm_buffer_get_height(buffer) != output->current->height)
+		return NULL;
+
+	/* The opaque region covers the whole of an XRGB8888 buffer */
+	box.x1 = 0;
+	box.y1 = 0;
+	box.x2 = es->geometry.width;
+	box.y2 = es->geometry.height;
+	if (pixman_region32_contains_rectangle(&es->opaque, &box) !=
+	    PIXMAN_REGION_IN)
+		return NULL;
+
+	return es;
+}
+
+static void
+copy_surface_to_hw_buffer(struct weston_output *output,
+			  struct weston_surface *es, pixman_region32_t *region)
+{
+	struct pixman_output_state *po = get_output_state(output);
+	struct pixman_surface_state *ps = get_surface_state(es);
+	pixman_region32_t output_region;
+
+	pixman_region32_init(&output_region);
+	pixman_region32_copy(&output_region, region);
+
+	region_global_to_output(output, &output_region);
+
+	pixman_image_set_clip_region32 (po->hw_buffer, &output_region);
+
+	/* repaint_region() leaves its transform and filter behind, the
+	 * buffer is copied as is here */
+	pixman_image_set_transform(ps->image, NULL);
+	pixman_image_set_filter(ps->image, PIXMAN_FILTER_NEAREST, NULL, 0);
+
+	pixman_image_composite32(PIXMAN_OP_SRC,
+				 ps->image, /* src */
+				 NULL /* mask */,
+				 po->hw_buffer, /* dest */
+				 0, 0, /* src_x, src_y */
+				 0, 0, /* mask_x, mask_y */
+				 0, 0, /* dest_x, dest_y */
+				 pixman_image_get_width (po->hw_buffer), /* width */
+				 pixman_image_get_height (po->hw_buffer) /* height */);
+
+	pixman_image_set_clip_region32 (po->hw_buffer, NULL);
+
+	pixman_region32_fini(&output_region);
+}
+
 static void
 pixman_renderer_repaint_output(struct weston_output *output,
 			     pixman_region32_t *output_damage)
 {
 	struct pixman_output_state *po = get_output_state(output);
+	struct weston_surface *fullscreen;
 
 	if (!po->hw_buffer)
 		return;
 
-	repaint_surfaces(output, output_damage);
-	copy_to_hw_buffer(output, output_damage);
+	/* A fullscreen opaque buffer goes straight to the hardware
+	 * buffer instead of through the shadow image.  The shadow image
+	 * then falls behind, so it gets repainted in full once the
+	 * output shows something else again. */
+	fullscreen = find_fullscreen_surface(output);
+	if (fullscreen) {
+		copy_surface_to_hw_buffer(output, fullscreen, output_damage);
+		po->shadow_stale = 1;
+	} else {
+		if (po->shadow_stale) {
+			pixman_region32_union(output_damage, output_damage,
+					      &output->region);
+			po->shadow_stale = 0;
+		}
+
+		repaint_surfaces(output, output_damage);
+		copy_to_hw_buffer(output, output_damage);
+	}
 
 	pixman_region32_copy(&output->previous_damage, output_damage);
 	wl_signal_emit(&output->frame_signal, output);
@@ -525,7 +752,12 @@ pixman_renderer_repaint_output(struct weston_output *output,
 static void
 pixman_renderer_flush_damage(struct weston_surface *surface)
 {
-	/* No-op for pixman renderer */
+	struct pixman_surface_state *ps = get_surface_state(surface);
+
+	/* Buffers are read in place, only the resampled copy of a
+	 * transformed surface needs to know about new contents. */
+	if (pixman_region32_not_empty(&surface->damage))
+		ps->transformed_stale = 1;
 }
 
 static void
@@ -536,6 +768,8 @@ pixman_renderer_attach(struct weston_surface *es, struct wl_buffer *buffer)
 
 	weston_buffer_reference(&ps->buffer_ref, buffer);
 
+	ps->transformed_stale = 1;
+
 	if (ps->image) {
 		pixman_image_unref(ps->image);
 		ps->image = NULL;
@@ -596,6 +830,8 @@ pixman_renderer_surface_set_color(struct weston_surface *es,
 	color.blue = blue * 0xffff;
 	color.alpha = alpha * 0xffff;
 	
+	ps->transformed_stale = 1;
+
 	if (ps->image) {
 		pixman_image_unref(ps->image);
 		ps->image = NULL;
@@ -613,6 +849,7 @@ pixman_renderer_destroy_surface(struct weston_surface *surface)
 		pixman_image_unref(ps->image);
 		ps->image = NULL;
 	}
+	surface_drop_transformed_image(ps);
 	weston_buffer_reference(&ps->buffer_ref, NULL);
 	free(ps);
 }
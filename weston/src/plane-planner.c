@@ -0,0 +1,229 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+
+#include "plane-planner.h"
+
+/* The search below is exhaustive for the handful of planes and
+ * surfaces a typical output has, this bounds the work it does for
+ * scenes where that would get expensive.  Since the first candidate
+ * it completes is the greedy one, it never does worse than that. */
+#define PLANNER_MAX_NODES 1024
+
+struct planner {
+	const struct planner_scene *scene;
+	int *current;
+	int *best;
+	uint64_t best_area;
+	int have_best;
+	uint32_t used_planes;
+	int nodes;
+};
+
+static int
+box_overlap(const pixman_box32_t *a, const pixman_box32_t *b)
+{
+	return a->x1 < b->x2 && b->x1 < a->x2 &&
+		a->y1 < b->y2 && b->y1 < a->y2;
+}
+
+static uint64_t
+box_area_on_output(const pixman_box32_t *box, const pixman_box32_t *output)
+{
+	int32_t x1, y1, x2, y2;
+
+	x1 = box->x1 > output->x1 ? box->x1 : output->x1;
+	y1 = box->y1 > output->y1 ? box->y1 : output->y1;
+	x2 = box->x2 < output->x2 ? box->x2 : output->x2;
+	y2 = box->y2 < output->y2 ? box->y2 : output->y2;
+
+	if (x1 >= x2 || y1 >= y2)
+		return 0;
+
+	return (uint64_t) (x2 - x1) * (y2 - y1);
+}
+
+static int
+plane_accepts_surface(const struct planner_scene *scene,
+		      const struct planner_plane *plane,
+		      const struct planner_surface *surface)
+{
+	int32_t width = surface->box.x2 - surface->box.x1;
+	int32_t height = surface->box.y2 - surface->box.y1;
+	int i;
+
+	if (surface->flags &
+	    (PLANNER_SURFACE_PRIMARY_ONLY | PLANNER_SURFACE_TRANSFORMED))
+		return 0;
+
+	if ((surface->flags & PLANNER_SURFACE_SCALED) && !plane->can_scale)
+		return 0;
+
+	if ((plane->max_width && width > plane->max_width) ||
+	    (plane->max_height && height > plane->max_height))
+		return 0;
+
+	switch (plane->type) {
+	case PLANNER_PLANE_CURSOR:
+		if (!(surface->flags & PLANNER_SURFACE_SHM))
+			return 0;
+		break;
+	case PLANNER_PLANE_SCANOUT:
+		if (surface->flags & PLANNER_SURFACE_SHM)
+			return 0;
+		if (surface->box.x1 != scene->output.x1 ||
+		    surface->box.y1 != scene->output.y1 ||
+		    surface->box.x2 != scene->output.x2 ||
+		    surface->box.y2 != scene->output.y2)
+			return 0;
+		break;
+	case PLANNER_PLANE_OVERLAY:
+		if (surface->flags & PLANNER_SURFACE_SHM)
+			return 0;
+		break;
+	}
+
+	if (plane->formats == NULL || surface->format == 0)
+		return 1;
+
+	for (i = 0; i < plane->format_count; i++)
+		if (plane->formats[i] == surface->format)
+			return 1;
+
+	return 0;
+}
+
+/* A surface can only leave the primary plane if nothing composited
+ * above it overlaps it, and if the planes of the surfaces above that
+ * it overlaps are displayed on top of the one it would go on. */
+static int
+surface_can_use_plane(struct planner *planner, int index, int plane)
+{
+	const struct planner_scene *scene = planner->scene;
+	const pixman_box32_t *box = &scene->surfaces[index].box;
+	int i, above;
+
+	for (i = 0; i < index; i++) {
+		if (!box_overlap(box, &scene->surfaces[i].box))
+			continue;
+
+		above = planner->current[i];
+		if (above == PLANNER_PRIMARY)
+			return 0;
+		if (scene->planes[above].z <= scene->planes[plane].z)
+			return 0;
+	}
+
+	return 1;
+}
+
+static void
+planner_search(struct planner *planner, int index,
+	       uint64_t area, int hidden)
+{
+	const struct planner_scene *scene = planner->scene;
+	const struct planner_surface *surface;
+	int i, count;
+
+	/* Moving more surfaces to the primary plane only adds area. */
+	if (planner->have_best && area >= planner->best_area)
+		return;
+
+	if (index == scene->surface_count) {
+		for (i = 0; i < scene->surface_count; i++)
+			planner->best[i] = planner->current[i];
+		planner->best_area = area;
+		planner->have_best = 1;
+		return;
+	}
+
+	if (planner->have_best && planner->nodes >= PLANNER_MAX_NODES)
+		return;
+	planner->nodes++;
+
+	/* Everything below a surface on the scanout plane is hidden, it
+	 * stays on the primary plane which doesn't get repainted. */
+	if (hidden) {
+		planner->current[index] = PLANNER_PRIMARY;
+		planner_search(planner, index + 1, area, 1);
+		return;
+	}
+
+	surface = &scene->surfaces[index];
+	count = scene->plane_count;
+	if (count > PLANNER_MAX_PLANES)
+		count = PLANNER_MAX_PLANES;
+
+	for (i = 0; i < count; i++) {
+		if (planner->used_planes & (1u << i))
+			continue;
+		if (!plane_accepts_surface(scene, &scene->planes[i], surface))
+			continue;
+		if (!surface_can_use_plane(planner, index, i))
+			continue;
+
+		planner->current[index] = i;
+		planner->used_planes |= 1u << i;
+		planner_search(planner, index + 1, area,
+			       scene->planes[i].type == PLANNER_PLANE_SCANOUT);
+		planner->used_planes &= ~(1u << i);
+	}
+
+	planner->current[index] = PLANNER_PRIMARY;
+	planner_search(planner, index + 1,
+		       area + box_area_on_output(&surface->box, &scene->output),
+		       0);
+}
+
+uint64_t
+planner_assign_planes(const struct planner_scene *scene, int *assignment)
+{
+	struct planner planner;
+	uint64_t area;
+	int i;
+
+	planner.scene = scene;
+	planner.best = assignment;
+	planner.best_area = 0;
+	planner.have_best = 0;
+	planner.used_planes = 0;
+	planner.nodes = 0;
+	planner.current = malloc(scene->surface_count *
+				 sizeof *planner.current + 1);
+
+	if (planner.current == NULL) {
+		area = 0;
+		for (i = 0; i < scene->surface_count; i++) {
+			assignment[i] = PLANNER_PRIMARY;
+			area += box_area_on_output(&scene->surfaces[i].box,
+						   &scene->output);
+		}
+
+		return area;
+	}
+
+	planner_search(&planner, 0, 0, 0);
+	free(planner.current);
+
+	return planner.best_area;
+}
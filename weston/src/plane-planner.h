@@ -0,0 +1,97 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _WESTON_PLANE_PLANNER_H_
+#define _WESTON_PLANE_PLANNER_H_
+
+#include <stdint.h>
+#include <pixman.h>
+
+/* The plane planner decides which surfaces of an output go on hardware
+ * planes and which get composited into the primary plane.  It only
+ * looks at a description of the planes and of the scene, so it doesn't
+ * touch the hardware and can be tested on its own; the backend still
+ * has to check each buffer when it puts the assignment into effect. */
+
+#define PLANNER_PRIMARY		-1
+#define PLANNER_MAX_PLANES	32
+
+enum planner_plane_type {
+	/* Small shm buffers, copied into a cursor image. */
+	PLANNER_PLANE_CURSOR,
+	/* Replaces the primary plane: the surface must cover the whole
+	 * output and everything below it is hidden. */
+	PLANNER_PLANE_SCANOUT,
+	/* Client buffers displayed above the primary plane. */
+	PLANNER_PLANE_OVERLAY
+};
+
+struct planner_plane {
+	enum planner_plane_type type;
+	/* Formats the plane can display, NULL for any. */
+	const uint32_t *formats;
+	int format_count;
+	/* Largest surface the plane takes, 0 for no limit. */
+	int32_t max_width, max_height;
+	int can_scale;
+	/* Stacking order, planes with a higher z are displayed on top.
+	 * Surfaces that overlap can only go on planes in their own
+	 * stacking order; the primary plane is below all of them. */
+	int z;
+};
+
+/* The buffer is in shared memory and can only go on a cursor plane. */
+#define PLANNER_SURFACE_SHM		(1 << 0)
+/* Rotated, or the buffer transform doesn't match the output. */
+#define PLANNER_SURFACE_TRANSFORMED	(1 << 1)
+/* The buffer is displayed at a different size than it has. */
+#define PLANNER_SURFACE_SCALED		(1 << 2)
+/* Must be composited for some other reason, like having no buffer, not
+ * being fully opaque or being visible on another output. */
+#define PLANNER_SURFACE_PRIMARY_ONLY	(1 << 3)
+
+struct planner_surface {
+	/* Bounding box in global coordinates. */
+	pixman_box32_t box;
+	/* Buffer format, 0 if unknown: the backend checks it when it
+	 * sets up the plane. */
+	uint32_t format;
+	uint32_t flags;
+};
+
+struct planner_scene {
+	/* The output in global coordinates. */
+	pixman_box32_t output;
+	const struct planner_plane *planes;
+	int plane_count;
+	/* Surfaces in stacking order, topmost first. */
+	const struct planner_surface *surfaces;
+	int surface_count;
+};
+
+/* Fills assignment[i] with the index of the plane surfaces[i] goes on,
+ * or PLANNER_PRIMARY, such that the area composited into the primary
+ * plane is as small as the planner could find.  Returns that area. */
+uint64_t
+planner_assign_planes(const struct planner_scene *scene, int *assignment);
+
+#endif
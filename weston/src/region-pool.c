@@ -0,0 +1,444 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <strings.h>
+#include <wayland-util.h>
+
+#include "region-pool.h"
+
+WL_EXPORT void
+weston_region_pool_init(struct weston_region_pool *pool)
+{
+	int i;
+
+	for (i = 0; i < WESTON_REGION_POOL_SIZE; i++)
+		pixman_region32_init(&pool->regions[i]);
+	pool->used = 0;
+	pool->nspare = 0;
+	pool->stored = 0;
+	pool->parked = 0;
+	pool->lost = 0;
+}
+
+WL_EXPORT void
+weston_region_pool_release(struct weston_region_pool *pool)
+{
+	int i;
+
+	for (i = 0; i < WESTON_REGION_POOL_SIZE; i++)
+		pixman_region32_fini(&pool->regions[i]);
+	for (i = 0; i < pool->nspare; i++)
+		free(pool->spare[i]);
+	pool->nspare = 0;
+	pool->used = 0;
+}
+
+static int
+region_index(struct weston_region_pool *pool, pixman_region32_t *region)
+{
+	if (region < pool->regions ||
+	    region >= pool->regions + WESTON_REGION_POOL_SIZE)
+		return -1;
+
+	return region - pool->regions;
+}
+
+static int
+region_has_storage(pixman_region32_t *region)
+{
+	return region->data && region->data->size;
+}
+
+/* Gives an empty region without storage some from the spares. */
+static void
+region_refill(struct weston_region_pool *pool, pixman_region32_t *region)
+{
+	if (region_has_storage(region) || pool->nspare == 0)
+		return;
+
+	region->data = pool->spare[--pool->nspare];
+	region->data->numRects = 0;
+	region->extents.x1 = 0;
+	region->extents.y1 = 0;
+	region->extents.x2 = 0;
+	region->extents.y2 = 0;
+}
+
+/* Sets the region to a single box. pixman has no storage for that, so
+ * the region's storage goes to the spares. */
+static void
+region_set_box(struct weston_region_pool *pool, pixman_region32_t *region,
+	       pixman_box32_t *box)
+{
+	int i;
+
+	if (box->x1 >= box->x2 || box->y1 >= box->y2) {
+		weston_region_clear(region);
+		return;
+	}
+
+	if (region_has_storage(region) &&
+	    pool->nspare < WESTON_REGION_POOL_SIZE) {
+		pool->spare[pool->nspare++] = region->data;
+		region->data = NULL;
+
+		i = region_index(pool, region);
+		if (i >= 0)
+			pool->parked |= 1u << i;
+	}
+
+	pixman_region32_reset(region, box);
+}
+
+static int
+box_contains(pixman_box32_t *a, pixman_box32_t *b)
+{
+	return a->x1 <= b->x1 && a->y1 <= b->y1 &&
+		a->x2 >= b->x2 && a->y2 >= b->y2;
+}
+
+static int
+box_overlaps(pixman_box32_t *a, pixman_box32_t *b)
+{
+	return a->x1 < b->x2 && b->x1 < a->x2 &&
+		a->y1 < b->y2 && b->y1 < a->y2;
+}
+
+/* Intersects the box with the rectangles of the region. When the
+ * pieces add up to a single rectangle, that is the result and pixman
+ * isn't needed; returns 0 when it is. */
+static int
+box_intersect_region(pixman_box32_t *box, pixman_region32_t *region,
+		     pixman_box32_t *result)
+{
+	pixman_box32_t *rects, piece;
+	int64_t area = 0;
+	int i, n, found = 0;
+
+	rects = pixman_region32_rectangles(region, &n);
+	for (i = 0; i < n; i++) {
+		piece.x1 = rects[i].x1 > box->x1 ? rects[i].x1 : box->x1;
+		piece.y1 = rects[i].y1 > box->y1 ? rects[i].y1 : box->y1;
+		piece.x2 = rects[i].x2 < box->x2 ? rects[i].x2 : box->x2;
+		piece.y2 = rects[i].y2 < box->y2 ? rects[i].y2 : box->y2;
+		if (piece.x1 >= piece.x2 || piece.y1 >= piece.y2)
+			continue;
+
+		if (!found) {
+			*result = piece;
+			found = 1;
+		} else {
+			if (piece.x1 < result->x1)
+				result->x1 = piece.x1;
+			if (piece.y1 < result->y1)
+				result->y1 = piece.y1;
+			if (piece.x2 > result->x2)
+				result->x2 = piece.x2;
+			if (piece.y2 > result->y2)
+				result->y2 = piece.y2;
+		}
+		area += (int64_t) (piece.x2 - piece.x1) * (piece.y2 - piece.y1);
+	}
+
+	if (!found) {
+		result->x1 = result->y1 = result->x2 = result->y2 = 0;
+		return 1;
+	}
+
+	return area == (int64_t) (result->x2 - result->x1) *
+		(result->y2 - result->y1);
+}
+
+/* a - b, when that is a single rectangle; b overlaps a without
+ * containing it. */
+static int
+box_subtract_box(pixman_box32_t *a, pixman_box32_t *b,
+		 pixman_box32_t *result)
+{
+	*result = *a;
+
+	if (b->x1 <= a->x1 && b->x2 >= a->x2) {
+		if (b->y1 <= a->y1)
+			result->y1 = b->y2;
+		else if (b->y2 >= a->y2)
+			result->y2 = b->y1;
+		else
+			return 0;
+	} else if (b->y1 <= a->y1 && b->y2 >= a->y2) {
+		if (b->x1 <= a->x1)
+			result->x1 = b->x2;
+		else if (b->x2 >= a->x2)
+			result->x2 = b->x1;
+		else
+			return 0;
+	} else {
+		return 0;
+	}
+
+	return 1;
+}
+
+static pixman_region32_t *
+region_get(struct weston_region_pool *pool)
+{
+	pixman_region32_t *region;
+	int i;
+
+	i = ffs(~pool->used & ((1u << WESTON_REGION_POOL_SIZE) - 1));
+	if (i == 0)
+		return NULL;
+
+	region = &pool->regions[i - 1];
+	region_refill(pool, region);
+
+	pool->used |= 1u << (i - 1);
+	pool->parked &= ~(1u << (i - 1));
+	if (region_has_storage(region))
+		pool->stored |= 1u << (i - 1);
+	else
+		pool->stored &= ~(1u << (i - 1));
+
+	return region;
+}
+
+static void
+region_put(struct weston_region_pool *pool, pixman_region32_t *region)
+{
+	weston_region_clear(region);
+	region_refill(pool, region);
+	pool->used &= ~(1u << region_index(pool, region));
+}
+
+WL_EXPORT pixman_region32_t *
+weston_region_pool_get(struct weston_region_pool *pool)
+{
+	pixman_region32_t *region;
+
+	region = region_get(pool);
+	if (region)
+		return region;
+
+	region = malloc(sizeof *region);
+	if (region == NULL)
+		return NULL;
+
+	pixman_region32_init(region);
+
+	return region;
+}
+
+WL_EXPORT void
+weston_region_pool_put(struct weston_region_pool *pool,
+		       pixman_region32_t *region)
+{
+	uint32_t bit;
+	int i;
+
+	i = region_index(pool, region);
+	if (i < 0) {
+		pixman_region32_fini(region);
+		free(region);
+		return;
+	}
+
+	bit = 1u << i;
+	if ((pool->stored & bit) && !(pool->parked & bit) &&
+	    !region_has_storage(region))
+		pool->lost++;
+
+	region_put(pool, region);
+}
+
+WL_EXPORT void
+weston_region_clear(pixman_region32_t *region)
+{
+	/* An empty region may keep its storage, pixman only frees it
+	 * when the region is finalized or gets a single rectangle. */
+	if (region->data && region->data->size) {
+		region->data->numRects = 0;
+		region->extents.x1 = 0;
+		region->extents.y1 = 0;
+		region->extents.x2 = 0;
+		region->extents.y2 = 0;
+	} else {
+		pixman_region32_fini(region);
+		pixman_region32_init(region);
+	}
+}
+
+static void
+region_swap(pixman_region32_t *a, pixman_region32_t *b)
+{
+	pixman_region32_t tmp;
+
+	tmp = *a;
+	*a = *b;
+	*b = tmp;
+}
+
+WL_EXPORT void
+weston_region_pool_copy(struct weston_region_pool *pool,
+			pixman_region32_t *region, pixman_region32_t *other)
+{
+	if (region == other)
+		return;
+
+	if (!pixman_region32_not_empty(other)) {
+		weston_region_clear(region);
+		return;
+	}
+
+	if (!other->data) {
+		region_set_box(pool, region, &other->extents);
+		return;
+	}
+
+	region_refill(pool, region);
+	pixman_region32_copy(region, other);
+}
+
+WL_EXPORT void
+weston_region_pool_union(struct weston_region_pool *pool,
+			 pixman_region32_t *region, pixman_region32_t *other)
+{
+	pixman_region32_t *result;
+
+	if (!pixman_region32_not_empty(other))
+		return;
+
+	if (!pixman_region32_not_empty(region)) {
+		weston_region_pool_copy(pool, region, other);
+		return;
+	}
+
+	if (!region->data && box_contains(&region->extents, &other->extents))
+		return;
+
+	if (!other->data && box_contains(&other->extents, &region->extents)) {
+		region_set_box(pool, region, &other->extents);
+		return;
+	}
+
+	result = region_get(pool);
+	if (result == NULL) {
+		pixman_region32_union(region, region, other);
+		return;
+	}
+
+	pixman_region32_union(result, region, other);
+	region_swap(result, region);
+	region_put(pool, result);
+}
+
+WL_EXPORT void
+weston_region_pool_intersect(struct weston_region_pool *pool,
+			     pixman_region32_t *region,
+			     pixman_region32_t *other)
+{
+	pixman_region32_t *result;
+	pixman_box32_t box;
+
+	if (!pixman_region32_not_empty(region))
+		return;
+
+	if (!pixman_region32_not_empty(other) ||
+	    !box_overlaps(&region->extents, &other->extents)) {
+		weston_region_clear(region);
+		return;
+	}
+
+	if (!other->data && box_contains(&other->extents, &region->extents))
+		return;
+
+	if (!region->data && box_contains(&region->extents, &other->extents)) {
+		weston_region_pool_copy(pool, region, other);
+		return;
+	}
+
+	if (!region->data && !other->data) {
+		box = region->extents;
+		if (box.x1 < other->extents.x1)
+			box.x1 = other->extents.x1;
+		if (box.y1 < other->extents.y1)
+			box.y1 = other->extents.y1;
+		if (box.x2 > other->extents.x2)
+			box.x2 = other->extents.x2;
+		if (box.y2 > other->extents.y2)
+			box.y2 = other->extents.y2;
+		region_set_box(pool, region, &box);
+		return;
+	}
+
+	if ((!region->data &&
+	     box_intersect_region(&region->extents, other, &box)) ||
+	    (!other->data &&
+	     box_intersect_region(&other->extents, region, &box))) {
+		region_set_box(pool, region, &box);
+		return;
+	}
+
+	result = region_get(pool);
+	if (result == NULL) {
+		pixman_region32_intersect(region, region, other);
+		return;
+	}
+
+	pixman_region32_intersect(result, region, other);
+	region_swap(result, region);
+	region_put(pool, result);
+}
+
+WL_EXPORT void
+weston_region_pool_subtract(struct weston_region_pool *pool,
+			    pixman_region32_t *region,
+			    pixman_region32_t *other)
+{
+	pixman_region32_t *result;
+	pixman_box32_t box;
+
+	if (!pixman_region32_not_empty(region) ||
+	    !pixman_region32_not_empty(other) ||
+	    !box_overlaps(&region->extents, &other->extents))
+		return;
+
+	if (!other->data && box_contains(&other->extents, &region->extents)) {
+		weston_region_clear(region);
+		return;
+	}
+
+	if (!region->data && !other->data &&
+	    box_subtract_box(&region->extents, &other->extents, &box)) {
+		region_set_box(pool, region, &box);
+		return;
+	}
+
+	result = region_get(pool);
+	if (result == NULL) {
+		pixman_region32_subtract(region, region, other);
+		return;
+	}
+
+	pixman_region32_subtract(result, region, other);
+	region_swap(result, region);
+	region_put(pool, result);
+}
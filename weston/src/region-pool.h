@@ -0,0 +1,94 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _WESTON_REGION_POOL_H_
+#define _WESTON_REGION_POOL_H_
+
+#include <stdint.h>
+#include <pixman.h>
+
+/* A set of scratch regions that are never finalized, so the rectangle
+ * storage pixman allocates for them stays around for the next frame.
+ * Regions borrowed with weston_region_pool_get() are empty and must be
+ * given back with weston_region_pool_put() before the frame is done.
+ *
+ * pixman allocates new storage whenever an operation writes its result
+ * into one of its multi-rectangle operands, so the in-place operations
+ * below compute the result into a scratch region and swap the two.
+ * pixman also frees the storage of a region that ends up with a single
+ * rectangle or none, so the operations work out such results from the
+ * extents where they can and set them without pixman, keeping the
+ * storage aside for the next region that needs it. Borrowed regions
+ * should only be written through the functions here. */
+
+#define WESTON_REGION_POOL_SIZE 16
+
+struct weston_region_pool {
+	pixman_region32_t regions[WESTON_REGION_POOL_SIZE];
+	uint32_t used;
+
+	/* storage of regions that were set to a single rectangle */
+	pixman_region32_data_t *spare[WESTON_REGION_POOL_SIZE];
+	int nspare;
+
+	/* regions that had storage when borrowed, and those of them
+	 * whose storage was set aside */
+	uint32_t stored, parked;
+	/* borrowed regions that came back without their storage */
+	uint32_t lost;
+};
+
+void
+weston_region_pool_init(struct weston_region_pool *pool);
+void
+weston_region_pool_release(struct weston_region_pool *pool);
+
+/* When all regions are in use, this falls back to allocating one. */
+pixman_region32_t *
+weston_region_pool_get(struct weston_region_pool *pool);
+void
+weston_region_pool_put(struct weston_region_pool *pool,
+		       pixman_region32_t *region);
+
+/* Empties the region, keeping its rectangle storage. */
+void
+weston_region_clear(pixman_region32_t *region);
+
+/* region = other */
+void
+weston_region_pool_copy(struct weston_region_pool *pool,
+			pixman_region32_t *region, pixman_region32_t *other);
+
+/* region = region op other */
+void
+weston_region_pool_union(struct weston_region_pool *pool,
+			 pixman_region32_t *region, pixman_region32_t *other);
+void
+weston_region_pool_intersect(struct weston_region_pool *pool,
+			     pixman_region32_t *region,
+			     pixman_region32_t *other);
+void
+weston_region_pool_subtract(struct weston_region_pool *pool,
+			    pixman_region32_t *region,
+			    pixman_region32_t *other);
+
+#endif
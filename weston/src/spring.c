@@ -0,0 +1,243 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <math.h>
+
+#include "compositor.h"
+
+/* The spring used to be integrated in 4ms steps of
+ *
+ *	x' = x + (x - p) + h² (k/10 (T - x) + (p - x) - (x - p) friction)
+ *
+ * with h = 0.01, which with y = x - T is the linear recurrence
+ *
+ *	y' = (2 - a - b) y - (1 - a) p,  a = h² (1 + friction), b = h² k/10
+ *
+ * The functions below evaluate its closed form solution instead, so
+ * that any timestamp costs the same and the result doesn't depend on
+ * how often the spring is updated.  Fractional steps use the natural
+ * extension of the solution, so at every multiple of 4ms the result is
+ * what stepping would have given. */
+
+#define SPRING_STEP_MSEC 4
+#define SPRING_EPSILON 0.0002
+
+enum spring_solution_type {
+	SPRING_OSCILLATING,
+	SPRING_OVERDAMPED,
+	SPRING_CRITICAL
+};
+
+/* y(s) = rho^s (c1 cos(theta s) + c2 sin(theta s))	oscillating
+ * y(s) = c1 r1^s + c2 r2^s				overdamped
+ * y(s) = (c1 + c2 s) r1^s				critical */
+struct spring_solution {
+	enum spring_solution_type type;
+	double r1, r2, theta;
+	double c1, c2;
+};
+
+static int
+spring_solve(const struct weston_spring *spring,
+	     struct spring_solution *sol)
+{
+	const double h2 = 0.01 * 0.01;
+	double a, b, p, q, disc, y0, y1, root;
+
+	a = h2 * (1.0 + spring->friction);
+	b = h2 * spring->k / 10.0;
+	p = 2.0 - a - b;
+	q = 1.0 - a;
+	disc = p * p - 4.0 * q;
+
+	y0 = spring->current - spring->target;
+	y1 = spring->previous - spring->target;
+
+	if (disc < -1e-13) {
+		sol->type = SPRING_OSCILLATING;
+		sol->r1 = sqrt(q);
+		sol->theta = acos(p / (2.0 * sol->r1));
+		sol->c1 = y0;
+		sol->c2 = (y0 * cos(sol->theta) - sol->r1 * y1) /
+			sin(sol->theta);
+	} else if (disc > 1e-13) {
+		root = sqrt(disc);
+		sol->type = SPRING_OVERDAMPED;
+		sol->r1 = (p + root) / 2.0;
+		sol->r2 = (p - root) / 2.0;
+		if (sol->r2 <= 0.0)
+			return 0;
+		sol->c1 = (y1 - y0 / sol->r2) / (1.0 / sol->r1 - 1.0 / sol->r2);
+		sol->c2 = y0 - sol->c1;
+	} else {
+		sol->type = SPRING_CRITICAL;
+		sol->r1 = p / 2.0;
+		if (sol->r1 <= 0.0)
+			return 0;
+		sol->c1 = y0;
+		sol->c2 = y0 - sol->r1 * y1;
+	}
+
+	/* Only decaying solutions ever settle on the target. */
+	return sol->r1 < 1.0;
+}
+
+static double
+spring_solution_eval(const struct spring_solution *sol, double s)
+{
+	switch (sol->type) {
+	case SPRING_OSCILLATING:
+		return pow(sol->r1, s) * (sol->c1 * cos(sol->theta * s) +
+					  sol->c2 * sin(sol->theta * s));
+	case SPRING_OVERDAMPED:
+		return sol->c1 * pow(sol->r1, s) + sol->c2 * pow(sol->r2, s);
+	case SPRING_CRITICAL:
+	default:
+		return (sol->c1 + sol->c2 * s) * pow(sol->r1, s);
+	}
+}
+
+/* The first s > 0 at which y(s) has an extremum, or -1 if it has none.
+ * Every later extremum of a decaying solution is smaller than that one,
+ * so together with y(0) it gives the largest |y| still ahead. */
+static double
+spring_solution_extremum(const struct spring_solution *sol)
+{
+	double ln1, ln2, phase, period, ratio, s;
+
+	ln1 = log(sol->r1);
+
+	switch (sol->type) {
+	case SPRING_OSCILLATING:
+		/* y(s) = R rho^s cos(theta s - phi) */
+		phase = atan(ln1 / sol->theta) + atan2(sol->c2, sol->c1);
+		period = M_PI / sol->theta;
+		s = fmod(phase / sol->theta, period);
+		return s < 0.0 ? s + period : s;
+	case SPRING_OVERDAMPED:
+		if (sol->c1 == 0.0)
+			return -1.0;
+		ln2 = log(sol->r2);
+		ratio = -sol->c2 * ln2 / (sol->c1 * ln1);
+		if (ratio <= 0.0)
+			return -1.0;
+		return log(ratio) / (ln1 - ln2);
+	case SPRING_CRITICAL:
+	default:
+		if (sol->c2 == 0.0)
+			return -1.0;
+		return -1.0 / ln1 - sol->c1 / sol->c2;
+	}
+}
+
+static double
+spring_solution_max(const struct spring_solution *sol)
+{
+	double max, y, s;
+
+	max = fabs(spring_solution_eval(sol, 0.0));
+
+	s = spring_solution_extremum(sol);
+	if (s > 0.0) {
+		y = fabs(spring_solution_eval(sol, s));
+		if (y > max)
+			max = y;
+	}
+
+	return max;
+}
+
+/* For parameters without a decaying closed form. */
+static void
+spring_step(struct weston_spring *spring, uint32_t msec)
+{
+	double force, v, current, step;
+
+	step = 0.01;
+	while (SPRING_STEP_MSEC < msec - spring->timestamp) {
+		current = spring->current;
+		v = current - spring->previous;
+		force = spring->k * (spring->target - current) / 10.0 +
+			(spring->previous - current) - v * spring->friction;
+
+		spring->current =
+			current + (current - spring->previous) +
+			force * step * step;
+		spring->previous = current;
+
+		spring->timestamp += SPRING_STEP_MSEC;
+	}
+}
+
+WL_EXPORT void
+weston_spring_init(struct weston_spring *spring,
+		 double k, double current, double target)
+{
+	spring->k = k;
+	spring->friction = 400.0;
+	spring->current = current;
+	spring->previous = current;
+	spring->target = target;
+}
+
+WL_EXPORT void
+weston_spring_update(struct weston_spring *spring, uint32_t msec)
+{
+	struct spring_solution sol;
+	double s;
+
+	/* Time moving backwards or jumping far ahead means the clock
+	 * changed under us, don't let that make the spring skip to the
+	 * end of the animation.
+	 */
+	if (msec - spring->timestamp > 1000) {
+		weston_log("unexpectedly large timestamp jump (from %u to %u)\n",
+			   spring->timestamp, msec);
+		spring->timestamp = msec - 1000;
+	}
+
+	if (!spring_solve(spring, &sol)) {
+		spring_step(spring, msec);
+		return;
+	}
+
+	s = (double) (msec - spring->timestamp) / SPRING_STEP_MSEC;
+	spring->current = spring->target + spring_solution_eval(&sol, s);
+	spring->previous = spring->target + spring_solution_eval(&sol, s - 1.0);
+	spring->timestamp = msec;
+}
+
+/* The spring is done once it can no longer leave the epsilon
+ * neighbourhood of its target, not just when it happens to be in it. */
+WL_EXPORT int
+weston_spring_done(struct weston_spring *spring)
+{
+	struct spring_solution sol;
+
+	if (!spring_solve(spring, &sol))
+		return fabs(spring->previous - spring->target) < SPRING_EPSILON &&
+			fabs(spring->current - spring->target) < SPRING_EPSILON;
+
+	return spring_solution_max(&sol) < SPRING_EPSILON;
+}
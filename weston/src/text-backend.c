@@ -59,6 +59,7 @@ struct text_input_manager {
 
 struct input_method {
 	struct wl_resource *input_method_binding;
+	uint32_t binding_version;
 	struct wl_global *input_method_global;
 	struct wl_listener destroy_listener;
 
@@ -85,6 +86,27 @@ struct input_method_context {
 	struct wl_list link;
 
 	struct wl_resource *keyboard;
+
+	uint32_t version;
+
+	struct {
+		int enabled;
+		struct wl_array keysyms;
+		uint32_t modifiers;
+		struct wl_array direct_keys;
+		uint32_t last_serial;
+		uint32_t acked_serial;
+		struct wl_array pending_modifiers;
+	} key_filter;
+};
+
+struct pending_modifiers {
+	uint32_t key_serial;
+	uint32_t serial;
+	uint32_t mods_depressed;
+	uint32_t mods_latched;
+	uint32_t mods_locked;
+	uint32_t group;
 };
 
 struct text_backend {
@@ -533,21 +555,167 @@ unbind_keyboard(struct wl_resource *resource)
 	free(resource);
 }
 
+static int
+key_filter_matches(struct input_method_context *context, uint32_t key)
+{
+	struct xkb_state *state = context->input_method->seat->xkb_state.state;
+	const xkb_keysym_t *syms;
+	uint32_t *sym;
+	int i, num_syms;
+
+	if (!state)
+		return 1;
+
+	if (xkb_state_serialize_mods(state, XKB_STATE_DEPRESSED |
+				     XKB_STATE_LATCHED) &
+	    context->key_filter.modifiers)
+		return 1;
+
+	num_syms = xkb_key_get_syms(state, key + 8, &syms);
+	for (i = 0; i < num_syms; i++)
+		wl_array_for_each(sym, &context->key_filter.keysyms)
+			if (*sym == syms[i])
+				return 1;
+
+	return 0;
+}
+
+/* Whether the key sent to the input method with serial has been
+ * neither forwarded nor acknowledged yet. */
+static int
+key_filter_outstanding(struct input_method_context *context, uint32_t serial)
+{
+	return (int32_t) (serial - context->key_filter.acked_serial) > 0 &&
+		(int32_t) (context->key_filter.last_serial - serial) >= 0;
+}
+
+/* Sends the modifier changes that were held back behind keys up to
+ * and including key_serial on to the client. */
+static void
+key_filter_flush_modifiers(struct input_method_context *context,
+			   uint32_t key_serial)
+{
+	struct weston_keyboard *keyboard = context->input_method->seat->keyboard;
+	struct weston_keyboard_grab *default_grab = &keyboard->default_grab;
+	struct wl_array *pending = &context->key_filter.pending_modifiers;
+	struct pending_modifiers *mods, *end;
+	size_t n = 0;
+
+	end = (struct pending_modifiers *) ((char *) pending->data + pending->size);
+	for (mods = pending->data; mods < end; mods++, n++) {
+		if ((int32_t) (mods->key_serial - key_serial) > 0)
+			break;
+		default_grab->interface->modifiers(default_grab, mods->serial,
+						   mods->mods_depressed,
+						   mods->mods_latched,
+						   mods->mods_locked,
+						   mods->group);
+	}
+
+	if (n == 0)
+		return;
+
+	pending->size -= n * sizeof *mods;
+	memmove(pending->data, mods, pending->size);
+}
+
+/* Holds a modifier change back until the keys sent to the input method
+ * before it reach the client. */
+static void
+key_filter_queue_modifiers(struct input_method_context *context,
+			   uint32_t serial, uint32_t mods_depressed,
+			   uint32_t mods_latched, uint32_t mods_locked,
+			   uint32_t group)
+{
+	struct pending_modifiers *mods;
+
+	mods = wl_array_add(&context->key_filter.pending_modifiers,
+			    sizeof *mods);
+	if (!mods)
+		return;
+
+	mods->key_serial = context->key_filter.last_serial;
+	mods->serial = serial;
+	mods->mods_depressed = mods_depressed;
+	mods->mods_latched = mods_latched;
+	mods->mods_locked = mods_locked;
+	mods->group = group;
+}
+
+/* Marks the keys sent to the input method up to serial as handled. */
+static void
+key_filter_ack(struct input_method_context *context, uint32_t serial)
+{
+	if (!key_filter_outstanding(context, serial))
+		return;
+
+	context->key_filter.acked_serial = serial;
+	key_filter_flush_modifiers(context, serial);
+}
+
+/* Decides whether a key event goes to the input method. Presses that
+ * bypass it are remembered, so that the release follows the press even
+ * if the filter or the modifiers changed in between. Nothing bypasses
+ * the input method while it still holds keys, or the client would see
+ * them out of order. */
+static int
+key_filter_grab_key(struct input_method_context *context,
+		    uint32_t key, uint32_t state)
+{
+	struct wl_array *direct_keys = &context->key_filter.direct_keys;
+	uint32_t *k, *end;
+
+	end = (uint32_t *) ((char *) direct_keys->data + direct_keys->size);
+	for (k = direct_keys->data; k < end; k++)
+		if (*k == key)
+			break;
+
+	if (state == WL_KEYBOARD_KEY_STATE_RELEASED) {
+		if (k == end)
+			return 1;
+		*k = end[-1];
+		direct_keys->size -= sizeof *k;
+		return 0;
+	}
+
+	if (!context->key_filter.enabled ||
+	    key_filter_outstanding(context, context->key_filter.last_serial) ||
+	    key_filter_matches(context, key))
+		return 1;
+
+	if (k == end) {
+		k = wl_array_add(direct_keys, sizeof *k);
+		if (k)
+			*k = key;
+	}
+
+	return 0;
+}
+
 static void
 input_method_context_grab_key(struct weston_keyboard_grab *grab,
 			      uint32_t time, uint32_t key, uint32_t state_w)
 {
 	struct weston_keyboard *keyboard = grab->keyboard;
+	struct weston_keyboard_grab *default_grab = &keyboard->default_grab;
+	struct input_method_context *context;
 	struct wl_display *display;
 	uint32_t serial;
 
 	if (!keyboard->input_method_resource)
 		return;
 
+	context = keyboard->input_method_resource->data;
+	if (!key_filter_grab_key(context, key, state_w)) {
+		default_grab->interface->key(default_grab, time, key, state_w);
+		return;
+	}
+
 	display = wl_client_get_display(keyboard->input_method_resource->client);
 	serial = wl_display_next_serial(display);
 	wl_keyboard_send_key(keyboard->input_method_resource,
 			     serial, time, key, state_w);
+	context->key_filter.last_serial = serial;
 }
 
 static void
@@ -556,10 +724,31 @@ input_method_context_grab_modifier(struct weston_keyboard_grab *grab, uint32_t s
 				   uint32_t mods_locked, uint32_t group)
 {
 	struct weston_keyboard *keyboard = grab->keyboard;
+	struct weston_keyboard_grab *default_grab = &keyboard->default_grab;
+	struct input_method_context *context;
 
 	if (!keyboard->input_method_resource)
 		return;
 
+	/* With a key filter some keys bypass the input method, so the
+	 * client gets modifier changes from us rather than when the input
+	 * method forwards them, but only after the keys the input method
+	 * still holds. */
+	context = keyboard->input_method_resource->data;
+	if (context->key_filter.enabled ||
+	    context->key_filter.pending_modifiers.size > 0) {
+		if (key_filter_outstanding(context,
+					   context->key_filter.last_serial))
+			key_filter_queue_modifiers(context, serial,
+						   mods_depressed, mods_latched,
+						   mods_locked, group);
+		else
+			default_grab->interface->modifiers(default_grab, serial,
+							   mods_depressed,
+							   mods_latched,
+							   mods_locked, group);
+	}
+
 	wl_keyboard_send_modifiers(keyboard->input_method_resource,
 				   serial, mods_depressed, mods_latched,
 				   mods_locked, group);
@@ -610,7 +799,13 @@ input_method_context_key(struct wl_client *client,
 	struct weston_keyboard *keyboard = seat->keyboard;
 	struct weston_keyboard_grab *default_grab = &keyboard->default_grab;
 
+	/* Modifier changes from before this key was sent to us go first. */
+	if (key_filter_outstanding(context, serial))
+		key_filter_flush_modifiers(context, serial - 1);
+
 	default_grab->interface->key(default_grab, time, key, state_w);
+
+	key_filter_ack(context, serial);
 }
 
 static void
@@ -628,6 +823,10 @@ input_method_context_modifiers(struct wl_client *client,
 	struct weston_keyboard *keyboard = seat->keyboard;
 	struct weston_keyboard_grab *default_grab = &keyboard->default_grab;
 
+	if (context->key_filter.enabled ||
+	    context->key_filter.pending_modifiers.size > 0)
+		return;
+
 	default_grab->interface->modifiers(default_grab,
 					   serial, mods_depressed,
 					   mods_latched, mods_locked,
@@ -656,6 +855,53 @@ input_method_context_text_direction(struct wl_client *client,
 	wl_text_input_send_text_direction(&context->model->resource, serial, direction);
 }
 
+static void
+input_method_context_set_key_filter(struct wl_client *client,
+				    struct wl_resource *resource,
+				    uint32_t serial,
+				    struct wl_array *keysyms,
+				    uint32_t modifiers)
+{
+	struct input_method_context *context = resource->data;
+
+	if (context->version < 2) {
+		wl_resource_post_error(resource,
+				       WL_DISPLAY_ERROR_INVALID_METHOD,
+				       "set_key_filter requires version 2");
+		return;
+	}
+
+	context->key_filter.keysyms.size = 0;
+	if (wl_array_copy(&context->key_filter.keysyms, keysyms) < 0) {
+		wl_resource_post_no_memory(resource);
+		return;
+	}
+	context->key_filter.keysyms.size &= ~(sizeof(uint32_t) - 1);
+
+	context->key_filter.modifiers = modifiers;
+	context->key_filter.enabled = 1;
+
+	key_filter_ack(context, serial);
+}
+
+static void
+input_method_context_clear_key_filter(struct wl_client *client,
+				      struct wl_resource *resource,
+				      uint32_t serial)
+{
+	struct input_method_context *context = resource->data;
+
+	if (context->version < 2) {
+		wl_resource_post_error(resource,
+				       WL_DISPLAY_ERROR_INVALID_METHOD,
+				       "clear_key_filter requires version 2");
+		return;
+	}
+
+	context->key_filter.enabled = 0;
+
+	key_filter_ack(context, serial);
+}
 
 static const struct wl_input_method_context_interface input_method_context_implementation = {
 	input_method_context_destroy,
@@ -671,7 +917,9 @@ static const struct wl_input_method_context_interface input_method_context_imple
 	input_method_context_key,
 	input_method_context_modifiers,
 	input_method_context_language,
-	input_method_context_text_direction
+	input_method_context_text_direction,
+	input_method_context_set_key_filter,
+	input_method_context_clear_key_filter
 };
 
 static void
@@ -683,6 +931,9 @@ destroy_input_method_context(struct wl_resource *resource)
 		wl_resource_destroy(context->keyboard);
 	}
 
+	wl_array_release(&context->key_filter.keysyms);
+	wl_array_release(&context->key_filter.direct_keys);
+	wl_array_release(&context->key_filter.pending_modifiers);
 	free(context);
 }
 
@@ -709,8 +960,13 @@ input_method_context_create(struct text_input *model,
 
 	context->model = model;
 	context->input_method = input_method;
+	context->version = input_method->binding_version;
 	input_method->context = context;
 
+	wl_array_init(&context->key_filter.keysyms);
+	wl_array_init(&context->key_filter.direct_keys);
+	wl_array_init(&context->key_filter.pending_modifiers);
+
 	wl_client_add_resource(input_method->input_method_binding->client, &context->resource);
 
 	wl_input_method_send_activate(input_method->input_method_binding, &context->resource);
@@ -776,6 +1032,7 @@ bind_input_method(struct wl_client *client,
 
 	resource->destroy = unbind_input_method;
 	input_method->input_method_binding = resource;
+	input_method->binding_version = version;
 
 	text_backend->input_method.binding = resource;
 }
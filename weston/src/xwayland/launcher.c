@@ -36,64 +36,77 @@
 #include "xserver-server-protocol.h"
 
 
-static int
-weston_xserver_handle_event(int listen_fd, uint32_t mask, void *data)
+static void
+weston_xserver_spawn(struct weston_xserver *wxs)
 {
-	struct weston_xserver *wxs = data;
-	char display[8], s[8];
-	int sv[2], client_fd;
+	char display[8];
+	char *argv[] = {
+		XSERVER_PATH,
+		display,
+		"-wayland",
+		"-rootless",
+		"-retro",
+		"-nolisten", "all",
+		"-terminate",
+		NULL
+	};
+	int sv[2];
 
 	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) {
 		weston_log("socketpair failed\n");
-		return 1;
+		return;
 	}
 
-	wxs->process.pid = fork();
-	switch (wxs->process.pid) {
-	case 0:
-		/* SOCK_CLOEXEC closes both ends, so we need to unset
-		 * the flag on the client fd. */
-		client_fd = dup(sv[1]);
-		if (client_fd < 0)
-			return 1;
+	snprintf(display, sizeof display, ":%d", wxs->display);
 
-		snprintf(s, sizeof s, "%d", client_fd);
-		setenv("WAYLAND_SOCKET", s, 1);
+	wxs->process.pid = weston_client_spawn(XSERVER_PATH, argv, sv[1]);
+	close(sv[1]);
 
-		snprintf(display, sizeof display, ":%d", wxs->display);
+	/* Either way, stop listening for X clients until the server
+	 * exits.  If it couldn't be started at all, retrying for every
+	 * wakeup of the still readable sockets wouldn't help. */
+	wl_event_source_remove(wxs->abstract_source);
+	wl_event_source_remove(wxs->unix_source);
+	wxs->abstract_source = NULL;
+	wxs->unix_source = NULL;
 
-		if (execl(XSERVER_PATH,
-			  XSERVER_PATH,
-			  display,
-			  "-wayland",
-			  "-rootless",
-			  "-retro",
-			  "-nolisten", "all",
-			  "-terminate",
-			  NULL) < 0)
-			weston_log("exec failed: %m\n");
-		exit(-1);
+	if (wxs->process.pid == -1) {
+		weston_log("failed to spawn X server\n");
+		wxs->process.pid = 0;
+		close(sv[0]);
+		return;
+	}
 
-	default:
-		weston_log("forked X server, pid %d\n", wxs->process.pid);
+	weston_log("spawned X server, pid %d\n", wxs->process.pid);
 
-		close(sv[1]);
-		wxs->client = wl_client_create(wxs->wl_display, sv[0]);
+	wxs->client = wl_client_create(wxs->wl_display, sv[0]);
 
-		weston_watch_process(&wxs->process);
+	weston_watch_process(&wxs->process);
+}
 
-		wl_event_source_remove(wxs->abstract_source);
-		wl_event_source_remove(wxs->unix_source);
-		break;
+static int
+weston_xserver_handle_event(int listen_fd, uint32_t mask, void *data)
+{
+	struct weston_xserver *wxs = data;
 
-	case -1:
-		weston_log( "failed to fork\n");
-		break;
-	}
+	weston_xserver_spawn(wxs);
 
 	return 1;
 }
 
+/* With prestart set, the X server is started as soon as the compositor
+ * has nothing else to do after starting up, rather than when the first X
+ * client connects, so that client doesn't have to wait for it. */
+static void
+weston_xserver_prestart(void *data)
+{
+	struct weston_xserver *wxs = data;
+
+	wxs->prestart_source = NULL;
+	if (wxs->process.pid == 0)
+		weston_xserver_spawn(wxs);
+}
+
 static void
 weston_xserver_shutdown(struct weston_xserver *wxs)
 {
@@ -103,9 +116,13 @@ weston_xserver_shutdown(struct weston_xserver *wxs)
 	unlink(path);
 	snprintf(path, sizeof path, "/tmp/.X11-unix/X%d", wxs->display);
 	unlink(path);
-	if (wxs->process.pid == 0) {
+	if (wxs->abstract_source)
 		wl_event_source_remove(wxs->abstract_source);
+	if (wxs->unix_source)
 		wl_event_source_remove(wxs->unix_source);
+	if (wxs->prestart_source) {
+		wl_event_source_remove(wxs->prestart_source);
+		wxs->prestart_source = NULL;
 	}
 	close(wxs->abstract_fd);
 	close(wxs->unix_fd);
@@ -162,13 +179,14 @@ bind_xserver(struct wl_client *client,
 		wl_client_add_object(client, &xserver_interface,
 				     &xserver_implementation, id, wxs);
 
+	/* The wm hands the X server its listen sockets once it's done
+	 * setting up; without one, X clients still get to connect. */
 	wxs->wm = weston_wm_create(wxs);
 	if (wxs->wm == NULL) {
 		weston_log("failed to create wm\n");
+		xserver_send_listen_socket(wxs->resource, wxs->abstract_fd);
+		xserver_send_listen_socket(wxs->resource, wxs->unix_fd);
 	}
-
-	xserver_send_listen_socket(wxs->resource, wxs->abstract_fd);
-	xserver_send_listen_socket(wxs->resource, wxs->unix_fd);
 }
 
 static int
@@ -321,7 +339,9 @@ module_init(struct weston_compositor *compositor,
 {
 	struct wl_display *display = compositor->wl_display;
 	struct weston_xserver *wxs;
+	struct weston_config_section *section;
 	char lockfile[256], display_name[8];
+	int prestart;
 
 	wxs = malloc(sizeof *wxs);
 	memset(wxs, 0, sizeof *wxs);
@@ -376,6 +396,14 @@ module_init(struct weston_compositor *compositor,
 
 	wl_display_add_global(display, &xserver_interface, wxs, bind_xserver);
 
+	section = weston_config_get_section(compositor->config,
+					    "xwayland", NULL, NULL);
+	weston_config_section_get_bool(section, "prestart", &prestart, 0);
+	if (prestart)
+		wxs->prestart_source =
+			wl_event_loop_add_idle(wxs->loop,
+					       weston_xserver_prestart, wxs);
+
 	wxs->destroy_listener.notify = weston_xserver_destroy;
 	wl_signal_add(&compositor->destroy_signal, &wxs->destroy_listener);
 
@@ -121,6 +121,12 @@ get_wm_window(struct weston_surface *surface);
 static void
 weston_wm_window_schedule_repaint(struct weston_wm_window *window);
 
+static int
+weston_wm_collect_resources(struct weston_wm *wm);
+
+static void
+weston_wm_finish_init(struct weston_wm *wm);
+
 const char *
 get_atom_name(xcb_connection_t *c, xcb_atom_t atom)
 {
@@ -1319,73 +1325,181 @@ weston_wm_handle_leave(struct weston_wm *wm, xcb_generic_event_t *event)
 	weston_wm_window_set_cursor(wm, window->frame_id, XWM_CURSOR_LEFT_PTR);
 }
 
+static void
+weston_wm_dispatch_event(struct weston_wm *wm, xcb_generic_event_t *event)
+{
+	if (weston_wm_handle_selection_event(wm, event))
+		return;
+
+	switch (event->response_type & ~0x80) {
+	case XCB_BUTTON_PRESS:
+	case XCB_BUTTON_RELEASE:
+		weston_wm_handle_button(wm, event);
+		break;
+	case XCB_ENTER_NOTIFY:
+		weston_wm_handle_enter(wm, event);
+		break;
+	case XCB_LEAVE_NOTIFY:
+		weston_wm_handle_leave(wm, event);
+		break;
+	case XCB_MOTION_NOTIFY:
+		weston_wm_handle_motion(wm, event);
+		break;
+	case XCB_CREATE_NOTIFY:
+		weston_wm_handle_create_notify(wm, event);
+		break;
+	case XCB_MAP_REQUEST:
+		weston_wm_handle_map_request(wm, event);
+		break;
+	case XCB_MAP_NOTIFY:
+		weston_wm_handle_map_notify(wm, event);
+		break;
+	case XCB_UNMAP_NOTIFY:
+		weston_wm_handle_unmap_notify(wm, event);
+		break;
+	case XCB_REPARENT_NOTIFY:
+		weston_wm_handle_reparent_notify(wm, event);
+		break;
+	case XCB_CONFIGURE_REQUEST:
+		weston_wm_handle_configure_request(wm, event);
+		break;
+	case XCB_CONFIGURE_NOTIFY:
+		weston_wm_handle_configure_notify(wm, event);
+		break;
+	case XCB_DESTROY_NOTIFY:
+		weston_wm_handle_destroy_notify(wm, event);
+		break;
+	case XCB_MAPPING_NOTIFY:
+		weston_log("XCB_MAPPING_NOTIFY\n");
+		break;
+	case XCB_PROPERTY_NOTIFY:
+		weston_wm_handle_property_notify(wm, event);
+		break;
+	case XCB_CLIENT_MESSAGE:
+		weston_wm_handle_client_message(wm, event);
+		break;
+	}
+}
+
+/* Motion, configure and property notifies only update state that a
+ * later event of the same kind for the same window (and property)
+ * overwrites, so when the batch has one of those, the earlier one is
+ * dropped.  Property notifies for the selection window drive the INCR
+ * transfers and all have to be handled. */
 static int
-weston_wm_handle_event(int fd, uint32_t mask, void *data)
+weston_wm_event_superseded(struct weston_wm *wm,
+			   xcb_generic_event_t **events, int i, int count)
 {
-	struct weston_wm *wm = data;
-	xcb_generic_event_t *event;
-	int count = 0;
+	xcb_motion_notify_event_t *motion, *later_motion;
+	xcb_configure_notify_event_t *configure, *later_configure;
+	xcb_property_notify_event_t *property, *later_property;
+	uint8_t type = events[i]->response_type & ~0x80;
+	int j;
+
+	switch (type) {
+	case XCB_MOTION_NOTIFY:
+	case XCB_CONFIGURE_NOTIFY:
+		break;
+	case XCB_PROPERTY_NOTIFY:
+		property = (xcb_property_notify_event_t *) events[i];
+		if (property->window == wm->selection_window)
+			return 0;
+		break;
+	default:
+		return 0;
+	}
 
-	while (event = xcb_poll_for_event(wm->conn), event != NULL) {
-		if (weston_wm_handle_selection_event(wm, event)) {
-			free(event);
-			count++;
+	for (j = i + 1; j < count; j++) {
+		if ((events[j]->response_type & ~0x80) != type)
 			continue;
-		}
 
-		switch (event->response_type & ~0x80) {
-		case XCB_BUTTON_PRESS:
-		case XCB_BUTTON_RELEASE:
-			weston_wm_handle_button(wm, event);
-			break;
-		case XCB_ENTER_NOTIFY:
-			weston_wm_handle_enter(wm, event);
-			break;
-		case XCB_LEAVE_NOTIFY:
-			weston_wm_handle_leave(wm, event);
-			break;
+		switch (type) {
 		case XCB_MOTION_NOTIFY:
-			weston_wm_handle_motion(wm, event);
-			break;
-		case XCB_CREATE_NOTIFY:
-			weston_wm_handle_create_notify(wm, event);
-			break;
-		case XCB_MAP_REQUEST:
-			weston_wm_handle_map_request(wm, event);
-			break;
-		case XCB_MAP_NOTIFY:
-			weston_wm_handle_map_notify(wm, event);
-			break;
-		case XCB_UNMAP_NOTIFY:
-			weston_wm_handle_unmap_notify(wm, event);
-			break;
-		case XCB_REPARENT_NOTIFY:
-			weston_wm_handle_reparent_notify(wm, event);
-			break;
-		case XCB_CONFIGURE_REQUEST:
-			weston_wm_handle_configure_request(wm, event);
+			motion = (xcb_motion_notify_event_t *) events[i];
+			later_motion = (xcb_motion_notify_event_t *) events[j];
+			if (later_motion->event == motion->event)
+				return 1;
 			break;
 		case XCB_CONFIGURE_NOTIFY:
-			weston_wm_handle_configure_notify(wm, event);
-			break;
-		case XCB_DESTROY_NOTIFY:
-			weston_wm_handle_destroy_notify(wm, event);
-			break;
-		case XCB_MAPPING_NOTIFY:
-			weston_log("XCB_MAPPING_NOTIFY\n");
+			configure = (xcb_configure_notify_event_t *) events[i];
+			later_configure =
+				(xcb_configure_notify_event_t *) events[j];
+			if (later_configure->event == configure->event &&
+			    later_configure->window == configure->window)
+				return 1;
 			break;
 		case XCB_PROPERTY_NOTIFY:
-			weston_wm_handle_property_notify(wm, event);
-			break;
-		case XCB_CLIENT_MESSAGE:
-			weston_wm_handle_client_message(wm, event);
+			property = (xcb_property_notify_event_t *) events[i];
+			later_property =
+				(xcb_property_notify_event_t *) events[j];
+			if (later_property->window == property->window &&
+			    later_property->atom == property->atom)
+				return 1;
 			break;
 		}
+	}
+
+	return 0;
+}
 
-		free(event);
-		count++;
+static int
+weston_wm_process_events(struct weston_wm *wm)
+{
+	xcb_generic_event_t **events = wm->events.data;
+	int i, count = wm->events.size / sizeof *events;
+
+	for (i = 0; i < count; i++) {
+		if (!weston_wm_event_superseded(wm, events, i, count))
+			weston_wm_dispatch_event(wm, events[i]);
+		free(events[i]);
 	}
 
+	wm->events.size = 0;
+
+	return count;
+}
+
+static int
+weston_wm_handle_event(int fd, uint32_t mask, void *data)
+{
+	struct weston_wm *wm = data;
+	xcb_generic_event_t *event, **p;
+	int processed, ret, count = 0;
+
+	/* No events are selected until the replies to the requests sent
+	 * at startup are all in, so there's nothing else to do yet. */
+	if (wm->init) {
+		ret = weston_wm_collect_resources(wm);
+		if (ret < 0) {
+			weston_log("lost the X connection while starting wm\n");
+			wm->server->wm = NULL;
+			weston_wm_destroy(wm);
+			return 0;
+		}
+		if (ret == 0)
+			return 0;
+		weston_wm_finish_init(wm);
+	}
+
+	/* Handling the batch may read more events off the connection
+	 * while waiting for replies, so keep going until it's empty. */
+	do {
+		while (event = xcb_poll_for_event(wm->conn), event != NULL) {
+			p = wl_array_add(&wm->events, sizeof *p);
+			if (p == NULL) {
+				count += weston_wm_process_events(wm);
+				weston_wm_dispatch_event(wm, event);
+				free(event);
+				count++;
+				continue;
+			}
+			*p = event;
+		}
+
+		processed = weston_wm_process_events(wm);
+		count += processed;
+	} while (processed > 0);
+
 	xcb_flush(wm->conn);
 
 	return count;
@@ -1421,108 +1535,105 @@ weston_wm_get_visual_and_colormap(struct weston_wm *wm)
 			    wm->colormap, wm->screen->root, wm->visual_id);
 }
 
-static void
-weston_wm_get_resources(struct weston_wm *wm)
-{
-
 #define F(field) offsetof(struct weston_wm, field)
 
-	static const struct { const char *name; int offset; } atoms[] = {
-		{ "WM_PROTOCOLS",	F(atom.wm_protocols) },
-		{ "WM_TAKE_FOCUS",	F(atom.wm_take_focus) },
-		{ "WM_DELETE_WINDOW",	F(atom.wm_delete_window) },
-		{ "WM_STATE",		F(atom.wm_state) },
-		{ "WM_S0",		F(atom.wm_s0) },
-		{ "WM_CLIENT_MACHINE",	F(atom.wm_client_machine) },
-		{ "_NET_WM_NAME",	F(atom.net_wm_name) },
-		{ "_NET_WM_PID",	F(atom.net_wm_pid) },
-		{ "_NET_WM_ICON",	F(atom.net_wm_icon) },
-		{ "_NET_WM_STATE",	F(atom.net_wm_state) },
-		{ "_NET_WM_STATE_FULLSCREEN", F(atom.net_wm_state_fullscreen) },
-		{ "_NET_WM_USER_TIME", F(atom.net_wm_user_time) },
-		{ "_NET_WM_ICON_NAME", F(atom.net_wm_icon_name) },
-		{ "_NET_WM_WINDOW_TYPE", F(atom.net_wm_window_type) },
-
-		{ "_NET_WM_WINDOW_TYPE_DESKTOP", F(atom.net_wm_window_type_desktop) },
-		{ "_NET_WM_WINDOW_TYPE_DOCK", F(atom.net_wm_window_type_dock) },
-		{ "_NET_WM_WINDOW_TYPE_TOOLBAR", F(atom.net_wm_window_type_toolbar) },
-		{ "_NET_WM_WINDOW_TYPE_MENU", F(atom.net_wm_window_type_menu) },
-		{ "_NET_WM_WINDOW_TYPE_UTILITY", F(atom.net_wm_window_type_utility) },
-		{ "_NET_WM_WINDOW_TYPE_SPLASH", F(atom.net_wm_window_type_splash) },
-		{ "_NET_WM_WINDOW_TYPE_DIALOG", F(atom.net_wm_window_type_dialog) },
-		{ "_NET_WM_WINDOW_TYPE_DROPDOWN_MENU", F(atom.net_wm_window_type_dropdown) },
-		{ "_NET_WM_WINDOW_TYPE_POPUP_MENU", F(atom.net_wm_window_type_popup) },
-		{ "_NET_WM_WINDOW_TYPE_TOOLTIP", F(atom.net_wm_window_type_tooltip) },
-		{ "_NET_WM_WINDOW_TYPE_NOTIFICATION", F(atom.net_wm_window_type_notification) },
-		{ "_NET_WM_WINDOW_TYPE_COMBO", F(atom.net_wm_window_type_combo) },
-		{ "_NET_WM_WINDOW_TYPE_DND", F(atom.net_wm_window_type_dnd) },
-		{ "_NET_WM_WINDOW_TYPE_NORMAL",	F(atom.net_wm_window_type_normal) },
-
-		{ "_NET_WM_MOVERESIZE", F(atom.net_wm_moveresize) },
-		{ "_NET_SUPPORTING_WM_CHECK",
-					F(atom.net_supporting_wm_check) },
-		{ "_NET_SUPPORTED",     F(atom.net_supported) },
-		{ "_MOTIF_WM_HINTS",	F(atom.motif_wm_hints) },
-		{ "CLIPBOARD",		F(atom.clipboard) },
-		{ "CLIPBOARD_MANAGER",	F(atom.clipboard_manager) },
-		{ "TARGETS",		F(atom.targets) },
-		{ "UTF8_STRING",	F(atom.utf8_string) },
-		{ "_WL_SELECTION",	F(atom.wl_selection) },
-		{ "INCR",		F(atom.incr) },
-		{ "TIMESTAMP",		F(atom.timestamp) },
-		{ "MULTIPLE",		F(atom.multiple) },
-		{ "UTF8_STRING"	,	F(atom.utf8_string) },
-		{ "COMPOUND_TEXT",	F(atom.compound_text) },
-		{ "TEXT",		F(atom.text) },
-		{ "STRING",		F(atom.string) },
-		{ "text/plain;charset=utf-8",	F(atom.text_plain_utf8) },
-		{ "text/plain",		F(atom.text_plain) },
-	};
+static const struct { const char *name; int offset; } atoms[] = {
+	{ "WM_PROTOCOLS",	F(atom.wm_protocols) },
+	{ "WM_TAKE_FOCUS",	F(atom.wm_take_focus) },
+	{ "WM_DELETE_WINDOW",	F(atom.wm_delete_window) },
+	{ "WM_STATE",		F(atom.wm_state) },
+	{ "WM_S0",		F(atom.wm_s0) },
+	{ "WM_CLIENT_MACHINE",	F(atom.wm_client_machine) },
+	{ "_NET_WM_NAME",	F(atom.net_wm_name) },
+	{ "_NET_WM_PID",	F(atom.net_wm_pid) },
+	{ "_NET_WM_ICON",	F(atom.net_wm_icon) },
+	{ "_NET_WM_STATE",	F(atom.net_wm_state) },
+	{ "_NET_WM_STATE_FULLSCREEN", F(atom.net_wm_state_fullscreen) },
+	{ "_NET_WM_USER_TIME", F(atom.net_wm_user_time) },
+	{ "_NET_WM_ICON_NAME", F(atom.net_wm_icon_name) },
+	{ "_NET_WM_WINDOW_TYPE", F(atom.net_wm_window_type) },
+
+	{ "_NET_WM_WINDOW_TYPE_DESKTOP", F(atom.net_wm_window_type_desktop) },
+	{ "_NET_WM_WINDOW_TYPE_DOCK", F(atom.net_wm_window_type_dock) },
+	{ "_NET_WM_WINDOW_TYPE_TOOLBAR", F(atom.net_wm_window_type_toolbar) },
+	{ "_NET_WM_WINDOW_TYPE_MENU", F(atom.net_wm_window_type_menu) },
+	{ "_NET_WM_WINDOW_TYPE_UTILITY", F(atom.net_wm_window_type_utility) },
+	{ "_NET_WM_WINDOW_TYPE_SPLASH", F(atom.net_wm_window_type_splash) },
+	{ "_NET_WM_WINDOW_TYPE_DIALOG", F(atom.net_wm_window_type_dialog) },
+	{ "_NET_WM_WINDOW_TYPE_DROPDOWN_MENU", F(atom.net_wm_window_type_dropdown) },
+	{ "_NET_WM_WINDOW_TYPE_POPUP_MENU", F(atom.net_wm_window_type_popup) },
+	{ "_NET_WM_WINDOW_TYPE_TOOLTIP", F(atom.net_wm_window_type_tooltip) },
+	{ "_NET_WM_WINDOW_TYPE_NOTIFICATION", F(atom.net_wm_window_type_notification) },
+	{ "_NET_WM_WINDOW_TYPE_COMBO", F(atom.net_wm_window_type_combo) },
+	{ "_NET_WM_WINDOW_TYPE_DND", F(atom.net_wm_window_type_dnd) },
+	{ "_NET_WM_WINDOW_TYPE_NORMAL",	F(atom.net_wm_window_type_normal) },
+
+	{ "_NET_WM_MOVERESIZE", F(atom.net_wm_moveresize) },
+	{ "_NET_SUPPORTING_WM_CHECK",
+				F(atom.net_supporting_wm_check) },
+	{ "_NET_SUPPORTED",     F(atom.net_supported) },
+	{ "_MOTIF_WM_HINTS",	F(atom.motif_wm_hints) },
+	{ "CLIPBOARD",		F(atom.clipboard) },
+	{ "CLIPBOARD_MANAGER",	F(atom.clipboard_manager) },
+	{ "TARGETS",		F(atom.targets) },
+	{ "UTF8_STRING",	F(atom.utf8_string) },
+	{ "_WL_SELECTION",	F(atom.wl_selection) },
+	{ "INCR",		F(atom.incr) },
+	{ "TIMESTAMP",		F(atom.timestamp) },
+	{ "MULTIPLE",		F(atom.multiple) },
+	{ "UTF8_STRING"	,	F(atom.utf8_string) },
+	{ "COMPOUND_TEXT",	F(atom.compound_text) },
+	{ "TEXT",		F(atom.text) },
+	{ "STRING",		F(atom.string) },
+	{ "text/plain;charset=utf-8",	F(atom.text_plain_utf8) },
+	{ "text/plain",		F(atom.text_plain) },
+};
 #undef F
 
-	xcb_xfixes_query_version_cookie_t xfixes_cookie;
-	xcb_xfixes_query_version_reply_t *xfixes_reply;
-	xcb_intern_atom_cookie_t cookies[ARRAY_LENGTH(atoms)];
-	xcb_intern_atom_reply_t *reply;
-	xcb_render_query_pict_formats_reply_t *formats_reply;
+/* Everything the wm needs to know about the server before it can start
+ * managing windows is requested up front and the replies are collected
+ * as they come in from the event loop, so that starting the wm doesn't
+ * block the compositor on a round trip per request. */
+struct weston_wm_init {
 	xcb_render_query_pict_formats_cookie_t formats_cookie;
-	xcb_render_pictforminfo_t *formats;
-	uint32_t i;
+	xcb_intern_atom_cookie_t atom_cookies[ARRAY_LENGTH(atoms)];
+	xcb_xfixes_query_version_cookie_t xfixes_cookie;
+	uint32_t next_reply;
+};
 
-	xcb_prefetch_extension_data (wm->conn, &xcb_xfixes_id);
+static int
+weston_wm_send_resource_requests(struct weston_wm *wm)
+{
+	struct weston_wm_init *init;
+	uint32_t i;
 
-	formats_cookie = xcb_render_query_pict_formats(wm->conn);
+	init = malloc(sizeof *init);
+	if (init == NULL)
+		return -1;
 
-	for (i = 0; i < ARRAY_LENGTH(atoms); i++)
-		cookies[i] = xcb_intern_atom (wm->conn, 0,
-					      strlen(atoms[i].name),
-					      atoms[i].name);
+	memset(init, 0, sizeof *init);
 
-	for (i = 0; i < ARRAY_LENGTH(atoms); i++) {
-		reply = xcb_intern_atom_reply (wm->conn, cookies[i], NULL);
-		*(xcb_atom_t *) ((char *) wm + atoms[i].offset) = reply->atom;
-		free(reply);
-	}
+	xcb_prefetch_extension_data (wm->conn, &xcb_xfixes_id);
 
-	wm->xfixes = xcb_get_extension_data(wm->conn, &xcb_xfixes_id);
-	if (!wm->xfixes || !wm->xfixes->present)
-		weston_log("xfixes not available\n");
+	init->formats_cookie = xcb_render_query_pict_formats(wm->conn);
 
-	xfixes_cookie = xcb_xfixes_query_version(wm->conn,
-						 XCB_XFIXES_MAJOR_VERSION,
-						 XCB_XFIXES_MINOR_VERSION);
-	xfixes_reply = xcb_xfixes_query_version_reply(wm->conn,
-						      xfixes_cookie, NULL);
+	for (i = 0; i < ARRAY_LENGTH(atoms); i++)
+		init->atom_cookies[i] =
+			xcb_intern_atom (wm->conn, 0,
+					 strlen(atoms[i].name), atoms[i].name);
 
-	weston_log("xfixes version: %d.%d\n",
-	       xfixes_reply->major_version, xfixes_reply->minor_version);
+	xcb_flush(wm->conn);
+	wm->init = init;
 
-	free(xfixes_reply);
+	return 0;
+}
 
-	formats_reply = xcb_render_query_pict_formats_reply(wm->conn,
-							    formats_cookie, 0);
-	if (formats_reply == NULL)
-		return;
+static void
+weston_wm_handle_formats(struct weston_wm *wm,
+			 xcb_render_query_pict_formats_reply_t *formats_reply)
+{
+	xcb_render_pictforminfo_t *formats;
+	uint32_t i;
 
 	formats = xcb_render_query_pict_formats_formats(formats_reply);
 	for (i = 0; i < formats_reply->num_formats; i++) {
@@ -1538,8 +1649,94 @@ weston_wm_get_resources(struct weston_wm *wm)
 		    formats[i].direct.alpha_shift == 24)
 			wm->format_rgba = formats[i];
 	}
+}
+
+static void
+weston_wm_handle_xfixes(struct weston_wm *wm)
+{
+	struct weston_wm_init *init = wm->init;
+
+	/* The extension reply came in ahead of the formats, so this
+	 * doesn't wait for it. */
+	wm->xfixes = xcb_get_extension_data(wm->conn, &xcb_xfixes_id);
+	if (!wm->xfixes || !wm->xfixes->present) {
+		weston_log("xfixes not available\n");
+		return;
+	}
+
+	init->xfixes_cookie =
+		xcb_xfixes_query_version(wm->conn,
+					 XCB_XFIXES_MAJOR_VERSION,
+					 XCB_XFIXES_MINOR_VERSION);
+	xcb_flush(wm->conn);
+}
+
+/* Returns 1 once all replies are in, 0 while some are still outstanding
+ * and -1 if the connection broke before they came in.  The replies come
+ * in the order the requests were sent in: the render formats, then the
+ * atoms, then the xfixes version, which is only requested once the
+ * formats are in. */
+static int
+weston_wm_collect_resources(struct weston_wm *wm)
+{
+	struct weston_wm_init *init = wm->init;
+	xcb_render_query_pict_formats_reply_t *formats_reply;
+	xcb_xfixes_query_version_reply_t *xfixes_reply;
+	xcb_intern_atom_reply_t *atom_reply;
+	xcb_generic_error_t *error;
+	uint32_t sequence, i;
+	void *reply;
+
+	while (init->next_reply <= ARRAY_LENGTH(atoms) + 1) {
+		i = init->next_reply;
+		if (i == 0)
+			sequence = init->formats_cookie.sequence;
+		else if (i <= ARRAY_LENGTH(atoms))
+			sequence = init->atom_cookies[i - 1].sequence;
+		else if (init->xfixes_cookie.sequence)
+			sequence = init->xfixes_cookie.sequence;
+		else
+			break;
+
+		reply = NULL;
+		error = NULL;
+		if (!xcb_poll_for_reply(wm->conn, sequence, &reply, &error)) {
+			if (xcb_connection_has_error(wm->conn))
+				return -1;
+			return 0;
+		}
+		free(error);
+
+		if (i == 0) {
+			formats_reply = reply;
+			if (formats_reply)
+				weston_wm_handle_formats(wm, formats_reply);
+			weston_wm_handle_xfixes(wm);
+		} else if (i <= ARRAY_LENGTH(atoms)) {
+			atom_reply = reply;
+			if (atom_reply)
+				*(xcb_atom_t *) ((char *) wm +
+						 atoms[i - 1].offset) =
+					atom_reply->atom;
+			else
+				weston_log("failed to intern atom %s\n",
+					   atoms[i - 1].name);
+		} else {
+			xfixes_reply = reply;
+			if (xfixes_reply)
+				weston_log("xfixes version: %d.%d\n",
+					   xfixes_reply->major_version,
+					   xfixes_reply->minor_version);
+		}
+
+		free(reply);
+		init->next_reply++;
+	}
 
-	free(formats_reply);
+	free(init);
+	wm->init = NULL;
+
+	return 1;
 }
 
 static void
@@ -1591,15 +1788,65 @@ weston_wm_create_wm_window(struct weston_wm *wm)
 				XCB_TIME_CURRENT_TIME);
 }
 
+static void
+weston_wm_finish_init(struct weston_wm *wm)
+{
+	struct weston_xserver *wxs = wm->server;
+	uint32_t values[1];
+	xcb_atom_t supported[3];
+
+	weston_wm_get_visual_and_colormap(wm);
+
+	values[0] =
+		XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY |
+		XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT |
+		XCB_EVENT_MASK_PROPERTY_CHANGE;
+	xcb_change_window_attributes(wm->conn, wm->screen->root,
+				     XCB_CW_EVENT_MASK, values);
+	wm->theme = theme_create();
+
+	weston_wm_create_wm_window(wm);
+
+	supported[0] = wm->atom.net_wm_moveresize;
+	supported[1] = wm->atom.net_wm_state;
+	supported[2] = wm->atom.net_wm_state_fullscreen;
+	xcb_change_property(wm->conn,
+			    XCB_PROP_MODE_REPLACE,
+			    wm->screen->root,
+			    wm->atom.net_supported,
+			    XCB_ATOM_ATOM,
+			    32, /* format */
+			    ARRAY_LENGTH(supported), supported);
+
+	weston_wm_selection_init(wm);
+
+	wm->activate_listener.notify = weston_wm_window_activate;
+	wl_signal_add(&wxs->compositor->activate_signal,
+		      &wm->activate_listener);
+	wm->kill_listener.notify = weston_wm_kill_client;
+	wl_signal_add(&wxs->compositor->kill_signal,
+		      &wm->kill_listener);
+
+	weston_wm_create_cursors(wm);
+	weston_wm_window_set_cursor(wm, wm->screen->root, XWM_CURSOR_LEFT_PTR);
+
+	xcb_flush(wm->conn);
+
+	/* Only let X clients connect once we're redirecting the root
+	 * window, or their windows would get mapped unmanaged. */
+	xserver_send_listen_socket(wxs->resource, wxs->abstract_fd);
+	xserver_send_listen_socket(wxs->resource, wxs->unix_fd);
+
+	weston_log("created wm\n");
+}
+
 struct weston_wm *
 weston_wm_create(struct weston_xserver *wxs)
 {
 	struct weston_wm *wm;
 	struct wl_event_loop *loop;
 	xcb_screen_iterator_t s;
-	uint32_t values[1];
 	int sv[2];
-	xcb_atom_t supported[3];
 
 	wm = malloc(sizeof *wm);
 	if (wm == NULL)
@@ -1607,6 +1854,7 @@ weston_wm_create(struct weston_xserver *wxs)
 
 	memset(wm, 0, sizeof *wm);
 	wm->server = wxs;
+	wl_array_init(&wm->events);
 	wm->window_hash = hash_table_create();
 	if (wm->window_hash == NULL) {
 		free(wm);
@@ -1642,47 +1890,19 @@ weston_wm_create(struct weston_xserver *wxs)
 		wl_event_loop_add_fd(loop, sv[0],
 				     WL_EVENT_READABLE,
 				     weston_wm_handle_event, wm);
-	wl_event_source_check(wm->source);
-
-	weston_wm_get_resources(wm);
-	weston_wm_get_visual_and_colormap(wm);
-
-	values[0] =
-		XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY |
-		XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT |
-		XCB_EVENT_MASK_PROPERTY_CHANGE;
-	xcb_change_window_attributes(wm->conn, wm->screen->root,
-				     XCB_CW_EVENT_MASK, values);
-	wm->theme = theme_create();
-
-	weston_wm_create_wm_window(wm);
-
-	supported[0] = wm->atom.net_wm_moveresize;
-	supported[1] = wm->atom.net_wm_state;
-	supported[2] = wm->atom.net_wm_state_fullscreen;
-	xcb_change_property(wm->conn,
-			    XCB_PROP_MODE_REPLACE,
-			    wm->screen->root,
-			    wm->atom.net_supported,
-			    XCB_ATOM_ATOM,
-			    32, /* format */
-			    ARRAY_LENGTH(supported), supported);
 
-	weston_wm_selection_init(wm);
-
-	xcb_flush(wm->conn);
-
-	wm->activate_listener.notify = weston_wm_window_activate;
-	wl_signal_add(&wxs->compositor->activate_signal,
-		      &wm->activate_listener);
-	wm->kill_listener.notify = weston_wm_kill_client;
-	wl_signal_add(&wxs->compositor->kill_signal,
-		      &wm->kill_listener);
-
-	weston_wm_create_cursors(wm);
-	weston_wm_window_set_cursor(wm, wm->screen->root, XWM_CURSOR_LEFT_PTR);
+	if (weston_wm_send_resource_requests(wm) < 0) {
+		weston_log("failed to start wm\n");
+		wl_event_source_remove(wm->source);
+		xcb_disconnect(wm->conn);
+		hash_table_destroy(wm->window_hash);
+		free(wm);
+		return NULL;
+	}
 
-	weston_log("created wm\n");
+	/* The rest of the setup happens in weston_wm_finish_init() once
+	 * the replies are in. */
+	wl_event_source_check(wm->source);
 
 	return wm;
 }
@@ -1692,12 +1912,16 @@ weston_wm_destroy(struct weston_wm *wm)
 {
 	/* FIXME: Free windows in hash. */
 	hash_table_destroy(wm->window_hash);
-	weston_wm_destroy_cursors(wm);
+	if (wm->init == NULL) {
+		weston_wm_destroy_cursors(wm);
+		wl_list_remove(&wm->selection_listener.link);
+		wl_list_remove(&wm->activate_listener.link);
+		wl_list_remove(&wm->kill_listener.link);
+	}
+	free(wm->init);
+	wl_array_release(&wm->events);
 	xcb_disconnect(wm->conn);
 	wl_event_source_remove(wm->source);
-	wl_list_remove(&wm->selection_listener.link);
-	wl_list_remove(&wm->activate_listener.link);
-	wl_list_remove(&wm->kill_listener.link);
 
 	free(wm);
 }
@@ -35,6 +35,7 @@ struct weston_xserver {
 	struct wl_event_source *abstract_source;
 	int unix_fd;
 	struct wl_event_source *unix_source;
+	struct wl_event_source *prestart_source;
 	int display;
 	struct weston_process process;
 	struct wl_resource *resource;
@@ -44,10 +45,14 @@ struct weston_xserver {
 	struct wl_listener destroy_listener;
 };
 
+struct weston_wm_init;
+
 struct weston_wm {
 	xcb_connection_t *conn;
+	struct weston_wm_init *init;
 	const xcb_query_extension_reply_t *xfixes;
 	struct wl_event_source *source;
+	struct wl_array events;
 	xcb_screen_t *screen;
 	struct hash_table *window_hash;
 	struct weston_xserver *server;
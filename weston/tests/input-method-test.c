@@ -0,0 +1,495 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Runs against weston-test-im, see input-method-test.ini. The input
+ * method filters for the 'a' keysym, so KEY_A goes through it and
+ * KEY_B does not. */
+
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/input.h>
+#include "weston-test-client-helper.h"
+#include "../clients/text-client-protocol.h"
+
+struct input_method_state {
+	int ready;
+	int done;
+	int keys;
+};
+
+static void
+text_input_commit_string(void *data,
+			 struct wl_text_input *text_input,
+			 uint32_t serial,
+			 const char *text)
+{
+	struct input_method_state *state = data;
+
+	if (strcmp(text, "ready") == 0)
+		state->ready += 1;
+	else if (strcmp(text, "done") == 0)
+		state->done += 1;
+	else if (strcmp(text, "key") == 0)
+		state->keys += 1;
+}
+
+static void
+text_input_preedit_string(void *data,
+			  struct wl_text_input *text_input,
+			  uint32_t serial,
+			  const char *text,
+			  const char *commit)
+{
+}
+
+static void
+text_input_delete_surrounding_text(void *data,
+				   struct wl_text_input *text_input,
+				   int32_t index,
+				   uint32_t length)
+{
+}
+
+static void
+text_input_cursor_position(void *data,
+			   struct wl_text_input *text_input,
+			   int32_t index,
+			   int32_t anchor)
+{
+}
+
+static void
+text_input_preedit_styling(void *data,
+			   struct wl_text_input *text_input,
+			   uint32_t index,
+			   uint32_t length,
+			   uint32_t style)
+{
+}
+
+static void
+text_input_preedit_cursor(void *data,
+			  struct wl_text_input *text_input,
+			  int32_t index)
+{
+}
+
+static void
+text_input_modifiers_map(void *data,
+			 struct wl_text_input *text_input,
+			 struct wl_array *map)
+{
+}
+
+static void
+text_input_keysym(void *data,
+		  struct wl_text_input *text_input,
+		  uint32_t serial,
+		  uint32_t time,
+		  uint32_t sym,
+		  uint32_t state,
+		  uint32_t modifiers)
+{
+}
+
+static void
+text_input_enter(void *data,
+		 struct wl_text_input *text_input,
+		 struct wl_surface *surface)
+{
+}
+
+static void
+text_input_leave(void *data,
+		 struct wl_text_input *text_input)
+{
+}
+
+static void
+text_input_input_panel_state(void *data,
+			     struct wl_text_input *text_input,
+			     uint32_t state)
+{
+}
+
+static void
+text_input_language(void *data,
+		    struct wl_text_input *text_input,
+		    uint32_t serial,
+		    const char *language)
+{
+}
+
+static void
+text_input_text_direction(void *data,
+			  struct wl_text_input *text_input,
+			  uint32_t serial,
+			  uint32_t direction)
+{
+}
+
+static const struct wl_text_input_listener text_input_listener = {
+	text_input_enter,
+	text_input_leave,
+	text_input_modifiers_map,
+	text_input_input_panel_state,
+	text_input_preedit_string,
+	text_input_preedit_styling,
+	text_input_preedit_cursor,
+	text_input_commit_string,
+	text_input_cursor_position,
+	text_input_delete_surrounding_text,
+	text_input_keysym,
+	text_input_language,
+	text_input_text_direction
+};
+
+static void
+wait_for(struct client *client, int *counter, int value)
+{
+	while (*counter < value)
+		assert(wl_display_dispatch(client->wl_display) >= 0);
+}
+
+/* Activates a text input on the client surface and waits until the
+ * input method has grabbed the keyboard. The compositor starts the
+ * input method along with itself, and only an input method that is
+ * already bound gets activated, so keep trying for a while. */
+static struct wl_text_input *
+activate_input_method(struct client *client, struct input_method_state *state)
+{
+	struct global *global;
+	struct wl_text_input_manager *factory;
+	struct wl_text_input *text_input;
+	int i;
+
+	factory = NULL;
+	wl_list_for_each(global, &client->global_list, link) {
+		if (strcmp(global->interface, "wl_text_input_manager") == 0)
+			factory = wl_registry_bind(client->wl_registry,
+						   global->name,
+						   &wl_text_input_manager_interface, 1);
+	}
+
+	assert(factory);
+
+	memset(state, 0, sizeof *state);
+	text_input = wl_text_input_manager_create_text_input(factory);
+	wl_text_input_add_listener(text_input, &text_input_listener, state);
+
+	wl_test_activate_surface(client->test->wl_test,
+				 client->surface->wl_surface);
+	client_roundtrip(client);
+	assert(client->input->keyboard->focus == client->surface);
+
+	for (i = 0; !state->ready; i++) {
+		assert(i < 500);
+
+		if (i % 50 == 0) {
+			wl_text_input_deactivate(text_input,
+						 client->input->wl_seat);
+			wl_text_input_activate(text_input,
+					       client->input->wl_seat,
+					       client->surface->wl_surface);
+		}
+
+		usleep(10000);
+		client_roundtrip(client);
+	}
+
+	return text_input;
+}
+
+static void
+send_command(struct client *client, struct wl_text_input *text_input,
+	     struct input_method_state *state, const char *command)
+{
+	int done = state->done;
+
+	wl_text_input_set_surrounding_text(text_input, command, 0, 0);
+	wait_for(client, &state->done, done + 1);
+}
+
+static void
+send_key(struct client *client, uint32_t key, uint32_t state)
+{
+	wl_test_send_key(client->test->wl_test, key, state);
+}
+
+#ifndef INPUT_METHOD_V1
+
+TEST(key_filter_bypass)
+{
+	struct client *client;
+	struct keyboard *keyboard;
+	struct wl_text_input *text_input;
+	struct input_method_state state;
+
+	client = client_create(100, 100, 100, 100);
+	assert(client);
+	keyboard = client->input->keyboard;
+	text_input = activate_input_method(client, &state);
+
+	/* Not in the filter, straight to the client. */
+	send_key(client, KEY_B, WL_KEYBOARD_KEY_STATE_PRESSED);
+	client_roundtrip(client);
+	assert(keyboard->key == KEY_B);
+	assert(keyboard->state == WL_KEYBOARD_KEY_STATE_PRESSED);
+
+	send_key(client, KEY_B, WL_KEYBOARD_KEY_STATE_RELEASED);
+	client_roundtrip(client);
+	assert(keyboard->key == KEY_B);
+	assert(keyboard->state == WL_KEYBOARD_KEY_STATE_RELEASED);
+	assert(state.keys == 0);
+
+	/* In the filter, through the input method. */
+	send_key(client, KEY_A, WL_KEYBOARD_KEY_STATE_PRESSED);
+	send_key(client, KEY_A, WL_KEYBOARD_KEY_STATE_RELEASED);
+	wait_for(client, &state.keys, 2);
+	assert(keyboard->key == KEY_A);
+	assert(keyboard->state == WL_KEYBOARD_KEY_STATE_RELEASED);
+
+	wl_text_input_destroy(text_input);
+}
+
+TEST(key_filter_pairs_release_with_press)
+{
+	struct client *client;
+	struct keyboard *keyboard;
+	struct wl_text_input *text_input;
+	struct input_method_state state;
+
+	client = client_create(100, 100, 100, 100);
+	assert(client);
+	keyboard = client->input->keyboard;
+	text_input = activate_input_method(client, &state);
+
+	/* A press that bypassed the input method is followed by its
+	 * release, even if the input method grabs everything by then. */
+	send_key(client, KEY_B, WL_KEYBOARD_KEY_STATE_PRESSED);
+	send_command(client, text_input, &state, "grab-all");
+	send_key(client, KEY_B, WL_KEYBOARD_KEY_STATE_RELEASED);
+	client_roundtrip(client);
+	assert(keyboard->key == KEY_B);
+	assert(keyboard->state == WL_KEYBOARD_KEY_STATE_RELEASED);
+	assert(state.keys == 0);
+
+	/* And a press the input method got is followed by its release,
+	 * even if the filter lets the key through by then. */
+	send_key(client, KEY_B, WL_KEYBOARD_KEY_STATE_PRESSED);
+	wait_for(client, &state.keys, 1);
+	send_command(client, text_input, &state, "filter");
+	send_key(client, KEY_B, WL_KEYBOARD_KEY_STATE_RELEASED);
+	wait_for(client, &state.keys, 2);
+	assert(keyboard->key == KEY_B);
+	assert(keyboard->state == WL_KEYBOARD_KEY_STATE_RELEASED);
+
+	wl_text_input_destroy(text_input);
+}
+
+TEST(key_filter_keeps_key_order)
+{
+	struct client *client;
+	struct keyboard *keyboard;
+	struct wl_text_input *text_input;
+	struct input_method_state state;
+
+	client = client_create(100, 100, 100, 100);
+	assert(client);
+	keyboard = client->input->keyboard;
+	text_input = activate_input_method(client, &state);
+
+	/* While the input method holds KEY_A, KEY_B must not overtake
+	 * it, so it goes to the input method too. */
+	send_command(client, text_input, &state, "hold");
+	send_key(client, KEY_A, WL_KEYBOARD_KEY_STATE_PRESSED);
+	send_key(client, KEY_B, WL_KEYBOARD_KEY_STATE_PRESSED);
+	send_key(client, KEY_B, WL_KEYBOARD_KEY_STATE_RELEASED);
+	wait_for(client, &state.keys, 3);
+	assert(keyboard->key == 0);
+
+	send_command(client, text_input, &state, "forward");
+	assert(keyboard->key == KEY_B);
+	assert(keyboard->state == WL_KEYBOARD_KEY_STATE_RELEASED);
+
+	send_key(client, KEY_A, WL_KEYBOARD_KEY_STATE_RELEASED);
+	wait_for(client, &state.keys, 4);
+	assert(keyboard->key == KEY_A);
+	assert(keyboard->state == WL_KEYBOARD_KEY_STATE_RELEASED);
+
+	/* Keys the input method consumes are acknowledged with the
+	 * filter, after which KEY_B bypasses it again. */
+	send_command(client, text_input, &state, "hold");
+	send_key(client, KEY_A, WL_KEYBOARD_KEY_STATE_PRESSED);
+	wait_for(client, &state.keys, 5);
+	send_command(client, text_input, &state, "consume");
+	send_key(client, KEY_B, WL_KEYBOARD_KEY_STATE_PRESSED);
+	client_roundtrip(client);
+	assert(keyboard->key == KEY_B);
+	assert(keyboard->state == WL_KEYBOARD_KEY_STATE_PRESSED);
+	assert(state.keys == 5);
+
+	send_key(client, KEY_B, WL_KEYBOARD_KEY_STATE_RELEASED);
+	send_key(client, KEY_A, WL_KEYBOARD_KEY_STATE_RELEASED);
+	wait_for(client, &state.keys, 6);
+	assert(keyboard->key == KEY_A);
+
+	wl_text_input_destroy(text_input);
+}
+
+TEST(key_filter_queues_modifiers)
+{
+	struct client *client;
+	struct keyboard *keyboard;
+	struct wl_text_input *text_input;
+	struct input_method_state state;
+
+	client = client_create(100, 100, 100, 100);
+	assert(client);
+	keyboard = client->input->keyboard;
+	text_input = activate_input_method(client, &state);
+
+	/* Shift is pressed after KEY_A, so the client must not see it
+	 * before the input method forwards KEY_A. */
+	send_command(client, text_input, &state, "hold");
+	send_key(client, KEY_A, WL_KEYBOARD_KEY_STATE_PRESSED);
+	send_key(client, KEY_LEFTSHIFT, WL_KEYBOARD_KEY_STATE_PRESSED);
+	wait_for(client, &state.keys, 2);
+	client_roundtrip(client);
+	assert(keyboard->key == 0);
+	assert(keyboard->mods_depressed == 0);
+
+	send_command(client, text_input, &state, "forward");
+	assert(keyboard->key == KEY_LEFTSHIFT);
+	assert(keyboard->mods_depressed != 0);
+
+	send_key(client, KEY_LEFTSHIFT, WL_KEYBOARD_KEY_STATE_RELEASED);
+	send_key(client, KEY_A, WL_KEYBOARD_KEY_STATE_RELEASED);
+	wait_for(client, &state.keys, 4);
+	assert(keyboard->key == KEY_A);
+	assert(keyboard->mods_depressed == 0);
+
+	wl_text_input_destroy(text_input);
+}
+
+static double
+timespec_diff_us(const struct timespec *a, const struct timespec *b)
+{
+	return (b->tv_sec - a->tv_sec) * 1000000.0 +
+		(b->tv_nsec - a->tv_nsec) / 1000.0;
+}
+
+/* Time from sending a key press to the client receiving it, for a key
+ * that bypasses the input method and one that goes through it. Both
+ * ends are timed on this client's monotonic clock. */
+static double
+key_latency_us(struct client *client, uint32_t key, int rounds)
+{
+	struct keyboard *keyboard = client->input->keyboard;
+	struct timespec start, end;
+	double total = 0;
+	int i;
+
+	for (i = 0; i < rounds; i++) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		send_key(client, key, WL_KEYBOARD_KEY_STATE_PRESSED);
+		wl_display_flush(client->wl_display);
+		while (keyboard->key != key ||
+		       keyboard->state != WL_KEYBOARD_KEY_STATE_PRESSED)
+			assert(wl_display_dispatch(client->wl_display) >= 0);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		total += timespec_diff_us(&start, &end);
+
+		send_key(client, key, WL_KEYBOARD_KEY_STATE_RELEASED);
+		while (keyboard->state != WL_KEYBOARD_KEY_STATE_RELEASED)
+			assert(wl_display_dispatch(client->wl_display) >= 0);
+	}
+
+	return total / rounds;
+}
+
+TEST(key_filter_latency)
+{
+	struct client *client;
+	struct wl_text_input *text_input;
+	struct input_method_state state;
+	double direct, filtered;
+
+	client = client_create(100, 100, 100, 100);
+	assert(client);
+	text_input = activate_input_method(client, &state);
+
+	direct = key_latency_us(client, KEY_B, 100);
+	filtered = key_latency_us(client, KEY_A, 100);
+
+	fprintf(stderr, "key latency: %.1f us direct, %.1f us through "
+		"the input method\n", direct, filtered);
+
+	wait_for(client, &state.keys, 200);
+
+	wl_text_input_destroy(text_input);
+}
+
+#else
+
+TEST(key_filter_requires_version_2)
+{
+	struct client *client;
+	struct keyboard *keyboard;
+	struct wl_text_input *text_input;
+	struct input_method_state state;
+	int i;
+
+	client = client_create(100, 100, 100, 100);
+	assert(client);
+	keyboard = client->input->keyboard;
+	text_input = activate_input_method(client, &state);
+
+	/* A version 1 input method gets every key. */
+	send_command(client, text_input, &state, "hold");
+	send_key(client, KEY_B, WL_KEYBOARD_KEY_STATE_PRESSED);
+	send_key(client, KEY_B, WL_KEYBOARD_KEY_STATE_RELEASED);
+	wait_for(client, &state.keys, 2);
+	assert(keyboard->key == 0);
+
+	/* Setting a filter is a protocol error that disconnects it, and
+	 * with its keyboard grab gone the keys come to us again. Had the
+	 * request been accepted, the held input method would keep
+	 * swallowing them. */
+	wl_text_input_set_surrounding_text(text_input, "filter", 0, 0);
+	for (i = 0; keyboard->key != KEY_C; i++) {
+		assert(i < 500);
+		send_key(client, KEY_C, WL_KEYBOARD_KEY_STATE_PRESSED);
+		send_key(client, KEY_C, WL_KEYBOARD_KEY_STATE_RELEASED);
+		usleep(10000);
+		client_roundtrip(client);
+	}
+
+	assert(keyboard->state == WL_KEYBOARD_KEY_STATE_RELEASED);
+	assert(state.done == 1);
+
+	wl_text_input_destroy(text_input);
+}
+
+#endif
@@ -0,0 +1,118 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "../src/compositor.h"
+
+#define WIDTH 100
+#define HEIGHT 50
+
+static int
+covers_surface(pixman_region32_t *region, int32_t x, int32_t y)
+{
+	pixman_box32_t box = { x, y, x + WIDTH, y + HEIGHT };
+
+	return pixman_region32_contains_rectangle(region, &box) ==
+		PIXMAN_REGION_IN;
+}
+
+/* None of the surfaces here ever get an opaque region set, like most
+ * clients' surfaces. */
+static void
+opaque_region_from_format(void *data)
+{
+	struct weston_compositor *compositor = data;
+	struct weston_surface *surface;
+	struct wl_client *client;
+	struct wl_buffer *xrgb, *argb;
+	pixman_region32_t requested;
+	int fds[2];
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0);
+	client = wl_client_create(compositor->wl_display, fds[0]);
+	assert(client);
+
+	xrgb = wl_shm_buffer_create(client, 0, WIDTH, HEIGHT, WIDTH * 4,
+				    WL_SHM_FORMAT_XRGB8888);
+	argb = wl_shm_buffer_create(client, 0, WIDTH, HEIGHT, WIDTH * 4,
+				    WL_SHM_FORMAT_ARGB8888);
+	assert(xrgb && argb);
+
+	surface = weston_surface_create(compositor);
+	weston_surface_configure(surface, 10, 20, WIDTH, HEIGHT);
+	pixman_region32_init(&requested);
+
+	/* A buffer without alpha makes the whole surface opaque... */
+	weston_surface_attach(surface, xrgb);
+	weston_surface_update_opaque(surface, &requested);
+	assert(covers_surface(&surface->opaque, 0, 0));
+
+	/* ...which is what occlusion and damage tracking see. */
+	weston_surface_update_transform(surface);
+	assert(covers_surface(&surface->transform.opaque, 10, 20));
+
+	/* A region the client did set doesn't make it any less opaque. */
+	pixman_region32_union_rect(&requested, &requested, 0, 0, 10, 10);
+	weston_surface_update_opaque(surface, &requested);
+	assert(covers_surface(&surface->opaque, 0, 0));
+
+	/* With alpha, the client's region is all there is. */
+	weston_surface_attach(surface, argb);
+	weston_surface_update_opaque(surface, &requested);
+	assert(pixman_region32_equal(&surface->opaque, &requested));
+
+	pixman_region32_clear(&requested);
+	weston_surface_update_opaque(surface, &requested);
+	assert(!pixman_region32_not_empty(&surface->opaque));
+
+	weston_surface_update_transform(surface);
+	assert(!pixman_region32_not_empty(&surface->transform.opaque));
+
+	/* The buffer reference is dropped after repaint, a commit without
+	 * a new buffer still shows the same opaque contents. */
+	weston_surface_attach(surface, xrgb);
+	weston_buffer_reference(&surface->buffer_ref, NULL);
+	weston_surface_update_opaque(surface, &requested);
+	assert(covers_surface(&surface->opaque, 0, 0));
+
+	pixman_region32_fini(&requested);
+	weston_surface_destroy(surface);
+	wl_client_destroy(client);
+	close(fds[1]);
+
+	wl_display_terminate(compositor->wl_display);
+}
+
+WL_EXPORT int
+module_init(struct weston_compositor *compositor, int *argc, char *argv[])
+{
+	struct wl_event_loop *loop;
+
+	loop = wl_display_get_event_loop(compositor->wl_display);
+
+	wl_event_loop_add_idle(loop, opaque_region_from_format, compositor);
+
+	return 0;
+}
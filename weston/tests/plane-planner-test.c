@@ -0,0 +1,373 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <assert.h>
+
+#include "weston-test-runner.h"
+#include "../src/plane-planner.h"
+
+#define ARRAY_LENGTH(a) (sizeof (a) / sizeof (a)[0])
+
+#define XRGB8888 0x34325258
+#define NV12 0x3231564e
+
+static const pixman_box32_t output = { 0, 0, 1024, 768 };
+
+static const uint32_t overlay_formats[] = { XRGB8888 };
+
+static const struct planner_plane cursor_plane = {
+	PLANNER_PLANE_CURSOR, NULL, 0, 64, 64, 0, 2
+};
+
+static const struct planner_plane scanout_plane = {
+	PLANNER_PLANE_SCANOUT, overlay_formats, 1, 0, 0, 0, 0
+};
+
+static const struct planner_plane overlay_plane = {
+	PLANNER_PLANE_OVERLAY, overlay_formats, 1, 0, 0, 1, 1
+};
+
+static struct planner_surface
+surface(int32_t x, int32_t y, int32_t width, int32_t height, uint32_t flags)
+{
+	struct planner_surface s;
+
+	s.box.x1 = x;
+	s.box.y1 = y;
+	s.box.x2 = x + width;
+	s.box.y2 = y + height;
+	s.format = XRGB8888;
+	s.flags = flags;
+
+	return s;
+}
+
+static uint64_t
+area(int32_t width, int32_t height)
+{
+	return (uint64_t) width * height;
+}
+
+/* Checks the rules any assignment has to follow, whatever it costs:
+ * every plane takes at most one surface that it accepts, and nothing
+ * above a surface that overlaps it is displayed below it. */
+static void
+check_assignment(const struct planner_scene *scene, const int *assignment)
+{
+	const struct planner_surface *a, *b;
+	int i, j, scanout = -1;
+
+	for (i = 0; i < scene->surface_count; i++) {
+		if (assignment[i] == PLANNER_PRIMARY)
+			continue;
+
+		assert(assignment[i] >= 0 &&
+		       assignment[i] < scene->plane_count);
+		for (j = 0; j < i; j++)
+			assert(assignment[j] != assignment[i]);
+
+		a = &scene->surfaces[i];
+		assert(!(a->flags & PLANNER_SURFACE_PRIMARY_ONLY));
+		assert(!(a->flags & PLANNER_SURFACE_TRANSFORMED));
+
+		if (scene->planes[assignment[i]].type ==
+		    PLANNER_PLANE_SCANOUT && scanout < 0)
+			scanout = i;
+	}
+
+	for (i = 0; i < scene->surface_count; i++) {
+		if (assignment[i] == PLANNER_PRIMARY)
+			continue;
+		if (scanout >= 0 && i > scanout)
+			assert(0 && "plane used below the scanout surface");
+
+		a = &scene->surfaces[i];
+		for (j = 0; j < i; j++) {
+			b = &scene->surfaces[j];
+			if (a->box.x2 <= b->box.x1 || b->box.x2 <= a->box.x1 ||
+			    a->box.y2 <= b->box.y1 || b->box.y2 <= a->box.y1)
+				continue;
+
+			assert(assignment[j] != PLANNER_PRIMARY);
+			assert(scene->planes[assignment[j]].z >
+			       scene->planes[assignment[i]].z);
+		}
+	}
+}
+
+static uint64_t
+assign(const struct planner_plane *planes, int plane_count,
+       const struct planner_surface *surfaces, int surface_count,
+       int *assignment)
+{
+	struct planner_scene scene;
+	uint64_t composited;
+
+	scene.output = output;
+	scene.planes = planes;
+	scene.plane_count = plane_count;
+	scene.surfaces = surfaces;
+	scene.surface_count = surface_count;
+
+	composited = planner_assign_planes(&scene, assignment);
+	check_assignment(&scene, assignment);
+
+	return composited;
+}
+
+TEST(empty_scene)
+{
+	struct planner_plane planes[] = { cursor_plane, overlay_plane };
+	int assignment[1];
+
+	assert(assign(planes, ARRAY_LENGTH(planes), NULL, 0, assignment) == 0);
+}
+
+TEST(separate_surfaces_use_planes)
+{
+	struct planner_plane planes[] = {
+		cursor_plane, overlay_plane, overlay_plane
+	};
+	struct planner_surface surfaces[] = {
+		surface(10, 10, 32, 32, PLANNER_SURFACE_SHM),
+		surface(100, 100, 320, 240, 0),
+		surface(500, 100, 320, 240, 0),
+		surface(0, 0, 1024, 768, PLANNER_SURFACE_SHM)
+	};
+	int assignment[ARRAY_LENGTH(surfaces)];
+	uint64_t composited;
+
+	composited = assign(planes, ARRAY_LENGTH(planes),
+			    surfaces, ARRAY_LENGTH(surfaces), assignment);
+
+	assert(composited == area(1024, 768));
+	assert(assignment[0] == 0);
+	assert(assignment[1] == 1 || assignment[1] == 2);
+	assert(assignment[2] == 1 || assignment[2] == 2);
+	assert(assignment[3] == PLANNER_PRIMARY);
+}
+
+TEST(composited_surface_above_blocks_plane)
+{
+	struct planner_plane planes[] = { overlay_plane };
+	struct planner_surface surfaces[] = {
+		/* A popup that has to be composited, over the video. */
+		surface(150, 150, 100, 100, PLANNER_SURFACE_PRIMARY_ONLY),
+		surface(100, 100, 320, 240, 0)
+	};
+	int assignment[ARRAY_LENGTH(surfaces)];
+	uint64_t composited;
+
+	composited = assign(planes, ARRAY_LENGTH(planes),
+			    surfaces, ARRAY_LENGTH(surfaces), assignment);
+
+	assert(composited == area(100, 100) + area(320, 240));
+	assert(assignment[0] == PLANNER_PRIMARY);
+	assert(assignment[1] == PLANNER_PRIMARY);
+}
+
+TEST(partially_occluded_surface_keeps_plane_order)
+{
+	struct planner_plane planes[] = { overlay_plane, overlay_plane };
+	struct planner_surface surfaces[] = {
+		surface(200, 200, 320, 240, 0),
+		surface(100, 100, 320, 240, 0)
+	};
+	int assignment[ARRAY_LENGTH(surfaces)];
+	uint64_t composited;
+
+	/* With both overlays at the same z, the order they'd be displayed
+	 * in is undefined, so only one of the overlapping surfaces can
+	 * leave the primary plane; the top one, since otherwise the
+	 * bottom one would be displayed above it. */
+	composited = assign(planes, ARRAY_LENGTH(planes),
+			    surfaces, ARRAY_LENGTH(surfaces), assignment);
+
+	assert(composited == area(320, 240));
+	assert(assignment[0] != PLANNER_PRIMARY);
+	assert(assignment[1] == PLANNER_PRIMARY);
+
+	/* Stacked overlays take both, in the right order. */
+	planes[1].z = 2;
+	composited = assign(planes, ARRAY_LENGTH(planes),
+			    surfaces, ARRAY_LENGTH(surfaces), assignment);
+
+	assert(composited == 0);
+	assert(assignment[0] == 1);
+	assert(assignment[1] == 0);
+}
+
+TEST(largest_surface_gets_the_only_overlay)
+{
+	struct planner_plane planes[] = { overlay_plane };
+	struct planner_surface surfaces[] = {
+		surface(0, 0, 100, 50, 0),
+		surface(200, 100, 640, 480, 0),
+		surface(900, 700, 50, 50, 0)
+	};
+	int assignment[ARRAY_LENGTH(surfaces)];
+	uint64_t composited;
+
+	/* Going top to bottom and taking the first surface that fits
+	 * would put the small one on the overlay. */
+	composited = assign(planes, ARRAY_LENGTH(planes),
+			    surfaces, ARRAY_LENGTH(surfaces), assignment);
+
+	assert(composited == area(100, 50) + area(50, 50));
+	assert(assignment[0] == PLANNER_PRIMARY);
+	assert(assignment[1] == 0);
+	assert(assignment[2] == PLANNER_PRIMARY);
+}
+
+TEST(transformed_surfaces_are_composited)
+{
+	struct planner_plane planes[] = { overlay_plane, overlay_plane };
+	struct planner_surface surfaces[] = {
+		surface(100, 100, 320, 240, PLANNER_SURFACE_TRANSFORMED),
+		surface(500, 100, 320, 240, PLANNER_SURFACE_SCALED)
+	};
+	int assignment[ARRAY_LENGTH(surfaces)];
+	uint64_t composited;
+
+	composited = assign(planes, ARRAY_LENGTH(planes),
+			    surfaces, ARRAY_LENGTH(surfaces), assignment);
+
+	assert(composited == area(320, 240));
+	assert(assignment[0] == PLANNER_PRIMARY);
+	assert(assignment[1] != PLANNER_PRIMARY);
+
+	/* Planes that can't scale don't take scaled surfaces either. */
+	planes[0].can_scale = 0;
+	planes[1].can_scale = 0;
+	composited = assign(planes, ARRAY_LENGTH(planes),
+			    surfaces, ARRAY_LENGTH(surfaces), assignment);
+
+	assert(composited == 2 * area(320, 240));
+	assert(assignment[1] == PLANNER_PRIMARY);
+}
+
+TEST(plane_formats_and_limits)
+{
+	struct planner_plane planes[] = { cursor_plane, overlay_plane };
+	struct planner_surface surfaces[] = {
+		surface(0, 0, 128, 128, PLANNER_SURFACE_SHM),
+		surface(200, 100, 320, 240, 0),
+		surface(600, 100, 320, 240, 0)
+	};
+	int assignment[ARRAY_LENGTH(surfaces)];
+	uint64_t composited;
+
+	surfaces[1].format = NV12;
+	surfaces[2].format = 0;
+
+	/* The cursor is too big for the cursor plane, the overlay can't
+	 * display NV12, and an unknown format is left for the backend
+	 * to check. */
+	composited = assign(planes, ARRAY_LENGTH(planes),
+			    surfaces, ARRAY_LENGTH(surfaces), assignment);
+
+	assert(composited == area(128, 128) + area(320, 240));
+	assert(assignment[0] == PLANNER_PRIMARY);
+	assert(assignment[1] == PLANNER_PRIMARY);
+	assert(assignment[2] == 1);
+}
+
+TEST(fullscreen_surface_uses_scanout)
+{
+	struct planner_plane planes[] = {
+		cursor_plane, scanout_plane, overlay_plane
+	};
+	struct planner_surface surfaces[] = {
+		surface(500, 400, 24, 24, PLANNER_SURFACE_SHM),
+		surface(0, 0, 1024, 768, 0),
+		surface(100, 100, 320, 240, 0),
+		surface(0, 0, 1024, 768, PLANNER_SURFACE_SHM)
+	};
+	int assignment[ARRAY_LENGTH(surfaces)];
+	uint64_t composited;
+
+	/* The pointer stays on top, and nothing below the fullscreen
+	 * surface is composited, or displayed on a plane. */
+	composited = assign(planes, ARRAY_LENGTH(planes),
+			    surfaces, ARRAY_LENGTH(surfaces), assignment);
+
+	assert(composited == 0);
+	assert(assignment[0] == 0);
+	assert(assignment[1] == 1);
+	assert(assignment[2] == PLANNER_PRIMARY);
+	assert(assignment[3] == PLANNER_PRIMARY);
+
+	/* A shm pointer that is too big has to be composited, and then
+	 * so does the fullscreen surface under it, and everything else. */
+	surfaces[0] = surface(500, 400, 96, 96, PLANNER_SURFACE_SHM);
+	composited = assign(planes, ARRAY_LENGTH(planes),
+			    surfaces, ARRAY_LENGTH(surfaces), assignment);
+
+	assert(assignment[0] == PLANNER_PRIMARY);
+	assert(assignment[1] == PLANNER_PRIMARY);
+	assert(assignment[2] == PLANNER_PRIMARY);
+	assert(composited == area(96, 96) + area(320, 240) +
+	       2 * area(1024, 768));
+}
+
+TEST(surfaces_outside_the_output_cost_nothing)
+{
+	struct planner_plane planes[] = { overlay_plane };
+	struct planner_surface surfaces[] = {
+		surface(1024, 0, 640, 480, PLANNER_SURFACE_SHM),
+		surface(1000, 0, 640, 480, 0)
+	};
+	int assignment[ARRAY_LENGTH(surfaces)];
+	uint64_t composited;
+
+	composited = assign(planes, ARRAY_LENGTH(planes),
+			    surfaces, ARRAY_LENGTH(surfaces), assignment);
+
+	assert(assignment[0] == PLANNER_PRIMARY);
+	assert(assignment[1] == PLANNER_PRIMARY);
+	assert(composited == area(24, 480));
+}
+
+TEST(large_scene)
+{
+	struct planner_plane planes[] = {
+		cursor_plane, overlay_plane, overlay_plane, overlay_plane
+	};
+	struct planner_surface surfaces[200];
+	int assignment[ARRAY_LENGTH(surfaces)];
+	uint64_t composited, total = 0;
+	unsigned int i;
+
+	/* A grid of small, overlapping surfaces; too many to search all
+	 * assignments, which must still give a valid one. */
+	for (i = 0; i < ARRAY_LENGTH(surfaces); i++) {
+		surfaces[i] = surface((i % 20) * 50, (i / 20) * 70,
+				      64, 64, i % 3 ? 0 : PLANNER_SURFACE_SHM);
+		total += area(64, 64);
+	}
+
+	composited = assign(planes, ARRAY_LENGTH(planes),
+			    surfaces, ARRAY_LENGTH(surfaces), assignment);
+
+	assert(composited < total);
+}
@@ -0,0 +1,178 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "../src/compositor.h"
+
+#define WARMUP 3
+#define FRAMES 10
+
+/* Top to bottom. Two small surfaces are damaged every frame, so the
+ * damage is two rectangles. Under them a wide surface catches both,
+ * one surface inside the first catches a single rectangle and one far
+ * away none at all. Each frame the renderer works out what to draw for
+ * all of them in the same pool regions. */
+static const struct {
+	int32_t x, y, width, height;
+	int damaged;
+} layout[] = {
+	{ 10, 10, 50, 50, 1 },
+	{ 210, 10, 50, 50, 1 },
+	{ 0, 0, 300, 80, 0 },
+	{ 20, 20, 20, 20, 0 },
+	{ 10, 300, 50, 50, 0 },
+};
+
+#define NSURFACES (sizeof layout / sizeof layout[0])
+
+struct repaint_test {
+	struct weston_compositor *compositor;
+	struct weston_layer layer;
+	struct weston_animation animation;
+	struct wl_client *client;
+	int fds[2];
+	struct weston_surface *surfaces[NSURFACES];
+	uint32_t lost;
+};
+
+static void
+damage_surfaces(struct repaint_test *test)
+{
+	unsigned int i;
+
+	for (i = 0; i < NSURFACES; i++)
+		if (layout[i].damaged)
+			weston_surface_damage(test->surfaces[i]);
+}
+
+static void
+repaint_test_finish(struct repaint_test *test)
+{
+	unsigned int i;
+
+	wl_list_remove(&test->animation.link);
+	for (i = 0; i < NSURFACES; i++)
+		weston_surface_destroy(test->surfaces[i]);
+	wl_client_destroy(test->client);
+	close(test->fds[1]);
+
+	wl_display_terminate(test->compositor->wl_display);
+}
+
+static void
+repaint_test_frame(struct weston_animation *animation,
+		   struct weston_output *output, uint32_t msecs)
+{
+	struct repaint_test *test =
+		container_of(animation, struct repaint_test, animation);
+	struct weston_region_pool *pool = &test->compositor->region_pool;
+
+	/* The first frames size the pool regions, after that no frame
+	 * should take their storage away again. */
+	if (animation->frame_counter == WARMUP)
+		test->lost = pool->lost;
+
+	if (animation->frame_counter == WARMUP + FRAMES) {
+		fprintf(stderr, "pool regions lost storage %u times in "
+			"%d frames\n", pool->lost - test->lost, FRAMES);
+		assert(pool->lost == test->lost);
+		repaint_test_finish(test);
+		return;
+	}
+
+	damage_surfaces(test);
+}
+
+static void
+region_pool_repaint(void *data)
+{
+	struct repaint_test *test = data;
+	struct weston_compositor *compositor = test->compositor;
+	struct weston_output *output;
+	struct weston_surface *surface;
+	struct wl_buffer *buffer;
+	pixman_region32_t opaque;
+	unsigned int i;
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0,
+			  test->fds) == 0);
+	test->client = wl_client_create(compositor->wl_display, test->fds[0]);
+	assert(test->client);
+
+	output = container_of(compositor->output_list.next,
+			      struct weston_output, link);
+
+	/* On top of everything, so nothing the shell shows clips them. */
+	weston_layer_init(&test->layer, &compositor->layer_list);
+
+	for (i = 0; i < NSURFACES; i++) {
+		buffer = wl_shm_buffer_create(test->client, 0,
+					      layout[i].width,
+					      layout[i].height,
+					      layout[i].width * 4,
+					      WL_SHM_FORMAT_ARGB8888);
+		assert(buffer);
+
+		surface = weston_surface_create(compositor);
+		assert(surface);
+		weston_surface_configure(surface,
+					 output->x + layout[i].x,
+					 output->y + layout[i].y,
+					 layout[i].width, layout[i].height);
+		weston_surface_attach(surface, buffer);
+		wl_list_insert(test->layer.surface_list.prev,
+			       &surface->layer_link);
+		weston_surface_update_transform(surface);
+		test->surfaces[i] = surface;
+	}
+
+	/* Only part of the wide surface is opaque, so it gets blended
+	 * and drawn opaque both. */
+	pixman_region32_init_rect(&opaque, 0, 0, 300, 40);
+	weston_surface_update_opaque(test->surfaces[2], &opaque);
+	pixman_region32_fini(&opaque);
+
+	test->animation.frame = repaint_test_frame;
+	test->animation.frame_counter = 0;
+	wl_list_insert(&output->animation_list, &test->animation.link);
+
+	damage_surfaces(test);
+}
+
+WL_EXPORT int
+module_init(struct weston_compositor *compositor, int *argc, char *argv[])
+{
+	static struct repaint_test test;
+	struct wl_event_loop *loop;
+
+	test.compositor = compositor;
+
+	loop = wl_display_get_event_loop(compositor->wl_display);
+
+	wl_event_loop_add_idle(loop, region_pool_repaint, &test);
+
+	return 0;
+}
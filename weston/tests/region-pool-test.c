@@ -0,0 +1,315 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <assert.h>
+#include <dlfcn.h>
+
+#include "weston-test-runner.h"
+#include "../src/region-pool.h"
+
+#define ARRAY_LENGTH(a) (sizeof (a) / sizeof (a)[0])
+
+#define WARMUP 3
+#define FRAMES 10
+
+static void *(*sys_malloc)(size_t);
+static void *(*sys_realloc)(void *, size_t);
+static void *(*sys_calloc)(size_t, size_t);
+static void (*sys_free)(void *);
+static int alloc_calls;
+
+static void
+load_sys(void)
+{
+	sys_calloc = dlsym(RTLD_NEXT, "calloc");
+	sys_realloc = dlsym(RTLD_NEXT, "realloc");
+	sys_malloc = dlsym(RTLD_NEXT, "malloc");
+	sys_free = dlsym(RTLD_NEXT, "free");
+}
+
+__attribute__ ((visibility("default"))) void *
+malloc(size_t size)
+{
+	if (sys_malloc == NULL)
+		load_sys();
+	alloc_calls++;
+
+	return sys_malloc(size);
+}
+
+__attribute__ ((visibility("default"))) void *
+realloc(void *mem, size_t size)
+{
+	if (sys_realloc == NULL)
+		load_sys();
+	alloc_calls++;
+
+	return sys_realloc(mem, size);
+}
+
+/* dlsym() may call calloc() while we're looking it up, it copes with
+ * getting NULL back. */
+__attribute__ ((visibility("default"))) void *
+calloc(size_t nmemb, size_t size)
+{
+	if (sys_calloc == NULL)
+		return NULL;
+	alloc_calls++;
+
+	return sys_calloc(nmemb, size);
+}
+
+__attribute__ ((visibility("default"))) void
+free(void *mem)
+{
+	if (sys_free == NULL)
+		load_sys();
+
+	sys_free(mem);
+}
+
+/* Fragmented damage: six full-width bands, three of them with a hole
+ * punched in by the opaque region, so every intermediate result has
+ * several rectangles. */
+static void
+init_scene(pixman_region32_t *damage, pixman_region32_t *opaque)
+{
+	pixman_box32_t damage_boxes[6], opaque_boxes[3];
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_LENGTH(damage_boxes); i++) {
+		damage_boxes[i].x1 = 0;
+		damage_boxes[i].y1 = i * 20;
+		damage_boxes[i].x2 = 100;
+		damage_boxes[i].y2 = i * 20 + 10;
+	}
+
+	for (i = 0; i < ARRAY_LENGTH(opaque_boxes); i++) {
+		opaque_boxes[i].x1 = 40;
+		opaque_boxes[i].y1 = i * 40;
+		opaque_boxes[i].x2 = 60;
+		opaque_boxes[i].y2 = i * 40 + 5;
+	}
+
+	pixman_region32_init_rects(damage, damage_boxes,
+				   ARRAY_LENGTH(damage_boxes));
+	pixman_region32_init_rects(opaque, opaque_boxes,
+				   ARRAY_LENGTH(opaque_boxes));
+}
+
+/* The region work compositor_accumulate_damage() and draw_surface()
+ * do for one surface. */
+static void
+pooled_frame(struct weston_region_pool *pool,
+	     pixman_region32_t *scene_damage, pixman_region32_t *scene_opaque)
+{
+	pixman_region32_t *damage, *opaque, *plane_damage;
+	int n;
+
+	damage = weston_region_pool_get(pool);
+	opaque = weston_region_pool_get(pool);
+	plane_damage = weston_region_pool_get(pool);
+
+	weston_region_pool_copy(pool, damage, scene_damage);
+	weston_region_pool_copy(pool, opaque, scene_opaque);
+
+	weston_region_pool_subtract(pool, damage, opaque);
+	pixman_region32_rectangles(damage, &n);
+	assert(n == 12);
+
+	weston_region_pool_union(pool, plane_damage, damage);
+	weston_region_pool_union(pool, opaque, damage);
+	pixman_region32_rectangles(opaque, &n);
+	assert(n == 6);
+
+	weston_region_pool_intersect(pool, plane_damage, scene_damage);
+	pixman_region32_rectangles(plane_damage, &n);
+	assert(n == 12);
+
+	weston_region_pool_put(pool, plane_damage);
+	weston_region_pool_put(pool, opaque);
+	weston_region_pool_put(pool, damage);
+}
+
+/* What draw_surface() works out for a surface with the given box:
+ * several rectangles, one or none, depending on where it is. */
+static void
+pooled_draw(struct weston_region_pool *pool, pixman_region32_t *damage,
+	    int32_t x, int32_t y, int32_t width, int32_t height)
+{
+	pixman_region32_t *repaint, box;
+
+	pixman_region32_init_rect(&box, x, y, width, height);
+
+	repaint = weston_region_pool_get(pool);
+	weston_region_pool_copy(pool, repaint, &box);
+	weston_region_pool_intersect(pool, repaint, damage);
+	weston_region_pool_put(pool, repaint);
+
+	pixman_region32_fini(&box);
+}
+
+static void
+unpooled_frame(pixman_region32_t *scene_damage,
+	       pixman_region32_t *scene_opaque)
+{
+	pixman_region32_t damage, opaque, plane_damage;
+
+	pixman_region32_init(&damage);
+	pixman_region32_init(&opaque);
+	pixman_region32_init(&plane_damage);
+
+	pixman_region32_copy(&damage, scene_damage);
+	pixman_region32_copy(&opaque, scene_opaque);
+	pixman_region32_subtract(&damage, &damage, &opaque);
+	pixman_region32_union(&plane_damage, &plane_damage, &damage);
+	pixman_region32_union(&opaque, &opaque, &damage);
+	pixman_region32_intersect(&plane_damage, &plane_damage, scene_damage);
+
+	pixman_region32_fini(&plane_damage);
+	pixman_region32_fini(&opaque);
+	pixman_region32_fini(&damage);
+}
+
+TEST(pool_get_put)
+{
+	struct weston_region_pool pool;
+	pixman_region32_t *regions[WESTON_REGION_POOL_SIZE + 1];
+	int i;
+
+	weston_region_pool_init(&pool);
+
+	for (i = 0; i < WESTON_REGION_POOL_SIZE + 1; i++) {
+		regions[i] = weston_region_pool_get(&pool);
+		assert(regions[i]);
+		assert(!pixman_region32_not_empty(regions[i]));
+		pixman_region32_union_rect(regions[i], regions[i],
+					   i, i, 10, 10);
+	}
+
+	/* The pool is exhausted, so the last one came from the heap. */
+	assert(pool.used == (1u << WESTON_REGION_POOL_SIZE) - 1);
+	for (i = 0; i < WESTON_REGION_POOL_SIZE; i++)
+		assert(regions[i] == &pool.regions[i]);
+	assert(regions[WESTON_REGION_POOL_SIZE] < pool.regions ||
+	       regions[WESTON_REGION_POOL_SIZE] >=
+	       pool.regions + WESTON_REGION_POOL_SIZE);
+
+	for (i = 0; i < WESTON_REGION_POOL_SIZE + 1; i++)
+		weston_region_pool_put(&pool, regions[i]);
+	assert(pool.used == 0);
+
+	/* Given back regions are handed out again, emptied. */
+	regions[0] = weston_region_pool_get(&pool);
+	assert(regions[0] == &pool.regions[0]);
+	assert(!pixman_region32_not_empty(regions[0]));
+	weston_region_pool_put(&pool, regions[0]);
+
+	weston_region_pool_release(&pool);
+}
+
+TEST(clear_keeps_storage)
+{
+	pixman_region32_t damage, opaque, region;
+	int n;
+
+	init_scene(&damage, &opaque);
+	pixman_region32_init(&region);
+	pixman_region32_copy(&region, &damage);
+
+	weston_region_clear(&region);
+	assert(!pixman_region32_not_empty(&region));
+	pixman_region32_rectangles(&region, &n);
+	assert(n == 0);
+
+	alloc_calls = 0;
+	pixman_region32_copy(&region, &damage);
+	assert(alloc_calls == 0);
+	assert(pixman_region32_equal(&region, &damage));
+
+	pixman_region32_fini(&region);
+	pixman_region32_fini(&opaque);
+	pixman_region32_fini(&damage);
+}
+
+TEST(pooled_frames_do_not_allocate)
+{
+	struct weston_region_pool pool;
+	pixman_region32_t damage, opaque;
+	int i;
+
+	init_scene(&damage, &opaque);
+	weston_region_pool_init(&pool);
+
+	/* The first frames size the scratch regions, storage moves
+	 * between them until all of it is big enough... */
+	for (i = 0; i < WARMUP; i++)
+		pooled_frame(&pool, &damage, &opaque);
+
+	/* ...after which the same work doesn't allocate at all. */
+	alloc_calls = 0;
+	for (i = 0; i < FRAMES; i++)
+		pooled_frame(&pool, &damage, &opaque);
+	assert(alloc_calls == 0);
+
+	/* While doing it with temporaries does, every frame. */
+	alloc_calls = 0;
+	for (i = 0; i < FRAMES; i++)
+		unpooled_frame(&damage, &opaque);
+	assert(alloc_calls >= FRAMES);
+
+	weston_region_pool_release(&pool);
+	pixman_region32_fini(&opaque);
+	pixman_region32_fini(&damage);
+}
+
+TEST(small_results_keep_storage)
+{
+	struct weston_region_pool pool;
+	pixman_region32_t damage, opaque;
+	int i;
+
+	init_scene(&damage, &opaque);
+	weston_region_pool_init(&pool);
+
+	/* Surfaces that only catch one rectangle of the damage, or none,
+	 * don't cost the next one its storage. */
+	for (i = 0; i < WARMUP + FRAMES; i++) {
+		if (i == WARMUP)
+			alloc_calls = 0;
+
+		pooled_draw(&pool, &damage, 200, 0, 10, 10);
+		pooled_draw(&pool, &damage, 0, 0, 100, 120);
+		pooled_draw(&pool, &damage, 10, 0, 10, 10);
+		pooled_draw(&pool, &damage, 0, 0, 100, 120);
+		pooled_draw(&pool, &damage, 0, 0, 100, 30);
+	}
+	assert(alloc_calls == 0);
+	assert(pool.lost == 0);
+
+	weston_region_pool_release(&pool);
+	pixman_region32_fini(&opaque);
+	pixman_region32_fini(&damage);
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <assert.h>
+#include <math.h>
+
+#include "weston-test-runner.h"
+#include "../src/compositor.h"
+
+#define ARRAY_LENGTH(a) (sizeof (a) / sizeof (a)[0])
+
+#define EPSILON 0.0002
+
+struct spring_params {
+	double k, friction, current, target;
+};
+
+/* k and friction as used by the surface animations, by zoom and by
+ * weston_spring_init()'s default friction. */
+static const struct spring_params params[] = {
+	{ 200.0, 700.0, 0.0, 1.0 },
+	{ 250.0, 1000.0, 0.0, 1.5 },
+	{ 400.0, 400.0, 1.0, 0.0 },
+	{ 200.0, 700.0, 0.8, 0.2 },
+};
+
+int
+weston_log(const char *fmt, ...)
+{
+	return 0;
+}
+
+/* What weston_spring_update() used to do. */
+static void
+integrate(struct weston_spring *spring, uint32_t msec)
+{
+	double force, v, current, step;
+
+	step = 0.01;
+	while (4 < msec - spring->timestamp) {
+		current = spring->current;
+		v = current - spring->previous;
+		force = spring->k * (spring->target - current) / 10.0 +
+			(spring->previous - current) - v * spring->friction;
+
+		spring->current =
+			current + (current - spring->previous) +
+			force * step * step;
+		spring->previous = current;
+
+		spring->timestamp += 4;
+	}
+}
+
+static void
+init_spring(struct weston_spring *spring, const struct spring_params *p,
+	    uint32_t msec)
+{
+	weston_spring_init(spring, p->k, p->current, p->target);
+	spring->friction = p->friction;
+	spring->timestamp = msec;
+}
+
+TEST(matches_integrator)
+{
+	struct weston_spring spring, reference;
+	uint32_t start = 1000;
+	unsigned int i, n;
+
+	for (i = 0; i < ARRAY_LENGTH(params); i++) {
+		init_spring(&spring, &params[i], start);
+		init_spring(&reference, &params[i], start);
+
+		for (n = 1; n <= 250; n++) {
+			/* The integrator stops short of msec, so this
+			 * leaves it exactly at start + 4n. */
+			integrate(&reference, start + 4 * n + 1);
+			weston_spring_update(&spring, start + 4 * n);
+
+			assert(reference.timestamp == spring.timestamp);
+			assert(fabs(reference.current - spring.current) < 1e-9);
+			assert(fabs(reference.previous - spring.previous) < 1e-9);
+		}
+	}
+}
+
+TEST(timing_independent)
+{
+	static const uint32_t frames[] = { 1, 7, 16, 3, 17, 33 };
+	struct weston_spring spring, reference;
+	uint32_t start = 5000, msec;
+	unsigned int i, n;
+
+	for (i = 0; i < ARRAY_LENGTH(params); i++) {
+		init_spring(&spring, &params[i], start);
+		init_spring(&reference, &params[i], start);
+
+		msec = start;
+		for (n = 0; msec - start < 900; n++) {
+			msec += frames[n % ARRAY_LENGTH(frames)];
+			weston_spring_update(&spring, msec);
+		}
+
+		/* One long frame ends up in the same place as many
+		 * irregular ones. */
+		weston_spring_update(&reference, msec);
+		assert(fabs(reference.current - spring.current) < 1e-9);
+		assert(fabs(reference.previous - spring.previous) < 1e-9);
+	}
+}
+
+TEST(done_is_final)
+{
+	struct weston_spring spring;
+	uint32_t start = 0, msec;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_LENGTH(params); i++) {
+		init_spring(&spring, &params[i], start);
+		assert(!weston_spring_done(&spring));
+
+		for (msec = start; !weston_spring_done(&spring); msec += 16) {
+			assert(msec - start < 10000);
+			weston_spring_update(&spring, msec);
+		}
+
+		/* Once done, the spring never leaves its target again. */
+		for (; msec - start < 20000; msec += 16) {
+			weston_spring_update(&spring, msec);
+			assert(fabs(spring.current - spring.target) < EPSILON);
+			assert(weston_spring_done(&spring));
+		}
+	}
+}
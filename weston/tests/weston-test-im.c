@@ -0,0 +1,349 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Input method driven by input-method-test. It reports what it sees
+ * through commit_string and takes commands through the surrounding
+ * text of the text input:
+ *
+ *   hold      keep the keys we get instead of forwarding them
+ *   forward   forward the held keys and stop holding
+ *   consume   drop the held keys, acknowledge them and stop holding
+ *   grab-all  clear the key filter
+ *   filter    set the key filter again
+ *
+ * Every command is answered with "done", every key with "key" and the
+ * keyboard grab with "ready". Built with TEST_IM_VERSION=1 it binds
+ * version 1 of wl_input_method, and the compositor kills it when it
+ * sets a key filter. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wayland-client.h>
+#include <xkbcommon/xkbcommon.h>
+
+#include "../clients/input-method-client-protocol.h"
+
+#ifndef TEST_IM_VERSION
+#define TEST_IM_VERSION 2
+#endif
+
+struct held_key {
+	uint32_t serial;
+	uint32_t time;
+	uint32_t key;
+	uint32_t state;
+};
+
+struct test_im {
+	struct wl_display *display;
+	struct wl_registry *registry;
+	struct wl_input_method *input_method;
+	struct wl_input_method_context *context;
+	struct wl_keyboard *keyboard;
+
+	int hold;
+	struct wl_array held;
+	uint32_t key_serial;
+};
+
+static void
+test_im_report(struct test_im *im, const char *text)
+{
+	wl_input_method_context_commit_string(im->context, 0, text);
+}
+
+static void
+test_im_set_key_filter(struct test_im *im)
+{
+	struct wl_array keysyms;
+	uint32_t *sym;
+
+	wl_array_init(&keysyms);
+	sym = wl_array_add(&keysyms, sizeof *sym);
+	if (sym) {
+		*sym = XKB_KEY_a;
+		wl_input_method_context_set_key_filter(im->context,
+						       im->key_serial,
+						       &keysyms, 0);
+	}
+	wl_array_release(&keysyms);
+}
+
+static void
+test_im_release_held(struct test_im *im, int forward)
+{
+	struct held_key *k;
+
+	wl_array_for_each(k, &im->held)
+		if (forward)
+			wl_input_method_context_key(im->context, k->serial,
+						    k->time, k->key,
+						    k->state);
+
+	im->held.size = 0;
+	im->hold = 0;
+}
+
+static void
+handle_surrounding_text(void *data,
+			struct wl_input_method_context *context,
+			const char *text,
+			uint32_t cursor,
+			uint32_t anchor)
+{
+	struct test_im *im = data;
+
+	if (strcmp(text, "hold") == 0) {
+		im->hold = 1;
+	} else if (strcmp(text, "forward") == 0) {
+		test_im_release_held(im, 1);
+	} else if (strcmp(text, "consume") == 0) {
+		test_im_release_held(im, 0);
+		test_im_set_key_filter(im);
+	} else if (strcmp(text, "grab-all") == 0) {
+		wl_input_method_context_clear_key_filter(context,
+							 im->key_serial);
+	} else if (strcmp(text, "filter") == 0) {
+		test_im_set_key_filter(im);
+	}
+
+	test_im_report(im, "done");
+}
+
+static void
+handle_reset(void *data,
+	     struct wl_input_method_context *context)
+{
+}
+
+static void
+handle_content_type(void *data,
+		    struct wl_input_method_context *context,
+		    uint32_t hint,
+		    uint32_t purpose)
+{
+}
+
+static void
+handle_invoke_action(void *data,
+		     struct wl_input_method_context *context,
+		     uint32_t button,
+		     uint32_t index)
+{
+}
+
+static void
+handle_commit_state(void *data,
+		    struct wl_input_method_context *context,
+		    uint32_t serial)
+{
+}
+
+static void
+handle_preferred_language(void *data,
+			  struct wl_input_method_context *context,
+			  const char *language)
+{
+}
+
+static const struct wl_input_method_context_listener input_method_context_listener = {
+	handle_surrounding_text,
+	handle_reset,
+	handle_content_type,
+	handle_invoke_action,
+	handle_commit_state,
+	handle_preferred_language
+};
+
+static void
+input_method_keyboard_keymap(void *data,
+			     struct wl_keyboard *wl_keyboard,
+			     uint32_t format,
+			     int32_t fd,
+			     uint32_t size)
+{
+	struct test_im *im = data;
+
+	close(fd);
+
+	test_im_report(im, "ready");
+}
+
+static void
+input_method_keyboard_key(void *data,
+			  struct wl_keyboard *wl_keyboard,
+			  uint32_t serial,
+			  uint32_t time,
+			  uint32_t key,
+			  uint32_t state)
+{
+	struct test_im *im = data;
+	struct held_key *k;
+
+	im->key_serial = serial;
+
+	if (im->hold) {
+		k = wl_array_add(&im->held, sizeof *k);
+		if (!k)
+			abort();
+		k->serial = serial;
+		k->time = time;
+		k->key = key;
+		k->state = state;
+	} else {
+		wl_input_method_context_key(im->context, serial, time,
+					    key, state);
+	}
+
+	test_im_report(im, "key");
+}
+
+static void
+input_method_keyboard_modifiers(void *data,
+				struct wl_keyboard *wl_keyboard,
+				uint32_t serial,
+				uint32_t mods_depressed,
+				uint32_t mods_latched,
+				uint32_t mods_locked,
+				uint32_t group)
+{
+	struct test_im *im = data;
+
+	wl_input_method_context_modifiers(im->context, serial,
+					  mods_depressed, mods_latched,
+					  mods_locked, group);
+}
+
+static const struct wl_keyboard_listener input_method_keyboard_listener = {
+	input_method_keyboard_keymap,
+	NULL, /* enter */
+	NULL, /* leave */
+	input_method_keyboard_key,
+	input_method_keyboard_modifiers
+};
+
+static void
+input_method_activate(void *data,
+		      struct wl_input_method *input_method,
+		      struct wl_input_method_context *context)
+{
+	struct test_im *im = data;
+
+	if (im->context)
+		wl_input_method_context_destroy(im->context);
+
+	im->context = context;
+	im->hold = 0;
+	im->held.size = 0;
+	im->key_serial = 0;
+
+	wl_input_method_context_add_listener(context,
+					     &input_method_context_listener,
+					     im);
+
+	if (TEST_IM_VERSION >= 2)
+		test_im_set_key_filter(im);
+
+	im->keyboard = wl_input_method_context_grab_keyboard(context);
+	wl_keyboard_add_listener(im->keyboard,
+				 &input_method_keyboard_listener, im);
+}
+
+static void
+input_method_deactivate(void *data,
+			struct wl_input_method *input_method,
+			struct wl_input_method_context *context)
+{
+	struct test_im *im = data;
+
+	if (!im->context)
+		return;
+
+	wl_input_method_context_destroy(im->context);
+	im->context = NULL;
+}
+
+static const struct wl_input_method_listener input_method_listener = {
+	input_method_activate,
+	input_method_deactivate
+};
+
+static void
+registry_handle_global(void *data, struct wl_registry *registry,
+		       uint32_t name, const char *interface,
+		       uint32_t version)
+{
+	struct test_im *im = data;
+
+	if (strcmp(interface, "wl_input_method") == 0) {
+		im->input_method =
+			wl_registry_bind(registry, name,
+					 &wl_input_method_interface,
+					 TEST_IM_VERSION);
+		wl_input_method_add_listener(im->input_method,
+					     &input_method_listener, im);
+	}
+}
+
+static void
+registry_handle_global_remove(void *data, struct wl_registry *registry,
+			      uint32_t name)
+{
+}
+
+static const struct wl_registry_listener registry_listener = {
+	registry_handle_global,
+	registry_handle_global_remove
+};
+
+int
+main(int argc, char *argv[])
+{
+	struct test_im im;
+	int ret = 0;
+
+	memset(&im, 0, sizeof im);
+	wl_array_init(&im.held);
+
+	im.display = wl_display_connect(NULL);
+	if (im.display == NULL) {
+		fprintf(stderr, "failed to connect to server: %m\n");
+		return -1;
+	}
+
+	im.registry = wl_display_get_registry(im.display);
+	wl_registry_add_listener(im.registry, &registry_listener, &im);
+	wl_display_roundtrip(im.display);
+	if (im.input_method == NULL) {
+		fprintf(stderr, "No input_method global\n");
+		return -1;
+	}
+
+	while (ret != -1)
+		ret = wl_display_dispatch(im.display);
+
+	fprintf(stderr, "weston-test-im: dispatch error: %m\n");
+
+	return 0;
+}
@@ -33,6 +33,7 @@
 #include <stdio.h>
 #include <fcntl.h>
 #include <string.h>
+#include <time.h>
 #include <xcb/xcb.h>
 #include <xcb/dri2.h>
 #include <xf86drm.h>
@@ -111,6 +112,75 @@ create_window(void)
 	return 0;
 }
 
+static double
+elapsed_ms(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) * 1000.0 +
+		(now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+#ifdef XWAYLAND_PRESTART
+#define XSERVER_START "prestarted"
+#else
+#define XSERVER_START "started on connect"
+#endif
+
+/*
+ * Time from connecting to the X server until the window manager has
+ * mapped our first window.  This runs before the other tests, so the
+ * connection is what starts the X server.  xwayland-prestart-test runs
+ * the same with prestart set in weston.ini, where the server is already
+ * starting up by then.
+ */
+TEST(xwayland_first_window_test)
+{
+	xcb_connection_t *c;
+	xcb_screen_t *screen;
+	xcb_window_t win;
+	xcb_generic_event_t *event;
+	struct timespec start;
+	uint32_t values[1];
+	double connected;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	c = xcb_connect(NULL, NULL);
+	assert(c && !xcb_connection_has_error(c));
+	connected = elapsed_ms(&start);
+
+	screen = xcb_setup_roots_iterator(xcb_get_setup(c)).data;
+
+	values[0] = XCB_EVENT_MASK_STRUCTURE_NOTIFY;
+	win = xcb_generate_id(c);
+	xcb_create_window(c, XCB_COPY_FROM_PARENT, win, screen->root,
+			0, 0, 150, 150, 1, XCB_WINDOW_CLASS_INPUT_OUTPUT,
+			screen->root_visual, XCB_CW_EVENT_MASK, values);
+	xcb_map_window(c, win);
+	xcb_flush(c);
+
+	/* The root window is redirected by the time the server accepts
+	 * connections, so this only comes in once the wm has mapped it. */
+	while (event = xcb_wait_for_event(c), event != NULL) {
+		if ((event->response_type & ~0x80) == XCB_MAP_NOTIFY) {
+			free(event);
+			break;
+		}
+		free(event);
+	}
+	assert(event != NULL);
+
+	printf("X server " XSERVER_START ": connected after %.1f ms, "
+	       "first window mapped after %.1f ms\n",
+	       connected, elapsed_ms(&start));
+
+	xcb_destroy_window(c, win);
+	xcb_disconnect(c);
+}
+
 /*
  * Ideally, the X Window Manager (XWM) and Weston Wayland compositor shouldn't
  * be in the same process because they are using two different protocol